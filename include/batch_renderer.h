@@ -0,0 +1,130 @@
+#pragma once
+
+#include "blocking_queue.h"
+#include "headless_renderer.h"
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+// A client connected to the job socket. Results are written back on the
+// connection the job came from; the descriptor is closed when neither the
+// reader nor any pending job refers to the client any more.
+class job_client {
+    public:
+        explicit job_client(int fd);
+        ~job_client();
+
+        job_client(const job_client &) = delete;
+        job_client &operator=(const job_client &) = delete;
+
+        void reply(const std::string &line);
+
+    private:
+        int fd;
+        std::mutex mutex;
+};
+
+// One line of the job stream, e.g.
+//   output=frame.ppm size=640x480 clear=0.1,0.1,0.1 offset=0.2,0 scale=0.5 rotation=45
+struct render_job {
+    std::uint64_t id = 0;
+    std::string output_path;
+    VkExtent2D extent;
+    float clear_color[3] = { 0.0f, 0.0f, 0.0f };
+    scene_transform transform;
+
+    std::chrono::steady_clock::time_point received;
+    std::shared_ptr<job_client> client;
+};
+
+render_job parse_render_job(const std::string &line);
+
+// A job whose pixels have been read back, or which failed
+struct completed_job {
+    render_job job;
+    std::vector<std::uint8_t> pixels;
+    std::string error;
+};
+
+// Renders a stream of jobs read from stdin or a Unix socket. Jobs are spread
+// over MAX_FRAMES_IN_FLIGHT slots: while the GPU renders one job, the slot of
+// the previous one is read back on the render thread and its image is encoded
+// and written on a separate writer thread.
+class batch_renderer {
+    public:
+        // An empty socket_path reads jobs from stdin until end of file;
+        // otherwise jobs are accepted on the socket until a client sends "quit".
+        // Jobs are rendered by the CPU rasterizer when use_cpu is set or no
+        // Vulkan device is available.
+        void run(const std::string &socket_path, bool use_cpu);
+
+        // Renders the given jobs on the device, pipelined the same way, and
+        // hands each result to on_result on the calling thread in job order
+        void render(std::vector<render_job> jobs, const std::function<void(completed_job &)> &on_result);
+
+    private:
+        struct slot {
+            VkCommandBuffer command_buffer;
+            VkFence fence;
+            VkExtent2D extent = { 0, 0 };
+            VkImage image = VK_NULL_HANDLE;
+            VkDeviceMemory image_memory = VK_NULL_HANDLE;
+            VkImageView image_view = VK_NULL_HANDLE;
+            VkFramebuffer framebuffer = VK_NULL_HANDLE;
+            VkBuffer readback_buffer = VK_NULL_HANDLE;
+            VkDeviceMemory readback_buffer_memory = VK_NULL_HANDLE;
+            void *readback_data = nullptr;
+            std::optional<render_job> job;
+        };
+
+        void init();
+        void cleanup();
+        void create_command_pool();
+        void create_slots();
+        void create_slot_targets(slot &target, VkExtent2D extent);
+        void destroy_slot_targets(slot &target);
+
+        void open_job_socket(const std::string &socket_path);
+        void close_stop_pipe();
+        void read_jobs_from_stdin();
+        void read_jobs_from_socket(const std::string &socket_path);
+        void accept_job_line(const std::string &line, const std::shared_ptr<job_client> &client);
+
+        void render_on_cpu();
+        void submit_job(render_job job);
+        void retire_oldest_slot();
+        void deliver(completed_job &result);
+        void record_command_buffer(slot &target, const render_job &job);
+
+        void write_results();
+        void report_summary();
+
+        headless_device shared;
+        std::uint32_t max_image_dimension;
+        VkCommandPool command_pool;
+        std::vector<slot> slots;
+        std::uint32_t next_slot = 0;
+        std::uint32_t slots_in_flight = 0;
+        std::uint64_t next_job_id = 0;
+        int listen_fd = -1;
+        int stop_reader_fds[2] = { -1, -1 };
+
+        blocking_queue<render_job> pending_jobs;
+        blocking_queue<completed_job> completed_jobs;
+        std::function<void(completed_job &)> result_handler;
+
+        // Only touched by the writer thread until it has been joined
+        std::vector<double> latencies_ms;
+        std::uint64_t failed_jobs = 0;
+        std::chrono::steady_clock::time_point first_job_received;
+        std::chrono::steady_clock::time_point last_job_written;
+        bool any_job_received = false;
+};
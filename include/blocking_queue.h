@@ -0,0 +1,55 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+// Unbounded multi-producer, multi-consumer queue. Once closed, pop() drains
+// the remaining items and then returns false.
+template <typename T>
+class blocking_queue {
+    public:
+        void push(T item) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                items.push_back(std::move(item));
+            }
+            available.notify_one();
+        }
+
+        bool pop(T &item) {
+            std::unique_lock<std::mutex> lock(mutex);
+            available.wait(lock, [this]() { return !items.empty() || closed; });
+            if (items.empty()) {
+                return false;
+            }
+            item = std::move(items.front());
+            items.pop_front();
+            return true;
+        }
+
+        bool try_pop(T &item) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (items.empty()) {
+                return false;
+            }
+            item = std::move(items.front());
+            items.pop_front();
+            return true;
+        }
+
+        void close() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                closed = true;
+            }
+            available.notify_all();
+        }
+
+    private:
+        std::mutex mutex;
+        std::condition_variable available;
+        std::deque<T> items;
+        bool closed = false;
+};
@@ -5,6 +5,91 @@ const std::uint32_t WINDOW_WIDTH = 800;
 const std::uint32_t WINDOW_HEIGHT = 600;
 const int MAX_FRAMES_IN_FLIGHT = 2;
 
+// Dynamic resolution: the scene is rendered at a fraction of the swap chain
+// extent and the fraction is steered towards this frame-time budget.
+const double FRAME_TIME_BUDGET_MS = 1000.0 / 60.0;
+const float MIN_RENDER_SCALE = 0.5f;
+const float MAX_RENDER_SCALE = 1.0f;
+const double STATS_REPORT_INTERVAL_S = 1.0;
+
+// Clamped to the device's framebufferColorSampleCounts, 1 disables MSAA
+const std::uint32_t MSAA_SAMPLES = 4;
+
+// Bindless materials: every instance selects its texture, through a per-instance
+// vertex attribute, from one large, partially bound descriptor array, so no
+// per-draw descriptor binds are needed.
+// INSTANCE_COUNT triangles are laid out on a grid and cycle through
+// TEXTURE_COUNT procedural textures (texture 0 is plain white).
+const bool enable_bindless_materials = true;
+const std::uint32_t MAX_BINDLESS_TEXTURES = 4096;
+const std::uint32_t TEXTURE_COUNT = 64;
+const std::uint32_t TEXTURE_SIZE = 64;
+const std::uint32_t INSTANCE_COUNT = 1;
+
+// Memory budget: device-local usage is checked against the budget reported by
+// VK_EXT_memory_budget at this interval. Above MEMORY_PRESSURE_HIGH the window
+// gives up MSAA and then lowers the render scale limit by RENDER_SCALE_LIMIT_STEP
+// at a time, shrinking its render targets; they are restored while the
+// estimated usage afterwards stays below MEMORY_PRESSURE_LOW.
+const double MEMORY_BUDGET_CHECK_INTERVAL_S = 1.0;
+const double MEMORY_PRESSURE_HIGH = 0.9;
+const double MEMORY_PRESSURE_LOW = 0.75;
+const float RENDER_SCALE_LIMIT_STEP = 0.75f;
+
+// Pipeline variants: the fragment shaders take a material as specialization
+// constant 0, and the triangle grid is drawn in one run of instances per
+// material. Every variant in use is compiled at startup, in parallel, through
+// a pipeline cache that persists in WINDOW_PIPELINE_CACHE_FILE.
+const std::uint32_t MATERIAL_OPAQUE = 0;
+const std::uint32_t MATERIAL_GREYSCALE = 1;
+const std::uint32_t MATERIAL_TRANSLUCENT = 2;
+const std::uint32_t MATERIAL_COUNT = 3;
+const char *const WINDOW_PIPELINE_CACHE_FILE = "window_pipeline_cache.bin";
+
+// Tessellation stress mode: the triangle is subdivided into up to about a billion
+// triangles on the GPU, by a compute pre-pass into a vertex buffer or, with
+// VK_EXT_mesh_shader, by mesh shaders every frame. The group sizes match the
+// local sizes of tessellate.comp and tessellate.mesh.
+const std::uint32_t TESSELLATION_COMPUTE_GROUP_SIZE = 64;
+const std::uint32_t TESSELLATION_MESH_GROUP_SIZE = 32;
+
+// Occlusion culling mode: a dense scene of small instances behind a few large
+// occluders, culled every frame against a hierarchical Z pyramid built from
+// the depth buffer. The group sizes match the local sizes of
+// occlusion_cull.comp and hiz_build.comp.
+const std::uint32_t OCCLUSION_CULL_GROUP_SIZE = 64;
+const std::uint32_t HIZ_GROUP_SIZE = 8;
+
+// Frame export: frames are rendered into a ring of this many exportable
+// images; the exporter only renders into one the consumer has released.
+const std::uint32_t EXPORT_RING_SIZE = 3;
+
+// Performance regression gate (--perf-record, --perf-check): a scenario is
+// run PERF_RUNS times. A metric regresses when its median over the runs grows
+// by more than its threshold and a one-sided Mann-Whitney U test puts the
+// odds of that being noise below PERF_SIGNIFICANCE; peak memory barely varies
+// between runs, so for it the threshold alone decides.
+const std::uint32_t PERF_RUNS = 7;
+const double PERF_SIGNIFICANCE = 0.01;
+const double PERF_STARTUP_THRESHOLD = 0.10;
+const double PERF_FRAME_TIME_THRESHOLD = 0.10;
+const double PERF_MEMORY_THRESHOLD = 0.05;
+
+// CPU rasterizer, used when there is no Vulkan device. Work is split into
+// square tiles spread over all hardware threads.
+const std::uint32_t CPU_TILE_SIZE = 64;
+const char *const CPU_FALLBACK_OUTPUT = "triangle.ppm";
+
+// Texture streaming: files are decoded by worker threads into a staging ring
+// of this size, which bounds how much decoded data can wait for upload.
+// Streamed textures replace the procedural ones as they arrive.
+const std::uint32_t STREAMING_DECODE_THREADS = 2;
+const std::uint64_t STREAMING_STAGING_SIZE = 64 * 1024 * 1024;
+
+// Mesh files are uploaded through two staging chunks of this size when the
+// device cannot read the file mapping directly
+const std::uint64_t MESH_STAGING_CHUNK_SIZE = 16 * 1024 * 1024;
+
 const std::vector<const char *> validation_layers = {
     "VK_LAYER_KHRONOS_validation"
 };
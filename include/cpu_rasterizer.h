@@ -0,0 +1,84 @@
+#pragma once
+
+#include "headless_renderer.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Screen-space triangle prepared for rasterization. Vertices are snapped to
+// the same 8-bit subpixel grid Vulkan devices commonly use, so the edge
+// functions are exact integers (held in doubles, which represent them
+// exactly within the guard band) and coverage matches the device bit for bit.
+struct cpu_triangle {
+    // Edge i runs from vertex i to vertex i + 1 and is
+    // e = a * x + b * y + c at the pixel center (x, y) in subpixel units
+    double a[3];
+    double b[3];
+    double c[3];
+    // A sample exactly on an edge is only inside for top and left edges
+    double min_value[3];
+    double inv_double_area;
+    float colors[3][3];
+    std::int32_t min_x, min_y, max_x, max_y;
+};
+
+// A screen-space vertex before snapping, in pixels
+struct clip_vertex {
+    double x, y;
+    float color[3];
+};
+
+using cpu_span_kernel = void (*)(const cpu_triangle &triangle, std::int32_t y, std::int32_t x_begin, std::int32_t x_end, std::uint8_t *row);
+
+// Tiled, multithreaded software rasterizer for the geometry of shader.vert
+// (placed by a scene_transform like scene.vert), with barycentric color
+// interpolation. Spans are shaded by an AVX2, SSE2 or scalar kernel,
+// whichever the CPU supports; all of them produce identical output.
+class cpu_rasterizer {
+    public:
+        // thread_count 0 uses every hardware thread
+        explicit cpu_rasterizer(std::uint32_t thread_count = 0);
+        ~cpu_rasterizer();
+
+        cpu_rasterizer(const cpu_rasterizer &) = delete;
+        cpu_rasterizer &operator=(const cpu_rasterizer &) = delete;
+
+        // Renders into tightly packed RGBA8 pixels, resized as needed
+        void render(const scene_transform &transform, const float clear_color[3], std::uint32_t width, std::uint32_t height,
+                std::vector<std::uint8_t> &pixels);
+
+        const char *kernel_name() const;
+        std::uint32_t thread_count() const;
+
+    private:
+        void setup_triangle(const scene_transform &transform);
+        void add_triangle(const clip_vertex &v0, const clip_vertex &v1, const clip_vertex &v2);
+        void worker_loop();
+        void render_tiles();
+        void render_tile(std::uint32_t tile);
+
+        cpu_span_kernel kernel;
+        const char *kernel_description;
+
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable work_ready;
+        std::condition_variable work_done;
+        std::uint64_t generation = 0;
+        std::uint32_t busy_workers = 0;
+        bool stopping = false;
+
+        // State of the frame being rendered, written before the workers start
+        std::vector<cpu_triangle> triangles;
+        std::uint32_t width;
+        std::uint32_t height;
+        std::vector<std::uint8_t> clear_row;
+        std::uint8_t *target;
+        std::uint32_t tiles_x;
+        std::uint32_t tile_count;
+        std::atomic<std::uint32_t> next_tile;
+};
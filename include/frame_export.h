@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <sys/types.h>
+#include <vulkan/vulkan.h>
+
+// Protocol between the frame exporter (--export-socket) and a consumer such
+// as frame_consumer, over a SOCK_SEQPACKET Unix socket so that every message
+// arrives whole, together with the file descriptors attached to it.
+//
+// On connecting, the consumer receives an export_hello with one
+// VK_KHR_external_memory_fd (opaque fd) descriptor per image of the ring. It
+// imports each into an image created exactly as export_image_info()
+// describes, on the device with the same UUIDs.
+//
+// Every frame then arrives as an export_frame with a sync file attached that
+// signals once rendering has finished. The image is in
+// VK_IMAGE_LAYOUT_GENERAL and has been released to VK_QUEUE_FAMILY_EXTERNAL;
+// it belongs to the consumer until it sends back an export_release for it,
+// optionally with a sync file that signals once its own reads are done.
+// Pixels never leave device memory.
+
+const std::uint32_t EXPORT_PROTOCOL_VERSION = 1;
+
+const std::uint32_t EXPORT_MESSAGE_HELLO = 1;
+const std::uint32_t EXPORT_MESSAGE_FRAME = 2;
+const std::uint32_t EXPORT_MESSAGE_RELEASE = 3;
+
+// Both sides must create the images with identical parameters
+const VkFormat EXPORT_IMAGE_FORMAT = VK_FORMAT_R8G8B8A8_UNORM;
+const VkImageUsageFlags EXPORT_IMAGE_USAGE =
+    VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+
+struct export_hello {
+    std::uint32_t type = EXPORT_MESSAGE_HELLO;
+    std::uint32_t version = EXPORT_PROTOCOL_VERSION;
+    std::uint32_t width;
+    std::uint32_t height;
+    std::uint32_t image_count;
+    // Opaque fd imports must use the exporter's allocation size and memory
+    // type; every image is a dedicated allocation
+    std::uint32_t memory_type_index;
+    std::uint64_t allocation_size;
+    std::uint8_t device_uuid[VK_UUID_SIZE];
+    std::uint8_t driver_uuid[VK_UUID_SIZE];
+};
+
+struct export_frame {
+    std::uint32_t type = EXPORT_MESSAGE_FRAME;
+    std::uint32_t image_index;
+    std::uint64_t frame_number;
+};
+
+struct export_release {
+    std::uint32_t type = EXPORT_MESSAGE_RELEASE;
+    std::uint32_t image_index;
+};
+
+// The create info for a ring image of the given size; external_info must
+// outlive its use
+VkImageCreateInfo export_image_info(std::uint32_t width, std::uint32_t height, VkExternalMemoryImageCreateInfo &external_info);
+
+// Sends one message with the descriptors in fds attached; the caller keeps
+// ownership of them
+void send_export_message(int socket_fd, const void *message, std::size_t size, const std::vector<int> &fds = {});
+
+// Receives one message of at most size bytes and takes ownership of the
+// descriptors that came with it. Returns the message size, 0 once the peer
+// has gone, or -1 if wait is false and nothing has arrived yet.
+ssize_t receive_export_message(int socket_fd, void *message, std::size_t size, std::vector<int> &fds, bool wait = true);
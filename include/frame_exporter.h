@@ -0,0 +1,71 @@
+#pragma once
+
+#include "headless_renderer.h"
+#include "vulkan_handle.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+// Renders the spinning triangle into a ring of exportable images and hands
+// each frame to another process without copying it, see frame_export.h for
+// the protocol. The ring is allocated with VK_KHR_external_memory_fd, and
+// completion travels both ways as sync files from
+// VK_KHR_external_semaphore_fd, so neither side waits on the CPU for the
+// other's GPU work.
+class frame_exporter {
+    public:
+        // Waits for one consumer on socket_path and streams frame_count
+        // frames to it, or fewer if it disconnects
+        void run(const std::string &socket_path, std::uint32_t frame_count, VkExtent2D extent);
+
+    private:
+        struct ring_image {
+            unique_image image;
+            unique_device_memory image_memory;
+            unique_image_view image_view;
+            unique_framebuffer framebuffer;
+            VkCommandBuffer command_buffer;
+            unique_fence fence;
+            // Signalled by the frame's submission and exported as a sync file
+            unique_semaphore rendered_semaphore;
+            // Holds the consumer's release sync file until the next frame
+            // rendered into the image waits on it
+            unique_semaphore released_semaphore;
+            bool with_consumer = false;
+            bool release_pending = false;
+        };
+
+        void init(VkExtent2D extent);
+        void cleanup();
+        void load_extension_functions();
+        void check_external_handle_support();
+        void create_command_pool();
+        void create_ring();
+
+        void open_socket(const std::string &socket_path);
+        void accept_consumer();
+        void send_hello();
+        bool receive_release(bool wait);
+
+        void render_frame(std::uint32_t image_index, std::uint64_t frame_number);
+        void record_command_buffer(ring_image &target, std::uint64_t frame_number);
+
+        headless_device shared;
+        shared_queue *queue;
+        VkExtent2D extent;
+        unique_command_pool command_pool;
+        std::vector<ring_image> ring;
+        std::uint32_t memory_type_index;
+        VkDeviceSize allocation_size;
+
+        PFN_vkGetMemoryFdKHR get_memory_fd;
+        PFN_vkGetSemaphoreFdKHR get_semaphore_fd;
+        PFN_vkImportSemaphoreFdKHR import_semaphore_fd;
+
+        std::string socket_path;
+        int listen_fd = -1;
+        int consumer_fd = -1;
+        bool consumer_connected = false;
+};
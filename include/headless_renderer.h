@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+// Push constants of scene.vert. The default places the triangle exactly as
+// shader.vert does.
+struct scene_transform {
+    float offset[2] = { 0.0f, 0.0f };
+    float scale = 1.0f;
+    float rotation = 0.0f;
+};
+
+// A device queue that several render contexts end up sharing when the queue
+// family has fewer queues than there are contexts, as on lavapipe, which has
+// one. Submissions to it are serialized on its mutex, so such contexts only
+// record in parallel.
+struct shared_queue {
+    VkQueue queue;
+    std::mutex mutex;
+};
+
+// Instance and device-level state that every headless render context shares:
+// the logical device and its queues, the pipeline cache, the shader modules
+// and the graphics pipeline built from them. All of it is created before any
+// context starts and is only read afterwards.
+class headless_device {
+    public:
+        // Throws if the device lacks any of the extensions
+        void init(std::uint32_t requested_queue_count, const std::vector<const char *> &extensions = {});
+        void cleanup();
+
+        shared_queue &queue_for_context(std::uint32_t context_index);
+        std::uint32_t queue_count() const;
+
+        VkPhysicalDevice physical_device = VK_NULL_HANDLE;
+        VkDevice device;
+        std::uint32_t queue_family;
+        VkFormat color_format = VK_FORMAT_R8G8B8A8_UNORM;
+        VkPipelineCache pipeline_cache;
+        VkShaderModule vert_shader_module;
+        VkShaderModule frag_shader_module;
+        VkRenderPass render_pass;
+        VkPipelineLayout pipeline_layout;
+        VkPipeline graphics_pipeline;
+
+    private:
+        void create_instance();
+        void pick_physical_device();
+        void create_logical_device(std::uint32_t requested_queue_count, const std::vector<const char *> &extensions);
+        void create_shader_modules();
+        void create_render_pass();
+        void create_graphics_pipeline();
+
+        VkInstance instance;
+        std::vector<std::unique_ptr<shared_queue>> queues;
+};
+
+// Everything a single rendering thread owns: its command pool, per-frame
+// command buffers and fences, and its offscreen render targets. Contexts never
+// touch each other's objects, so they can record and submit in parallel.
+class render_context {
+    public:
+        void init(headless_device &shared_device, std::uint32_t context_index, VkExtent2D render_extent);
+        void cleanup();
+
+        // Appends how long each frame took to submit, including waiting for
+        // its slot, to frame_times_ms if given
+        void render_frames(std::uint32_t frame_count, std::vector<double> *frame_times_ms = nullptr);
+        void wait_idle();
+
+    private:
+        void create_command_pool();
+        void create_command_buffers();
+        void create_sync_objects();
+        void create_offscreen_targets();
+
+        void draw_frame();
+        void record_command_buffer(VkCommandBuffer command_buffer);
+
+        headless_device *shared;
+        shared_queue *queue;
+        VkExtent2D extent;
+        VkCommandPool command_pool;
+        std::vector<VkCommandBuffer> command_buffers;
+        std::vector<VkFence> in_flight_fences;
+        std::vector<VkImage> offscreen_images;
+        std::vector<VkDeviceMemory> offscreen_image_memories;
+        std::vector<VkImageView> offscreen_image_views;
+        std::vector<VkFramebuffer> offscreen_framebuffers;
+        std::uint32_t current_frame = 0;
+};
+
+// Renders with 1, 2, 4, ... up to max_contexts contexts in parallel threads
+// and reports the aggregate frame rate for each context count.
+//
+// All contexts share one device. Each row reports how many queues its
+// contexts were spread over; beyond the family's queue count their
+// submissions serialize, which bounds the scaling that can be measured.
+class headless_benchmark {
+    public:
+        void run(std::uint32_t max_contexts, std::uint32_t frames_per_context, VkExtent2D render_extent);
+
+    private:
+        double measure(std::uint32_t context_count, std::uint32_t frames_per_context, VkExtent2D render_extent);
+
+        headless_device shared;
+};
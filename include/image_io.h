@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Writes tightly packed RGBA8 pixels as a binary PPM, dropping alpha
+void write_ppm(const std::string &filename, std::uint32_t width, std::uint32_t height, const std::uint8_t *rgba);
+
+// Size and pixel data location of a binary (P6) PPM with 8-bit samples
+struct ppm_header {
+    std::uint32_t width;
+    std::uint32_t height;
+    std::size_t pixel_offset;
+};
+
+// Both work on a PPM already in memory, so the caller can find out how much
+// space the pixels need before decoding them straight into it
+ppm_header parse_ppm_header(const std::uint8_t *data, std::size_t size);
+// Expands the RGB samples, validated by parse_ppm_header, to tightly packed RGBA8 with opaque alpha
+void decode_ppm(const std::uint8_t *data, const ppm_header &header, std::uint8_t *rgba);
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// A whole file mapped read-only into memory, unmapped on destruction
+class mapped_file {
+    public:
+        explicit mapped_file(const std::string &filename);
+        ~mapped_file();
+
+        mapped_file(const mapped_file &) = delete;
+        mapped_file &operator=(const mapped_file &) = delete;
+
+        const std::uint8_t *data() const { return bytes; }
+        std::size_t size() const { return length; }
+
+    private:
+        const std::uint8_t *bytes = nullptr;
+        std::size_t length = 0;
+};
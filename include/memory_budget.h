@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+// One memory heap as last queried
+struct memory_heap_usage {
+    VkDeviceSize size = 0;
+    // How much this process may allocate from the heap
+    VkDeviceSize budget = 0;
+    // How much this process has allocated from it
+    VkDeviceSize usage = 0;
+    bool device_local = false;
+};
+
+// Tracks this process's usage of every memory heap against its budget.
+//
+// With VK_EXT_memory_budget both come from the driver, which lowers the
+// budget as other processes take memory from the same heap. Without the
+// extension only heap sizes are known. A budget_limit is then compared
+// against the usage the process estimates for itself with
+// set_estimated_usage(); with neither, the pressure reads as zero.
+class memory_budget {
+    public:
+        // A nonzero budget_limit caps every device-local budget, for when the
+        // process only has a slice of a shared device
+        void init(VkPhysicalDevice physical_device, bool budget_extension_enabled, VkDeviceSize budget_limit);
+
+        // Queries the heaps again; the driver updates its numbers whenever
+        // memory is allocated or freed, by any process
+        void update();
+
+        bool tracks_usage() const { return budget_extension_enabled || budget_limit != 0; }
+
+        // Device-local bytes the process knows it has allocated, taken as
+        // its usage of every device-local heap without the extension.
+        // Applies from the next update().
+        void set_estimated_usage(VkDeviceSize usage) { estimated_usage = usage; }
+
+        // Highest usage to budget ratio among the device-local heaps. Pass
+        // extra_usage to ask what it would be after allocating that much more.
+        double device_local_pressure(VkDeviceSize extra_usage = 0) const;
+
+        const std::vector<memory_heap_usage> &heaps() const { return heap_usages; }
+
+        // One line, e.g. "heap 0 (device) 312/7680 MiB, heap 1 40/15890 MiB"
+        void print(std::ostream &out) const;
+
+    private:
+        VkPhysicalDevice physical_device = VK_NULL_HANDLE;
+        bool budget_extension_enabled = false;
+        VkDeviceSize budget_limit = 0;
+        VkDeviceSize estimated_usage = 0;
+        std::vector<memory_heap_usage> heap_usages;
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Binary mesh file (.vtm), written by mesh_converter and mapped by the mesh
+// loader.
+//
+// All fields are little-endian. The file is a header followed by a vertex,
+// an index and a meshlet block. Every block starts at a multiple of
+// MESH_BLOCK_ALIGNMENT and the file is padded to one as well, so that
+// everything after the header can be copied, or imported as host memory,
+// into a single GPU buffer in one piece. Offsets into that buffer are the
+// file offsets.
+
+// "VTM1" read as a little-endian word; a big-endian reader sees it reversed
+const std::uint32_t MESH_FILE_MAGIC = 0x314D5456;
+const std::uint32_t MESH_FILE_VERSION = 2;
+// A page, which also satisfies the host pointer import alignment of
+// common devices
+const std::uint64_t MESH_BLOCK_ALIGNMENT = 4096;
+
+// Meshlets are bounded like mesh shader workgroups usually are
+const std::uint32_t MESHLET_MAX_VERTICES = 64;
+const std::uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+// Matches the vertex input of mesh.vert: position as three floats and the
+// normal as R8G8B8A8_SNORM (w unused)
+struct mesh_vertex {
+    float position[3];
+    std::int8_t normal[4];
+};
+static_assert(sizeof(mesh_vertex) == 16, "mesh_vertex must be tightly packed");
+
+// A run of consecutive triangles in the index block, laid out for std430
+struct mesh_meshlet {
+    // Bounding sphere of the meshlet's vertices
+    float center[3];
+    float radius;
+    // Every triangle normal n satisfies dot(n, cone_axis) >= cone_cutoff;
+    // a cutoff of -1 means the meshlet cannot be back-face culled as a whole
+    float cone_axis[3];
+    float cone_cutoff;
+    std::uint32_t first_index;
+    std::uint32_t index_count;
+    std::uint32_t padding[2];
+};
+static_assert(sizeof(mesh_meshlet) == 48, "mesh_meshlet must match its std430 layout");
+
+struct mesh_file_header {
+    std::uint32_t magic;
+    std::uint32_t version;
+    std::uint32_t vertex_count;
+    std::uint32_t vertex_stride;
+    // 32-bit indices, three per triangle
+    std::uint32_t index_count;
+    std::uint32_t meshlet_count;
+    // Largest value in the index block, recorded so that loading can check
+    // it against vertex_count without scanning the indices
+    std::uint32_t max_index;
+    std::uint32_t padding;
+    std::uint64_t vertex_offset;
+    std::uint64_t index_offset;
+    std::uint64_t meshlet_offset;
+    // Size of the whole file including padding
+    std::uint64_t file_size;
+    float bounds_min[3];
+    float bounds_max[3];
+};
+static_assert(sizeof(mesh_file_header) == 88, "mesh_file_header must be tightly packed");
+
+inline std::uint64_t align_mesh_offset(std::uint64_t offset) {
+    return (offset + MESH_BLOCK_ALIGNMENT - 1) / MESH_BLOCK_ALIGNMENT * MESH_BLOCK_ALIGNMENT;
+}
+
+// Checks that a mapped file of the given size has a well-formed header with
+// blocks inside the file and returns it; throws std::runtime_error otherwise.
+// Index values are not scanned, that would defeat mapping the file; only the
+// recorded max_index is checked, so a file that lies about it still needs
+// robust buffer access to be drawn safely.
+const mesh_file_header &validate_mesh_file(const std::uint8_t *data, std::size_t size, const std::string &filename);
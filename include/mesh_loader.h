@@ -0,0 +1,35 @@
+#pragma once
+
+#include "vulkan_handle.h"
+
+#include <cstdint>
+#include <string>
+#include <vulkan/vulkan.h>
+
+// A mesh file resident in one device-local buffer that holds the whole file,
+// so the vertex, index and meshlet blocks sit at their file offsets
+struct gpu_mesh {
+    unique_buffer buffer;
+    unique_device_memory buffer_memory;
+    VkDeviceSize vertex_offset = 0;
+    VkDeviceSize index_offset = 0;
+    VkDeviceSize meshlet_offset = 0;
+    std::uint32_t vertex_count = 0;
+    std::uint32_t index_count = 0;
+    std::uint32_t meshlet_count = 0;
+    float bounds_min[3];
+    float bounds_max[3];
+};
+
+// Maps a mesh file and copies it into a gpu_mesh without parsing it.
+//
+// With host_pointer_import (VK_EXT_external_memory_host enabled on the
+// device), the mapping itself is imported as the source of the copy and the
+// GPU reads the file straight from the page cache. Otherwise, or if the
+// driver rejects the mapping, the file goes through a double-buffered
+// staging buffer so copying on the CPU overlaps the transfers on the GPU.
+//
+// Blocks until the upload has completed; queue must not be used by anyone
+// else meanwhile.
+gpu_mesh load_mesh(VkPhysicalDevice physical_device, VkDevice device, VkQueue queue, std::uint32_t queue_family,
+        bool host_pointer_import, const std::string &filename);
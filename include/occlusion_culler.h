@@ -0,0 +1,99 @@
+#pragma once
+
+#include "vulkan_handle.h"
+
+#include <cstdint>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+// Two-phase occlusion culling of the dense scene in occlusion_scene.glsl,
+// entirely on the GPU. Each frame:
+//
+//  1. record_first_phase() selects the instances that were visible last
+//     frame, which are drawn with draw(..., 0) and fill the depth buffer.
+//  2. record_second_phase() reduces that depth into a hierarchical Z pyramid
+//     (every texel the farthest depth of its footprint) and tests every
+//     instance's bounds against it. Those visible now but not drawn in phase
+//     1 are drawn with draw(..., 1), and the result is what phase 1 of the
+//     next frame starts from.
+//
+// Both draws are indirect, so the CPU never learns what is visible except
+// through the counts read_counts() reports a few frames late.
+class occlusion_culler {
+    public:
+        void init(VkPhysicalDevice physical_device, VkDevice device, std::uint32_t instance_count, std::uint32_t frame_slots);
+        // Nothing recorded by this culler may still be in use
+        void cleanup();
+
+        // The depth attachment the scene is rendered into, sampled in
+        // DEPTH_STENCIL_READ_ONLY_OPTIMAL between the phases. The pyramid is
+        // sized for extent; the old one is retired until last_use_frame.
+        void set_depth_target(VkImageView depth_view, VkExtent2D extent, deletion_queue &retired, std::uint64_t last_use_frame);
+
+        // The layout of the pipelines draw() is used with, which draw the
+        // instance lists with culled.vert
+        VkPipelineLayout draw_layout() const { return draw_pipeline_layout; }
+
+        // Outside a render pass
+        void record_first_phase(VkCommandBuffer command_buffer, float time);
+        // Outside a render pass, once the first phase has been drawn into the
+        // top-left render_extent of the depth target
+        void record_second_phase(VkCommandBuffer command_buffer, VkExtent2D render_extent, float time);
+        // Inside the render pass, with a pipeline using draw_layout() bound
+        void draw(VkCommandBuffer command_buffer, std::uint32_t phase, float time);
+
+        // Outside a render pass, after both draws: keeps the frame's counts
+        // in frame_slot until read_counts() after it has completed
+        void record_counts(VkCommandBuffer command_buffer, std::uint32_t frame_slot);
+        void read_counts(std::uint32_t frame_slot, std::uint32_t &first_phase, std::uint32_t &second_phase) const;
+
+        std::uint32_t count() const { return instance_count; }
+
+    private:
+        void create_pipelines();
+        void create_static_descriptors();
+        void create_pyramid(VkExtent2D extent);
+        void create_pyramid_descriptors(VkImageView depth_view);
+        void dispatch_cull(VkCommandBuffer command_buffer, std::uint32_t phase, VkExtent2D render_extent,
+                std::uint32_t hiz_levels, float time);
+
+        VkPhysicalDevice physical_device = VK_NULL_HANDLE;
+        VkDevice device = VK_NULL_HANDLE;
+        std::uint32_t instance_count = 0;
+        std::uint32_t cull_group_counts[2];
+        bool visibility_cleared = false;
+
+        unique_buffer visibility_buffer;
+        unique_device_memory visibility_buffer_memory;
+        unique_buffer draw_buffer;
+        unique_device_memory draw_buffer_memory;
+        unique_buffer instance_list_buffer;
+        unique_device_memory instance_list_buffer_memory;
+        // Two draw commands per frame slot, persistently mapped
+        unique_buffer count_buffer;
+        unique_device_memory count_buffer_memory;
+        const VkDrawIndirectCommand *counts = nullptr;
+
+        unique_sampler sampler;
+        unique_descriptor_set_layout cull_descriptor_set_layout;
+        unique_descriptor_set_layout hiz_descriptor_set_layout;
+        unique_descriptor_set_layout draw_descriptor_set_layout;
+        unique_pipeline_layout cull_pipeline_layout;
+        unique_pipeline_layout hiz_pipeline_layout;
+        unique_pipeline_layout draw_pipeline_layout;
+        unique_pipeline cull_pipeline;
+        unique_pipeline hiz_pipeline;
+        unique_descriptor_pool static_descriptor_pool;
+        VkDescriptorSet draw_descriptor_set;
+
+        // Recreated with the depth target
+        VkExtent2D pyramid_extent;
+        std::uint32_t pyramid_levels = 0;
+        unique_image pyramid_image;
+        unique_device_memory pyramid_image_memory;
+        unique_image_view pyramid_view;
+        std::vector<unique_image_view> pyramid_level_views;
+        unique_descriptor_pool pyramid_descriptor_pool;
+        VkDescriptorSet cull_descriptor_set;
+        std::vector<VkDescriptorSet> hiz_descriptor_sets;
+};
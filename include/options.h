@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Command line options. Without any, the interactive window is shown.
+struct options {
+    bool show_help = false;
+
+    // Headless benchmark: render with 1..bench_contexts parallel contexts
+    std::uint32_t bench_contexts = 0;
+    std::uint32_t frames = 1000;
+    std::uint32_t width;
+    std::uint32_t height;
+
+    // Batch rendering: jobs from stdin, or from batch_socket when it is set
+    bool batch = false;
+    std::string batch_socket;
+
+    // Render with the CPU rasterizer even if a Vulkan device is available
+    bool use_cpu = false;
+    // Compare the CPU rasterizer against the device, then benchmark both
+    bool cpu_check = false;
+
+    // Image files streamed onto the GPU while the window is shown
+    std::vector<std::string> texture_files;
+    // The window's scene is shown in this many windows, or presented to as
+    // many VK_EXT_headless_surface surfaces for --frames frames
+    std::uint32_t window_count = 1;
+    bool headless_surface = false;
+    // Binary mesh shown in the window instead of the triangles
+    std::string mesh_file;
+    // Caps the device-local memory budget of the window, 0 for no cap
+    std::uint32_t memory_budget_mib = 0;
+
+    // Geometry stress mode: the window's triangle subdivided into
+    // tessellate_segments² triangles, or into a Sierpinski gasket of
+    // sierpinski_levels levels
+    std::uint32_t tessellate_segments = 0;
+    std::uint32_t sierpinski_levels = 0;
+    // Tessellate with the compute pre-pass even if mesh shaders are supported
+    bool no_mesh_shaders = false;
+
+    // Occlusion culling mode: this many instances culled on the GPU against
+    // a hierarchical Z pyramid
+    std::uint32_t occlusion_cull_instances = 0;
+
+    // Export frames to a consumer process on this Unix socket
+    std::string export_socket;
+
+    // Performance gate: record a baseline of the headless benchmark at
+    // --size for --frames frames, or check the benchmark against one
+    std::string perf_record;
+    std::string perf_check;
+    std::uint32_t perf_runs;
+};
+
+options parse_options(int argc, char **argv);
+void print_usage(const char *program);
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vulkan/vulkan.h>
+
+// Performance regression gate for the headless renderer. A scenario of
+// frames at extent is run runs times, each in a fresh child process, measuring
+// its startup time (to the first completed frame), per-frame times and peak
+// resident memory.
+//
+// record_perf_baseline() writes the runs to a JSON baseline. run_perf_check()
+// reruns the baseline's scenario and compares the runs with a one-sided
+// Mann-Whitney U test, printing a report; it throws if startup time, p99
+// frame time or memory use regressed by more than the thresholds in config.h.
+// Baselines are only comparable on the device they were recorded on.
+void record_perf_baseline(const std::string &path, std::uint32_t runs, std::uint32_t frames, VkExtent2D extent);
+void run_perf_check(const std::string &baseline_path, std::uint32_t runs);
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "vulkan_handle.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+// Everything that differs between the pipelines built from one pair of
+// shaders: fixed-function state, and the specialization constants that pick
+// a material in the fragment shader
+struct pipeline_key {
+    VkCullModeFlags cull_mode = VK_CULL_MODE_BACK_BIT;
+    VkFrontFace front_face = VK_FRONT_FACE_CLOCKWISE;
+    VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+    // Standard alpha blending instead of overwriting the color
+    bool blend = false;
+    // Depth test and write against the render pass's depth attachment
+    bool depth_test = false;
+    // Fragment shader specialization constant 0, one of the MATERIAL_* values
+    std::uint32_t material = 0;
+
+    bool operator==(const pipeline_key &other) const;
+};
+
+struct pipeline_key_hash {
+    std::size_t operator()(const pipeline_key &key) const;
+};
+
+// The pipelines built from one pair of shaders, created on first use and
+// kept in a map by key.
+//
+// Creating a pipeline can take milliseconds, so the variants that are known
+// up front should be handed to precompile(), which builds them in parallel
+// through the shared pipeline cache before the first frame; get() then only
+// ever compiles variants nobody anticipated, and says so.
+class pipeline_variants {
+    public:
+        // layout, render_pass and pipeline_cache must outlive the variants.
+        // The vertex input is the same for every variant. A vert_shader_file
+        // ending in .mesh.spv is a mesh shader, which takes no vertex input.
+        void init(VkDevice device, VkPipelineCache pipeline_cache, VkPipelineLayout layout, VkRenderPass render_pass,
+                const std::string &vert_shader_file, const std::string &frag_shader_file,
+                std::vector<VkVertexInputBindingDescription> vertex_bindings = {},
+                std::vector<VkVertexInputAttributeDescription> vertex_attributes = {});
+        // No pipeline may be in use on the device
+        void cleanup();
+
+        // Compiles every key that has no pipeline yet on all hardware threads
+        // and blocks until they are done
+        void precompile(const std::vector<pipeline_key> &keys);
+
+        // Variants created from now on target render_pass. Existing ones stay
+        // usable with any render pass compatible with the one they were
+        // created for, which may be destroyed meanwhile.
+        void set_render_pass(VkRenderPass render_pass) { this->render_pass = render_pass; }
+
+        // Returns the pipeline for key, compiling it first if needed
+        VkPipeline get(const pipeline_key &key);
+
+        // Pipelines get() had to compile, each of them a stall on first use
+        std::uint32_t late_compile_count() const { return late_compiles; }
+
+    private:
+        // Only reads state set up by init(), so it may run on several
+        // threads at once
+        unique_pipeline create_pipeline(const pipeline_key &key) const;
+
+        VkDevice device = VK_NULL_HANDLE;
+        VkPipelineCache pipeline_cache = VK_NULL_HANDLE;
+        VkPipelineLayout layout = VK_NULL_HANDLE;
+        VkRenderPass render_pass = VK_NULL_HANDLE;
+        std::string vert_shader_file;
+        bool mesh_shader = false;
+        unique_shader_module vert_shader_module;
+        unique_shader_module frag_shader_module;
+        std::vector<VkVertexInputBindingDescription> vertex_bindings;
+        std::vector<VkVertexInputAttributeDescription> vertex_attributes;
+
+        std::unordered_map<pipeline_key, unique_pipeline, pipeline_key_hash> pipelines;
+        std::uint32_t late_compiles = 0;
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "vulkan_handle.h"
+
+#include <cstdint>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+// How finely the triangle is subdivided in the geometry stress mode
+struct tessellation_settings {
+    // Sierpinski gasket instead of a uniform subdivision
+    bool sierpinski = false;
+    // Segments per edge of a uniform subdivision (detail² triangles), or
+    // levels of the gasket (3^detail triangles); 0 draws the plain triangle
+    std::uint32_t detail = 0;
+
+    // Throws if the vertex count would not fit in 32 bits
+    std::uint32_t triangle_count() const;
+};
+
+// Push constants of tessellate.comp and tessellate.mesh. A dispatch covers
+// the triangles from first_triangle up to triangle_count; large ones are split
+// into rows of groups_per_row work groups.
+struct tessellation_parameters {
+    std::uint32_t pattern;
+    std::uint32_t detail;
+    std::uint32_t triangle_count;
+    std::uint32_t groups_per_row;
+    std::uint32_t first_triangle;
+};
+
+// Work group counts of a dispatch of group_count groups split into rows no
+// longer than max_counts[0]; false if there would be more than max_counts[1]
+// rows
+bool split_dispatch(std::uint64_t group_count, const std::uint32_t max_counts[3], std::uint32_t counts[2]);
+
+tessellation_parameters make_tessellation_parameters(const tessellation_settings &settings, std::uint32_t groups_per_row);
+
+// A run of consecutive triangles, three R16G16_SNORM positions each and no
+// index buffer
+struct tessellation_chunk {
+    unique_buffer buffer;
+    unique_device_memory buffer_memory;
+    std::uint32_t vertex_count = 0;
+};
+
+// The subdivided triangle in device-local vertex buffers, drawn one after the
+// other. Each is no larger than a storage buffer range may be, which is only
+// 128 MiB (about 11 million triangles) on some drivers.
+struct gpu_tessellation {
+    std::vector<tessellation_chunk> chunks;
+};
+
+// Writes the triangles with the tessellate.comp pre-pass. Blocks until it has
+// completed; queue must support compute and not be used by anyone else
+// meanwhile.
+gpu_tessellation generate_tessellation(VkPhysicalDevice physical_device, VkDevice device, VkQueue queue,
+        std::uint32_t queue_family, const tessellation_settings &settings);
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <cstdint>
+#include <vulkan/vulkan.h>
+
+// Renders a set of scenes on the Vulkan device and with the CPU rasterizer,
+// compares the images pixel by pixel and then measures the frame rate of
+// both at the given size. Throws if the images differ by more than rounding.
+void run_rasterizer_check(std::uint32_t frames, VkExtent2D extent);
@@ -0,0 +1,144 @@
+#pragma once
+
+#include "blocking_queue.h"
+#include "submission_scheduler.h"
+#include "vulkan_handle.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+// A streamed texture whose upload has completed, ready to be sampled
+struct streamed_texture {
+    std::string path;
+    VkImageView image_view;
+    std::uint32_t width;
+    std::uint32_t height;
+    std::uint32_t mip_levels;
+};
+
+// Loads image files onto the GPU without blocking the render thread.
+//
+// Worker threads map each file, decode it straight into a persistently
+// mapped staging ring buffer and hand it to the render thread. update(),
+// called once per frame, copies decoded textures into their images on the
+// transfer queue and generates their mip chains with blits on the graphics
+// queue, both submitted along with the frame. Neither submission is waited
+// for: each upload signals its value on a timeline semaphore, and update()
+// hands out the textures whose value the completion timeline has reached.
+class texture_streamer {
+    public:
+        // transfer_queue may be the graphics queue when the device has no
+        // separate transfer family
+        void init(VkPhysicalDevice physical_device, VkDevice device, std::uint32_t graphics_family, VkQueue graphics_queue,
+                std::uint32_t transfer_family, VkQueue transfer_queue);
+        // The device must be idle
+        void cleanup();
+
+        // Queues a binary PPM for streaming and returns immediately
+        void request(const std::string &path);
+
+        // Enqueues uploads for decoded textures to scheduler, recycles the
+        // staging space of finished copies and returns the textures completed
+        // since the last call. Only polls the timelines, never waits on the
+        // device.
+        std::vector<streamed_texture> update(submission_scheduler &scheduler);
+
+    private:
+        struct texture_request {
+            std::string path;
+            std::chrono::steady_clock::time_point requested;
+        };
+
+        struct decoded_texture {
+            texture_request request;
+            std::uint32_t width = 0;
+            std::uint32_t height = 0;
+            VkDeviceSize staging_offset = 0;
+            VkDeviceSize size = 0;
+            std::chrono::steady_clock::time_point decoded;
+            std::string error;
+        };
+
+        struct upload {
+            decoded_texture texture;
+            std::uint32_t mip_levels;
+            unique_image image;
+            unique_device_memory image_memory;
+            unique_image_view image_view;
+            VkCommandBuffer transfer_command_buffer;
+            VkCommandBuffer graphics_command_buffer;
+            std::uint64_t timeline_value;
+            bool staging_released = false;
+            std::chrono::steady_clock::time_point submitted;
+        };
+
+        struct staging_allocation {
+            VkDeviceSize offset;
+            VkDeviceSize size;
+            bool released;
+        };
+
+        void create_staging_ring();
+        void create_command_pools();
+        void create_timelines();
+
+        void worker_loop();
+        bool allocate_staging(VkDeviceSize size, VkDeviceSize &offset);
+        void release_staging(VkDeviceSize offset);
+
+        void record_upload(decoded_texture texture);
+        void record_copy(VkCommandBuffer command_buffer, const upload &target);
+        void record_mip_generation(VkCommandBuffer command_buffer, const upload &target);
+        void report(const upload &finished, std::chrono::steady_clock::time_point completed);
+
+        VkPhysicalDevice physical_device;
+        VkDevice device;
+        std::uint32_t graphics_family;
+        VkQueue graphics_queue;
+        std::uint32_t transfer_family;
+        VkQueue transfer_queue;
+        std::uint32_t max_image_dimension;
+
+        unique_buffer staging_buffer;
+        unique_device_memory staging_buffer_memory;
+        std::uint8_t *staging_data;
+        VkDeviceSize staging_capacity;
+        VkDeviceSize staging_alignment;
+
+        // The ring hands out space in allocation order but gets it back in
+        // upload order, so released space is only reused once everything
+        // allocated before it has been released too
+        std::mutex staging_mutex;
+        std::condition_variable staging_available;
+        std::deque<staging_allocation> staging_allocations;
+        VkDeviceSize staging_head = 0;
+        bool stopping = false;
+
+        std::vector<std::thread> workers;
+        blocking_queue<texture_request> requests;
+        blocking_queue<decoded_texture> decoded_textures;
+
+        // Only touched by the render thread
+        unique_command_pool transfer_command_pool;
+        unique_command_pool graphics_command_pool;
+        // Copies into the images signal transfer_timeline, finished mip
+        // chains completion_timeline, both with the upload's value
+        unique_semaphore transfer_timeline;
+        unique_semaphore completion_timeline;
+        std::uint64_t next_timeline_value = 0;
+        std::list<upload> uploads;
+        std::vector<upload> completed_uploads;
+
+        std::uint32_t outstanding_requests = 0;
+        std::uint32_t streamed_count = 0;
+        VkDeviceSize streamed_bytes = 0;
+        std::chrono::steady_clock::time_point first_request;
+};
@@ -1,3 +1,4 @@
+#include <chrono>
 #include <cstdint>
 #include <optional>
 #include <string>
@@ -6,9 +7,21 @@
 #include <GLFW/glfw3.h>
 #include <vulkan/vulkan_core.h>
 
+#include "memory_budget.h"
+#include "mesh_loader.h"
+#include "occlusion_culler.h"
+#include "options.h"
+#include "pipeline_variants.h"
+#include "procedural_geometry.h"
+#include "submission_scheduler.h"
+#include "texture_streamer.h"
+#include "vulkan_handle.h"
+
 struct queue_family_indices {
     std::optional<uint32_t> graphics_family;
     std::optional<uint32_t> present_family;
+    // A family for transfers only, usually backed by a DMA engine
+    std::optional<uint32_t> transfer_family;
 
     bool is_complete() {
         return graphics_family.has_value() && present_family.has_value();
@@ -21,8 +34,46 @@ struct swap_chain_support_details {
     std::vector<VkPresentModeKHR> present_modes;
 };
 
+// A swap chain that has been replaced but whose presents may still be pending
+struct retired_swap_chain {
+    unique_swapchain swap_chain;
+    // The present fences it was last presented with, if any
+    std::vector<unique_fence> present_fences;
+};
+
+// A window, or a VK_EXT_headless_surface surface without one, with its own
+// swap chain and the semaphores ordering it against each frame's submission
+struct presentation_surface {
+    GLFWwindow *window = nullptr;
+    VkSurfaceKHR surface = VK_NULL_HANDLE;
+    unique_swapchain swap_chain;
+    std::vector<VkImage> images;
+    VkFormat format;
+    VkExtent2D extent;
+    std::vector<unique_semaphore> image_available_semaphores;
+    std::vector<unique_semaphore> render_finished_semaphores;
+    // With VK_EXT_swapchain_maintenance1, one per frame slot, signalled once
+    // the slot's last present is done with its semaphore and image
+    std::vector<unique_fence> present_fences;
+    // Destroyed by release_old_swap_chains() once no present uses them
+    std::vector<retired_swap_chain> old_swap_chains;
+    bool resized = false;
+    // The window has no size, so there is no swap chain that fits it; it is
+    // recreated once the window is restored
+    bool minimized = false;
+    // Acquired for the frame being recorded
+    std::uint32_t image_index = 0;
+};
+
 class triangle_application {
     public:
+        triangle_application() = default;
+        // Shows the occlusion culled scene, opts.mesh_file or the tessellated
+        // triangle if set in opts.window_count windows, or headless surfaces
+        // for opts.frames frames, and streams in opts.texture_files once they
+        // are up
+        explicit triangle_application(const options &opts);
+
         void run();
     private:
         void init_window();
@@ -34,23 +85,51 @@ class triangle_application {
         void setup_debug_messenger();
         void create_surface();
         void pick_physical_device();
+        bool presents_to_all_surfaces(VkPhysicalDevice device);
         void create_logical_device();
-        void create_swap_chain();
+        void create_swap_chain(presentation_surface &target);
         void cleanup_swap_chain();
-        void recreate_swap_chain();
-        void create_image_views();
+        void retire_swap_chain();
+        void recreate_swap_chain(presentation_surface &target);
+        void create_present_fences(presentation_surface &target);
+        void release_old_swap_chains(presentation_surface &target);
+        void wait_for_presents(presentation_surface &target);
+        void recreate_render_targets();
+        void create_offscreen_targets();
+        void create_msaa_target();
+        void create_depth_target();
         void create_render_pass();
+        void create_second_phase_render_pass();
+        void create_texture_sampler();
+        void create_descriptor_set_layout();
         void create_graphics_pipeline();
+        void create_mesh_pipeline();
+        void create_tessellation_pipeline();
+        void create_occlusion_culler();
+        void create_culled_pipeline();
+        pipeline_key scene_pipeline_key(std::uint32_t material) const;
+        pipeline_key mesh_pipeline_key() const;
+        pipeline_key culled_pipeline_key() const;
+        void precompile_pipelines();
+        void load_scene_mesh();
+        void tessellate_scene();
         void create_framebuffers();
         void create_command_pool();
         void create_command_buffers();
+        void create_textures();
+        void create_descriptor_pool();
+        void create_descriptor_set();
+        void create_instance_buffers();
         void create_sync_objects();
+        void create_timestamp_queries();
+        void create_texture_streamer();
+        void update_streamed_textures();
 
         static void framebuffer_resize_callback(GLFWwindow *window, int width, int height);
 
 
-        static bool check_validation_layer_support();
-        static std::vector<const char *> get_required_extensions();
+        static std::vector<const char *> get_required_extensions(bool headless);
+        static bool check_instance_extension_support(const char *extension_name);
         static void show_available_extensions();
         static VKAPI_ATTR VkBool32 VKAPI_CALL debug_callback(
                 VkDebugUtilsMessageSeverityFlagBitsEXT message_severity,
@@ -63,6 +142,8 @@ class triangle_application {
 
         static bool is_device_suitable(VkPhysicalDevice device, VkSurfaceKHR surface);
         static bool check_device_extension_support(VkPhysicalDevice device);
+        static bool check_optional_device_extension(VkPhysicalDevice device, const char *extension_name);
+        static bool check_descriptor_indexing_support(VkPhysicalDevice device);
         static queue_family_indices find_queue_families(VkPhysicalDevice device, VkSurfaceKHR surface);
 
         static swap_chain_support_details query_swap_chain_support(VkPhysicalDevice device, VkSurfaceKHR surface);
@@ -70,37 +151,153 @@ class triangle_application {
         static VkPresentModeKHR choose_swap_present_mode(const std::vector<VkPresentModeKHR> &available_present_modes);
         static VkExtent2D choose_swap_extent(const VkSurfaceCapabilitiesKHR &capabilities, GLFWwindow *window);
 
-        static std::vector<char> read_file(const std::string &filename);
-        VkShaderModule create_shader_module(const std::vector<char> &code);
+        VkSampleCountFlagBits choose_msaa_samples();
+
+        VkCommandBuffer begin_single_time_commands();
+        void end_single_time_commands(VkCommandBuffer command_buffer);
+        void transition_image_layout(VkCommandBuffer command_buffer, VkImage image,
+                VkImageLayout old_layout, VkImageLayout new_layout);
 
 
         void draw_frame();
 
-        void record_command_buffer(VkCommandBuffer command_buffer, std::uint32_t image_index);
+        void record_command_buffer(VkCommandBuffer command_buffer);
+
+        VkExtent2D scaled_extent(float scale);
+        VkExtent2D render_extent();
+        bool read_gpu_frame_time(double &frame_time_ms);
+        void update_render_scale(double frame_time_ms);
+        void report_frame_stats();
+
+        VkDeviceSize render_target_bytes(float scale_limit, VkSampleCountFlagBits samples);
+        // The render targets plus the scene's buffers and images, for
+        // --memory-budget without VK_EXT_memory_budget
+        VkDeviceSize estimated_device_local_bytes();
+        void check_memory_budget();
+        void set_msaa_samples(VkSampleCountFlagBits samples);
+        void set_render_scale_limit(float limit);
 
 
-        GLFWwindow *window;
         VkInstance instance;
         VkDebugUtilsMessengerEXT debug_messenger;
-        VkSurfaceKHR surface;
+        // All presented to from present_queue in one call per frame, the
+        // first one deciding the size and format of the render targets
+        std::vector<presentation_surface> surfaces;
+        // The ones the frame being recorded acquired an image from; minimised
+        // windows are left out until they have a size again
+        std::vector<presentation_surface *> frame_surfaces;
+        std::uint32_t surface_count = 1;
+        bool headless_surfaces = false;
+        std::uint32_t headless_frame_count = 0;
         VkPhysicalDevice physical_device = VK_NULL_HANDLE;
         VkDevice device;
         VkQueue graphics_queue;
         VkQueue present_queue;
-        VkSwapchainKHR swap_chain;
-        std::vector<VkImage> swap_chain_images;
+        std::uint32_t transfer_family;
+        VkQueue transfer_queue;
+        // Those of the first surface
         VkFormat swap_chain_image_format;
         VkExtent2D swap_chain_extent;
-        std::vector<VkImageView> swap_chain_image_views;
-        VkRenderPass render_pass;
-        VkPipelineLayout pipeline_layout;
-        VkPipeline graphics_pipeline;
-        std::vector<VkFramebuffer> swap_chain_framebuffers;
-        VkCommandPool command_pool;
+        std::vector<unique_image> offscreen_images;
+        std::vector<unique_device_memory> offscreen_image_memories;
+        std::vector<unique_image_view> offscreen_image_views;
+        VkFilter upscale_filter;
+        VkSampleCountFlagBits msaa_samples = VK_SAMPLE_COUNT_1_BIT;
+        VkSampleCountFlagBits supported_msaa_samples = VK_SAMPLE_COUNT_1_BIT;
+        unique_image msaa_image;
+        unique_device_memory msaa_image_memory;
+        unique_image_view msaa_image_view;
+        // Only used by occlusion culling, shared like the MSAA image
+        VkFormat depth_format = VK_FORMAT_UNDEFINED;
+        unique_image depth_image;
+        unique_device_memory depth_image_memory;
+        unique_image_view depth_image_view;
+        unique_render_pass render_pass;
+        // Continues render_pass after the second culling phase, keeping what
+        // the first drew
+        unique_render_pass second_phase_render_pass;
+        unique_sampler texture_sampler;
+        unique_descriptor_set_layout descriptor_set_layout;
+        unique_pipeline_cache pipeline_cache;
+        unique_pipeline_layout pipeline_layout;
+        pipeline_variants scene_pipelines;
+        std::vector<unique_framebuffer> offscreen_framebuffers;
+        unique_command_pool command_pool;
         std::vector<VkCommandBuffer> command_buffers;
-        std::vector<VkSemaphore> image_available_semaphores;
-        std::vector<VkSemaphore> render_finished_semaphores;
-        std::vector<VkFence> in_flight_fences;
-        bool framebuffer_resized = false;
+        std::vector<unique_image> texture_images;
+        std::vector<unique_device_memory> texture_image_memories;
+        std::vector<unique_image_view> texture_image_views;
+        std::uint32_t bindless_texture_capacity = 0;
+        unique_descriptor_pool descriptor_pool;
+        VkDescriptorSet descriptor_set;
+        // The bindless slot each instance samples, an instance-rate vertex
+        // attribute. One persistently mapped buffer per frame in flight,
+        // filled in when the frame is recorded.
+        std::vector<unique_buffer> instance_buffers;
+        std::vector<unique_device_memory> instance_buffer_memories;
+        std::vector<std::uint32_t *> instance_texture_slots;
+        std::vector<unique_fence> in_flight_fences;
         std::uint32_t current_frame = 0;
+
+        // Frames are numbered in submission order; a slot's fence signalling
+        // means its frame and every earlier one on the queue have completed
+        std::uint64_t submitted_frames = 0;
+        std::vector<std::uint64_t> frame_numbers;
+        deletion_queue retired_resources;
+
+        std::vector<std::string> texture_files;
+        std::string mesh_file;
+        bool host_pointer_import = false;
+        gpu_mesh mesh;
+        unique_pipeline_layout mesh_pipeline_layout;
+        pipeline_variants mesh_pipelines;
+        std::chrono::steady_clock::time_point start_time;
+
+        tessellation_settings tessellation;
+        bool allow_mesh_shaders = true;
+        // Set while the tessellation is generated by mesh shaders every frame
+        // rather than once into tessellated
+        bool mesh_shader_tessellation = false;
+        PFN_vkCmdDrawMeshTasksEXT cmd_draw_mesh_tasks = nullptr;
+        tessellation_parameters mesh_task_parameters;
+        std::uint32_t mesh_task_group_counts[2];
+        gpu_tessellation tessellated;
+        unique_pipeline_layout tessellation_pipeline_layout;
+        pipeline_variants tessellation_pipelines;
+
+        std::uint32_t occlusion_cull_instances = 0;
+        occlusion_culler culler;
+        pipeline_variants culled_pipelines;
+        // As of the last completed frame in the current slot
+        std::uint32_t drawn_first_phase = 0;
+        std::uint32_t drawn_second_phase = 0;
+
+        texture_streamer streamer;
+        std::uint32_t streamed_texture_count = 0;
+        VkDeviceSize streamed_texture_bytes = 0;
+
+        // Presents signal fences, so replaced swap chains can be destroyed as
+        // soon as their presents are done
+        bool surface_maintenance_1_enabled = false;
+        bool swapchain_maintenance_1_enabled = false;
+
+        // Every queue submission of a frame goes through it
+        bool synchronization_2_enabled = false;
+        submission_scheduler scheduler;
+
+        unique_query_pool timestamp_query_pool;
+        float timestamp_period = 0.0f;
+        std::vector<bool> timestamps_written;
+        float render_scale = 1.0f;
+        // Lowered under memory pressure; the render targets are sized for it
+        float render_scale_limit = 1.0f;
+        double smoothed_frame_time_ms = 0.0;
+        std::uint32_t frames_since_report = 0;
+        std::chrono::steady_clock::time_point last_frame_time;
+        std::chrono::steady_clock::time_point last_report_time;
+
+        bool memory_budget_enabled = false;
+        VkDeviceSize memory_budget_limit = 0;
+        memory_budget memory;
+        std::chrono::steady_clock::time_point last_budget_check_time;
 };
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <utility>
+#include <vulkan/vulkan.h>
+
+// Owns one object created from a VkDevice and destroys it with the matching
+// vkDestroy*/vkFree* function. Move-only; converts to the raw handle so it can
+// be passed straight to Vulkan calls.
+template <typename T, void (VKAPI_PTR *destroy)(VkDevice, T, const VkAllocationCallbacks *)>
+class device_handle {
+    public:
+        device_handle() = default;
+        device_handle(VkDevice device, T handle) : device(device), handle(handle) {}
+        ~device_handle() { reset(); }
+
+        device_handle(const device_handle &) = delete;
+        device_handle &operator=(const device_handle &) = delete;
+
+        device_handle(device_handle &&other) noexcept
+            : device(other.device), handle(std::exchange(other.handle, static_cast<T>(VK_NULL_HANDLE))) {}
+
+        device_handle &operator=(device_handle &&other) noexcept {
+            if (this != &other) {
+                reset();
+                device = other.device;
+                handle = std::exchange(other.handle, static_cast<T>(VK_NULL_HANDLE));
+            }
+            return *this;
+        }
+
+        operator T() const { return handle; }
+        T get() const { return handle; }
+        explicit operator bool() const { return handle != VK_NULL_HANDLE; }
+
+        // Destroys the current object and returns where vkCreate* should
+        // write the new one, e.g. vkCreateFence(device, &info, nullptr, fence.put(device))
+        T *put(VkDevice owner) {
+            reset();
+            device = owner;
+            return &handle;
+        }
+
+        void reset() {
+            if (handle != VK_NULL_HANDLE) {
+                destroy(device, handle, nullptr);
+                handle = static_cast<T>(VK_NULL_HANDLE);
+            }
+        }
+
+    private:
+        VkDevice device = VK_NULL_HANDLE;
+        T handle = static_cast<T>(VK_NULL_HANDLE);
+};
+
+using unique_swapchain = device_handle<VkSwapchainKHR, vkDestroySwapchainKHR>;
+using unique_image = device_handle<VkImage, vkDestroyImage>;
+using unique_image_view = device_handle<VkImageView, vkDestroyImageView>;
+using unique_device_memory = device_handle<VkDeviceMemory, vkFreeMemory>;
+using unique_buffer = device_handle<VkBuffer, vkDestroyBuffer>;
+using unique_sampler = device_handle<VkSampler, vkDestroySampler>;
+using unique_framebuffer = device_handle<VkFramebuffer, vkDestroyFramebuffer>;
+using unique_render_pass = device_handle<VkRenderPass, vkDestroyRenderPass>;
+using unique_descriptor_set_layout = device_handle<VkDescriptorSetLayout, vkDestroyDescriptorSetLayout>;
+using unique_descriptor_pool = device_handle<VkDescriptorPool, vkDestroyDescriptorPool>;
+using unique_pipeline_layout = device_handle<VkPipelineLayout, vkDestroyPipelineLayout>;
+using unique_pipeline = device_handle<VkPipeline, vkDestroyPipeline>;
+using unique_pipeline_cache = device_handle<VkPipelineCache, vkDestroyPipelineCache>;
+using unique_shader_module = device_handle<VkShaderModule, vkDestroyShaderModule>;
+using unique_command_pool = device_handle<VkCommandPool, vkDestroyCommandPool>;
+using unique_semaphore = device_handle<VkSemaphore, vkDestroySemaphore>;
+using unique_fence = device_handle<VkFence, vkDestroyFence>;
+using unique_query_pool = device_handle<VkQueryPool, vkDestroyQueryPool>;
+
+// Resources that frames already submitted may still use. Each one is keyed
+// on the number of the last frame submitted before it was retired and is only
+// destroyed once that frame is known to have completed, so resources can be
+// replaced while rendering continues instead of waiting for the device to go idle.
+class deletion_queue {
+    public:
+        template <typename T>
+        void retire(std::uint64_t last_use_frame, T &&resource) {
+            entries.push_back({ last_use_frame, std::make_shared<std::decay_t<T>>(std::forward<T>(resource)) });
+        }
+
+        // Destroys, in retirement order, everything whose last frame is done
+        void collect(std::uint64_t completed_frame) {
+            while (!entries.empty() && entries.front().last_use_frame <= completed_frame) {
+                entries.pop_front();
+            }
+        }
+
+        void flush() {
+            entries.clear();
+        }
+
+        bool empty() const {
+            return entries.empty();
+        }
+
+    private:
+        struct entry {
+            std::uint64_t last_use_frame;
+            std::shared_ptr<void> resource;
+        };
+
+        std::deque<entry> entries;
+};
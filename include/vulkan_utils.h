@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+// Helpers shared by the windowed application and the headless renderers
+
+// Thrown when no Vulkan implementation or device is available at all, as
+// opposed to one that lacks a feature, so callers can fall back to the CPU
+class no_vulkan_device_error : public std::runtime_error {
+    public:
+        using std::runtime_error::runtime_error;
+};
+
+bool check_validation_layer_support();
+
+std::vector<char> read_file(const std::string &filename);
+VkShaderModule create_shader_module(VkDevice device, const std::vector<char> &code);
+
+// Creates a pipeline cache seeded from a file left behind by an earlier run,
+// if there is one, and writes a cache back to such a file
+VkPipelineCache load_pipeline_cache(VkDevice device, const std::string &filename);
+void save_pipeline_cache(VkDevice device, VkPipelineCache pipeline_cache, const std::string &filename);
+
+std::uint32_t find_memory_type(VkPhysicalDevice physical_device, std::uint32_t type_filter,
+        VkMemoryPropertyFlags properties, VkMemoryPropertyFlags preferred_properties = 0);
+void create_image(VkPhysicalDevice physical_device, VkDevice device, std::uint32_t width, std::uint32_t height,
+        VkSampleCountFlagBits samples, VkFormat format, VkImageUsageFlags usage, VkMemoryPropertyFlags properties,
+        VkMemoryPropertyFlags preferred_properties, VkImage &image, VkDeviceMemory &image_memory);
+void create_image(VkPhysicalDevice physical_device, VkDevice device, std::uint32_t width, std::uint32_t height,
+        std::uint32_t mip_levels, VkSampleCountFlagBits samples, VkFormat format, VkImageUsageFlags usage,
+        VkMemoryPropertyFlags properties, VkMemoryPropertyFlags preferred_properties, VkImage &image,
+        VkDeviceMemory &image_memory);
+VkImageView create_image_view(VkDevice device, VkImage image, VkFormat format, VkImageAspectFlags aspect_flags,
+        std::uint32_t mip_levels = 1);
+void create_buffer(VkPhysicalDevice physical_device, VkDevice device, VkDeviceSize size, VkBufferUsageFlags usage,
+        VkMemoryPropertyFlags properties, VkMemoryPropertyFlags preferred_properties, VkBuffer &buffer,
+        VkDeviceMemory &buffer_memory);
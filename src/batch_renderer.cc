@@ -0,0 +1,693 @@
+#include "batch_renderer.h"
+#include "config.h"
+#include "cpu_rasterizer.h"
+#include "image_io.h"
+#include "vulkan_utils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+job_client::job_client(int fd) : fd(fd) {}
+
+job_client::~job_client() {
+    close(fd);
+}
+
+void job_client::reply(const std::string &line) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::string message = line + "\n";
+    size_t sent = 0;
+    while (sent < message.size()) {
+        ssize_t result = send(fd, message.data() + sent, message.size() - sent, MSG_NOSIGNAL);
+        if (result <= 0) {
+            // The client went away, nobody is left to tell
+            return;
+        }
+        sent += result;
+    }
+}
+
+static std::vector<float> parse_floats(const std::string &key, const std::string &value, size_t count) {
+    std::vector<float> result;
+    std::stringstream stream(value);
+    std::string item;
+
+    while (std::getline(stream, item, ',')) {
+        size_t end = 0;
+        float number = 0.0f;
+        try {
+            number = std::stof(item, &end);
+        } catch (const std::exception &) {
+            end = 0;
+        }
+        if (end == 0 || end != item.size() || !std::isfinite(number)) {
+            throw std::invalid_argument("Invalid value for " + key + ": " + value);
+        }
+        result.push_back(number);
+    }
+
+    if (result.size() != count) {
+        throw std::invalid_argument("Expected " + std::to_string(count) + " value(s) for " + key + ": " + value);
+    }
+
+    return result;
+}
+
+render_job parse_render_job(const std::string &line) {
+    render_job job;
+    job.extent = { WINDOW_WIDTH, WINDOW_HEIGHT };
+
+    std::stringstream stream(line);
+    std::string field;
+    while (stream >> field) {
+        size_t separator = field.find('=');
+        if (separator == std::string::npos) {
+            throw std::invalid_argument("Expected key=value, got " + field);
+        }
+
+        std::string key = field.substr(0, separator);
+        std::string value = field.substr(separator + 1);
+
+        if (key == "output") {
+            job.output_path = value;
+        } else if (key == "size") {
+            size_t x = value.find('x');
+            std::vector<float> size = parse_floats(key, x == std::string::npos ? value : value.substr(0, x) + "," + value.substr(x + 1), 2);
+            if (size[0] < 1.0f || size[1] < 1.0f || size[0] != std::floor(size[0]) || size[1] != std::floor(size[1])) {
+                throw std::invalid_argument("Invalid value for size: " + value);
+            }
+            job.extent = { static_cast<std::uint32_t>(size[0]), static_cast<std::uint32_t>(size[1]) };
+        } else if (key == "clear") {
+            std::vector<float> color = parse_floats(key, value, 3);
+            std::copy(color.begin(), color.end(), job.clear_color);
+        } else if (key == "offset") {
+            std::vector<float> offset = parse_floats(key, value, 2);
+            std::copy(offset.begin(), offset.end(), job.transform.offset);
+        } else if (key == "scale") {
+            job.transform.scale = parse_floats(key, value, 1)[0];
+        } else if (key == "rotation") {
+            // Degrees in the job description, radians in the shader
+            job.transform.rotation = parse_floats(key, value, 1)[0] * static_cast<float>(M_PI / 180.0);
+        } else {
+            throw std::invalid_argument("Unknown job key: " + key);
+        }
+    }
+
+    if (job.output_path.empty()) {
+        throw std::invalid_argument("Job has no output path");
+    }
+
+    return job;
+}
+
+void batch_renderer::run(const std::string &socket_path, bool use_cpu) {
+    if (!use_cpu) {
+        try {
+            init();
+        } catch (const no_vulkan_device_error &e) {
+            std::cerr << e.what() << " Rendering jobs on the CPU instead." << std::endl;
+            use_cpu = true;
+        }
+    }
+
+    // Written to when the reader has to stop before its input ends
+    if (pipe(stop_reader_fds) != 0) {
+        throw std::runtime_error("Failed to create reader stop pipe!");
+    }
+
+    std::thread reader;
+    if (socket_path.empty()) {
+        reader = std::thread([this]() { read_jobs_from_stdin(); });
+    } else {
+        open_job_socket(socket_path);
+        reader = std::thread([this, socket_path]() { read_jobs_from_socket(socket_path); });
+    }
+    std::thread writer([this]() { write_results(); });
+
+    try {
+        if (use_cpu) {
+            render_on_cpu();
+        }
+
+        // Keep the GPU fed while jobs are waiting; when none are, retire the
+        // slots still in flight instead of leaving their results unwritten
+        while (!use_cpu) {
+            render_job job;
+            if (pending_jobs.try_pop(job)) {
+                submit_job(std::move(job));
+            } else if (slots_in_flight > 0) {
+                retire_oldest_slot();
+            } else if (pending_jobs.pop(job)) {
+                submit_job(std::move(job));
+            } else {
+                break;
+            }
+        }
+    } catch (...) {
+        // The reader may be blocked on its input; it also polls the stop pipe
+        char stop = 0;
+        write(stop_reader_fds[1], &stop, 1);
+        reader.join();
+        completed_jobs.close();
+        writer.join();
+        close_stop_pipe();
+
+        if (!use_cpu) {
+            cleanup();
+        }
+        throw;
+    }
+
+    reader.join();
+    completed_jobs.close();
+    writer.join();
+    close_stop_pipe();
+
+    if (!use_cpu) {
+        cleanup();
+    }
+    report_summary();
+}
+
+void batch_renderer::close_stop_pipe() {
+    close(stop_reader_fds[0]);
+    close(stop_reader_fds[1]);
+    stop_reader_fds[0] = -1;
+    stop_reader_fds[1] = -1;
+}
+
+void batch_renderer::render(std::vector<render_job> jobs, const std::function<void(completed_job &)> &on_result) {
+    result_handler = on_result;
+    init();
+
+    for (auto &job : jobs) {
+        job.id = next_job_id++;
+        job.received = std::chrono::steady_clock::now();
+        submit_job(std::move(job));
+    }
+    while (slots_in_flight > 0) {
+        retire_oldest_slot();
+    }
+
+    cleanup();
+    result_handler = nullptr;
+}
+
+void batch_renderer::render_on_cpu() {
+    cpu_rasterizer rasterizer;
+    std::cout << "Rendering jobs on the CPU with " << rasterizer.thread_count() << " thread(s), "
+        << rasterizer.kernel_name() << " kernels" << std::endl;
+
+    render_job job;
+    while (pending_jobs.pop(job)) {
+        completed_job result;
+        rasterizer.render(job.transform, job.clear_color, job.extent.width, job.extent.height, result.pixels);
+        result.job = std::move(job);
+        deliver(result);
+    }
+}
+
+void batch_renderer::deliver(completed_job &result) {
+    if (result_handler) {
+        result_handler(result);
+    } else {
+        completed_jobs.push(std::move(result));
+    }
+}
+
+void batch_renderer::init() {
+    shared.init(1);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(shared.physical_device, &properties);
+    max_image_dimension = properties.limits.maxImageDimension2D;
+
+    create_command_pool();
+    create_slots();
+}
+
+void batch_renderer::create_command_pool() {
+    VkCommandPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    pool_info.queueFamilyIndex = shared.queue_family;
+
+    if (vkCreateCommandPool(shared.device, &pool_info, nullptr, &command_pool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create command pool!");
+    }
+}
+
+void batch_renderer::create_slots() {
+    slots.resize(MAX_FRAMES_IN_FLIGHT);
+
+    for (auto &target : slots) {
+        VkCommandBufferAllocateInfo alloc_info{};
+        alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        alloc_info.commandPool = command_pool;
+        alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        alloc_info.commandBufferCount = 1;
+
+        if (vkAllocateCommandBuffers(shared.device, &alloc_info, &target.command_buffer) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate command buffers!");
+        }
+
+        // Unsignaled: a slot's fence is only waited on while it holds a job
+        VkFenceCreateInfo fence_info{};
+        fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+        if (vkCreateFence(shared.device, &fence_info, nullptr, &target.fence) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create sync objects!");
+        }
+    }
+}
+
+void batch_renderer::create_slot_targets(slot &target, VkExtent2D extent) {
+    create_image(shared.physical_device, shared.device, extent.width, extent.height, VK_SAMPLE_COUNT_1_BIT,
+            shared.color_format, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, target.image, target.image_memory);
+    target.image_view = create_image_view(shared.device, target.image, shared.color_format, VK_IMAGE_ASPECT_COLOR_BIT);
+
+    VkFramebufferCreateInfo framebuffer_info{};
+    framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebuffer_info.renderPass = shared.render_pass;
+    framebuffer_info.attachmentCount = 1;
+    framebuffer_info.pAttachments = &target.image_view;
+    framebuffer_info.width = extent.width;
+    framebuffer_info.height = extent.height;
+    framebuffer_info.layers = 1;
+
+    if (vkCreateFramebuffer(shared.device, &framebuffer_info, nullptr, &target.framebuffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create framebuffer!");
+    }
+
+    // Cached memory makes the CPU-side copy out of the readback buffer much
+    // faster on devices that offer it
+    VkDeviceSize readback_size = static_cast<VkDeviceSize>(extent.width) * extent.height * 4;
+    create_buffer(shared.physical_device, shared.device, readback_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            VK_MEMORY_PROPERTY_HOST_CACHED_BIT, target.readback_buffer, target.readback_buffer_memory);
+    vkMapMemory(shared.device, target.readback_buffer_memory, 0, readback_size, 0, &target.readback_data);
+
+    target.extent = extent;
+}
+
+void batch_renderer::destroy_slot_targets(slot &target) {
+    if (target.image == VK_NULL_HANDLE) {
+        return;
+    }
+
+    vkUnmapMemory(shared.device, target.readback_buffer_memory);
+    vkDestroyBuffer(shared.device, target.readback_buffer, nullptr);
+    vkFreeMemory(shared.device, target.readback_buffer_memory, nullptr);
+    vkDestroyFramebuffer(shared.device, target.framebuffer, nullptr);
+    vkDestroyImageView(shared.device, target.image_view, nullptr);
+    vkDestroyImage(shared.device, target.image, nullptr);
+    vkFreeMemory(shared.device, target.image_memory, nullptr);
+
+    target.extent = { 0, 0 };
+    target.image = VK_NULL_HANDLE;
+    target.readback_data = nullptr;
+}
+
+void batch_renderer::read_jobs_from_stdin() {
+    // Read with poll() rather than std::getline so that the stop pipe can
+    // interrupt it
+    std::string buffer;
+    bool done = false;
+    while (!done) {
+        pollfd fds[2] = { { STDIN_FILENO, POLLIN, 0 }, { stop_reader_fds[0], POLLIN, 0 } };
+        if (poll(fds, 2, -1) < 0) {
+            continue;
+        }
+        if (fds[1].revents & POLLIN) {
+            break;
+        }
+        if (!(fds[0].revents & (POLLIN | POLLHUP | POLLERR))) {
+            continue;
+        }
+
+        char data[4096];
+        ssize_t received = read(STDIN_FILENO, data, sizeof(data));
+        if (received <= 0) {
+            // Like std::getline, a last line without a newline still counts
+            if (!buffer.empty()) {
+                accept_job_line(buffer, nullptr);
+            }
+            done = true;
+            continue;
+        }
+
+        buffer.append(data, received);
+        size_t newline;
+        while ((newline = buffer.find('\n')) != std::string::npos) {
+            accept_job_line(buffer.substr(0, newline), nullptr);
+            buffer.erase(0, newline + 1);
+        }
+    }
+    pending_jobs.close();
+}
+
+void batch_renderer::open_job_socket(const std::string &socket_path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Job socket path is too long!");
+    }
+    std::strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        throw std::runtime_error("Failed to create job socket!");
+    }
+
+    // A socket file left behind by an earlier run would make bind() fail
+    unlink(socket_path.c_str());
+    if (bind(listen_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(listen_fd, 16) != 0) {
+        close(listen_fd);
+        throw std::runtime_error("Failed to listen on job socket " + socket_path + "!");
+    }
+
+    std::cout << "Accepting jobs on " << socket_path << std::endl;
+}
+
+void batch_renderer::read_jobs_from_socket(const std::string &socket_path) {
+    struct connection {
+        std::shared_ptr<job_client> client;
+        std::string buffer;
+    };
+    std::map<int, connection> connections;
+    bool quit = false;
+
+    while (!quit) {
+        std::vector<pollfd> fds;
+        fds.push_back({ listen_fd, POLLIN, 0 });
+        fds.push_back({ stop_reader_fds[0], POLLIN, 0 });
+        for (const auto &[fd, unused] : connections) {
+            fds.push_back({ fd, POLLIN, 0 });
+        }
+
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            continue;
+        }
+        if (fds[1].revents & POLLIN) {
+            break;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int client_fd = accept(listen_fd, nullptr, nullptr);
+            if (client_fd >= 0) {
+                connections[client_fd].client = std::make_shared<job_client>(client_fd);
+            }
+        }
+
+        for (size_t i = 2; i < fds.size() && !quit; i++) {
+            if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+                continue;
+            }
+
+            connection &current = connections[fds[i].fd];
+            char data[4096];
+            ssize_t received = recv(fds[i].fd, data, sizeof(data), 0);
+            if (received <= 0) {
+                // Pending jobs keep the client alive until they have replied
+                connections.erase(fds[i].fd);
+                continue;
+            }
+
+            current.buffer.append(data, received);
+            size_t newline;
+            while ((newline = current.buffer.find('\n')) != std::string::npos) {
+                std::string line = current.buffer.substr(0, newline);
+                current.buffer.erase(0, newline + 1);
+
+                if (!line.empty() && line.back() == '\r') {
+                    line.pop_back();
+                }
+                if (line == "quit") {
+                    quit = true;
+                    break;
+                }
+                accept_job_line(line, current.client);
+            }
+        }
+    }
+
+    connections.clear();
+    close(listen_fd);
+    unlink(socket_path.c_str());
+    pending_jobs.close();
+}
+
+void batch_renderer::accept_job_line(const std::string &line, const std::shared_ptr<job_client> &client) {
+    size_t start = line.find_first_not_of(" \t");
+    if (start == std::string::npos || line[start] == '#') {
+        return;
+    }
+
+    try {
+        render_job job = parse_render_job(line);
+        job.id = next_job_id++;
+        job.received = std::chrono::steady_clock::now();
+        job.client = client;
+        pending_jobs.push(std::move(job));
+    } catch (const std::invalid_argument &e) {
+        std::string message = std::string("error ") + e.what();
+        if (client) {
+            client->reply(message);
+        } else {
+            std::cerr << message << std::endl;
+        }
+    }
+}
+
+void batch_renderer::submit_job(render_job job) {
+    if (job.extent.width > max_image_dimension || job.extent.height > max_image_dimension) {
+        completed_job failed;
+        failed.error = "size exceeds the device limit of " + std::to_string(max_image_dimension);
+        failed.job = std::move(job);
+        deliver(failed);
+        return;
+    }
+
+    // Every slot is busy: the oldest one is the one to reuse
+    if (slots_in_flight == slots.size()) {
+        retire_oldest_slot();
+    }
+
+    slot &target = slots[next_slot];
+    next_slot = (next_slot + 1) % slots.size();
+
+    if (target.extent.width != job.extent.width || target.extent.height != job.extent.height) {
+        destroy_slot_targets(target);
+        create_slot_targets(target, job.extent);
+    }
+
+    vkResetCommandBuffer(target.command_buffer, 0);
+    record_command_buffer(target, job);
+
+    VkSubmitInfo submit_info{};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &target.command_buffer;
+
+    shared_queue &queue = shared.queue_for_context(0);
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (vkQueueSubmit(queue.queue, 1, &submit_info, target.fence) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to submit draw command buffer!");
+        }
+    }
+
+    target.job = std::move(job);
+    slots_in_flight++;
+}
+
+void batch_renderer::retire_oldest_slot() {
+    slot &target = slots[(next_slot + slots.size() - slots_in_flight) % slots.size()];
+
+    vkWaitForFences(shared.device, 1, &target.fence, VK_TRUE, std::numeric_limits<std::uint64_t>::max());
+    vkResetFences(shared.device, 1, &target.fence);
+
+    // Copy out so the slot can take the next job while the writer encodes
+    completed_job result;
+    const std::uint8_t *data = static_cast<const std::uint8_t *>(target.readback_data);
+    result.pixels.assign(data, data + static_cast<size_t>(target.extent.width) * target.extent.height * 4);
+    result.job = std::move(*target.job);
+    target.job.reset();
+    slots_in_flight--;
+
+    deliver(result);
+}
+
+void batch_renderer::record_command_buffer(slot &target, const render_job &job) {
+    VkCommandBufferBeginInfo begin_info{};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    if (vkBeginCommandBuffer(target.command_buffer, &begin_info) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to begin recording command buffer!");
+    }
+
+    VkRenderPassBeginInfo render_pass_info{};
+    render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    render_pass_info.renderPass = shared.render_pass;
+    render_pass_info.framebuffer = target.framebuffer;
+    render_pass_info.renderArea.offset = { 0, 0 };
+    render_pass_info.renderArea.extent = job.extent;
+    VkClearValue clear_color = { { { job.clear_color[0], job.clear_color[1], job.clear_color[2], 1.0f } } };
+    render_pass_info.clearValueCount = 1;
+    render_pass_info.pClearValues = &clear_color;
+
+    vkCmdBeginRenderPass(target.command_buffer, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
+
+    vkCmdBindPipeline(target.command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shared.graphics_pipeline);
+
+    VkViewport viewport{};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = static_cast<float>(job.extent.width);
+    viewport.height = static_cast<float>(job.extent.height);
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(target.command_buffer, 0, 1, &viewport);
+
+    VkRect2D scissor{};
+    scissor.offset = { 0, 0 };
+    scissor.extent = job.extent;
+    vkCmdSetScissor(target.command_buffer, 0, 1, &scissor);
+
+    vkCmdPushConstants(target.command_buffer, shared.pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(job.transform), &job.transform);
+
+    vkCmdDraw(target.command_buffer, 3, 1, 0, 0);
+
+    vkCmdEndRenderPass(target.command_buffer);
+
+    // The render pass leaves the image in TRANSFER_SRC_OPTIMAL
+    VkBufferImageCopy region{};
+    region.bufferOffset = 0;
+    region.bufferRowLength = 0;
+    region.bufferImageHeight = 0;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = 0;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+    region.imageOffset = { 0, 0, 0 };
+    region.imageExtent = { job.extent.width, job.extent.height, 1 };
+
+    vkCmdCopyImageToBuffer(target.command_buffer, target.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, target.readback_buffer, 1, &region);
+
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = target.readback_buffer;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+
+    vkCmdPipelineBarrier(target.command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+            0, nullptr, 1, &barrier, 0, nullptr);
+
+    if (vkEndCommandBuffer(target.command_buffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to record command buffer!");
+    }
+}
+
+void batch_renderer::write_results() {
+    completed_job result;
+    while (completed_jobs.pop(result)) {
+        const render_job &job = result.job;
+
+        if (result.error.empty()) {
+            try {
+                write_ppm(job.output_path, job.extent.width, job.extent.height, result.pixels.data());
+            } catch (const std::runtime_error &e) {
+                result.error = e.what();
+            }
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        double latency_ms = std::chrono::duration<double, std::milli>(now - job.received).count();
+
+        if (!any_job_received) {
+            first_job_received = job.received;
+            any_job_received = true;
+        }
+        last_job_written = now;
+
+        std::ostringstream line;
+        line << std::fixed << std::setprecision(2);
+        if (result.error.empty()) {
+            latencies_ms.push_back(latency_ms);
+            line << "done " << job.id << " " << job.output_path << " "
+                << job.extent.width << "x" << job.extent.height << " " << latency_ms << " ms";
+        } else {
+            failed_jobs++;
+            line << "error " << job.id << " " << job.output_path << ": " << result.error;
+        }
+
+        if (job.client) {
+            job.client->reply(line.str());
+        }
+        std::cout << line.str() << std::endl;
+    }
+}
+
+void batch_renderer::report_summary() {
+    if (latencies_ms.empty()) {
+        std::cout << "No jobs rendered, " << failed_jobs << " failed" << std::endl;
+        return;
+    }
+
+    std::vector<double> sorted = latencies_ms;
+    std::sort(sorted.begin(), sorted.end());
+    auto percentile = [&](double p) {
+        return sorted[std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()))];
+    };
+
+    double mean = 0.0;
+    for (double latency : sorted) {
+        mean += latency;
+    }
+    mean /= sorted.size();
+
+    double seconds = std::chrono::duration<double>(last_job_written - first_job_received).count();
+
+    std::cout << std::fixed << std::setprecision(2)
+        << sorted.size() << " jobs rendered, " << failed_jobs << " failed, "
+        << (seconds > 0.0 ? sorted.size() / seconds : 0.0) << " jobs/s\n"
+        << "Latency ms: mean " << mean << ", p50 " << percentile(0.5) << ", p95 " << percentile(0.95)
+        << ", max " << sorted.back() << std::endl;
+}
+
+void batch_renderer::cleanup() {
+    vkDeviceWaitIdle(shared.device);
+
+    for (auto &target : slots) {
+        destroy_slot_targets(target);
+        vkDestroyFence(shared.device, target.fence, nullptr);
+    }
+    vkDestroyCommandPool(shared.device, command_pool, nullptr);
+
+    shared.cleanup();
+}
@@ -0,0 +1,427 @@
+#include "cpu_rasterizer.h"
+#include "config.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CPU_RASTERIZER_X86
+#include <immintrin.h>
+#endif
+
+// Same vertices and colors as shader.vert
+static const float positions[3][2] = {
+    { 0.0f, -0.5f },
+    { 0.5f, 0.5f },
+    { -0.5f, 0.5f }
+};
+
+static const float colors[3][3] = {
+    { 1.0f, 0.0f, 0.0f },
+    { 0.0f, 1.0f, 0.0f },
+    { 0.0f, 0.0f, 1.0f }
+};
+
+static const double SUBPIXEL_SCALE = 256.0;
+
+// Triangles are clipped to this many pixels around the origin, which keeps
+// every edge function value below 2^53 and therefore exact in a double
+static const double GUARD_BAND = 32768.0;
+
+// Sutherland-Hodgman against the guard band rectangle. Screen space is
+// affine, so positions and colors are interpolated linearly along the edges.
+static std::vector<clip_vertex> clip_to_guard_band(std::vector<clip_vertex> polygon) {
+    for (int plane = 0; plane < 4 && !polygon.empty(); plane++) {
+        // -x, +x, -y, +y
+        bool vertical = plane < 2;
+        double bound = (plane % 2 == 0) ? -GUARD_BAND : GUARD_BAND;
+        auto coordinate = [vertical](const clip_vertex &v) { return vertical ? v.x : v.y; };
+        auto inside = [&](const clip_vertex &v) { return plane % 2 == 0 ? coordinate(v) >= bound : coordinate(v) <= bound; };
+
+        std::vector<clip_vertex> clipped;
+        for (size_t i = 0; i < polygon.size(); i++) {
+            const clip_vertex &current = polygon[i];
+            const clip_vertex &next = polygon[(i + 1) % polygon.size()];
+
+            if (inside(current)) {
+                clipped.push_back(current);
+            }
+            if (inside(current) != inside(next)) {
+                double t = (bound - coordinate(current)) / (coordinate(next) - coordinate(current));
+                clip_vertex crossing;
+                crossing.x = vertical ? bound : current.x + t * (next.x - current.x);
+                crossing.y = vertical ? current.y + t * (next.y - current.y) : bound;
+                for (int k = 0; k < 3; k++) {
+                    crossing.color[k] = static_cast<float>(current.color[k] + t * (next.color[k] - current.color[k]));
+                }
+                clipped.push_back(crossing);
+            }
+        }
+        polygon = std::move(clipped);
+    }
+    return polygon;
+}
+
+// Colors are interpolated in double precision and rounded to UNORM8. Every
+// kernel performs the same operations in the same order per pixel.
+static inline std::uint8_t to_unorm8(double value) {
+    return static_cast<std::uint8_t>(static_cast<std::int32_t>(std::min(std::max(value * 255.0, 0.0), 255.0) + 0.5));
+}
+
+static void rasterize_span_scalar(const cpu_triangle &triangle, std::int32_t y, std::int32_t x_begin, std::int32_t x_end, std::uint8_t *row) {
+    double py = y * SUBPIXEL_SCALE + SUBPIXEL_SCALE / 2;
+    double row_e[3];
+    for (int i = 0; i < 3; i++) {
+        row_e[i] = triangle.b[i] * py + triangle.c[i];
+    }
+
+    for (std::int32_t x = x_begin; x < x_end; x++) {
+        double px = x * SUBPIXEL_SCALE + SUBPIXEL_SCALE / 2;
+        double e0 = triangle.a[0] * px + row_e[0];
+        double e1 = triangle.a[1] * px + row_e[1];
+        double e2 = triangle.a[2] * px + row_e[2];
+
+        if (e0 < triangle.min_value[0] || e1 < triangle.min_value[1] || e2 < triangle.min_value[2]) {
+            continue;
+        }
+
+        // The weight of each vertex is the edge function of the opposite edge
+        std::uint8_t *pixel = row + x * 4;
+        for (int k = 0; k < 3; k++) {
+            double value = e1 * triangle.colors[0][k] + e2 * triangle.colors[1][k] + e0 * triangle.colors[2][k];
+            pixel[k] = to_unorm8(value * triangle.inv_double_area);
+        }
+        pixel[3] = 255;
+    }
+}
+
+#ifdef CPU_RASTERIZER_X86
+
+__attribute__((target("sse2")))
+static void rasterize_span_sse2(const cpu_triangle &triangle, std::int32_t y, std::int32_t x_begin, std::int32_t x_end, std::uint8_t *row) {
+    double py = y * SUBPIXEL_SCALE + SUBPIXEL_SCALE / 2;
+    __m128d a[3], row_e[3], min_value[3];
+    for (int i = 0; i < 3; i++) {
+        a[i] = _mm_set1_pd(triangle.a[i]);
+        row_e[i] = _mm_set1_pd(triangle.b[i] * py + triangle.c[i]);
+        min_value[i] = _mm_set1_pd(triangle.min_value[i]);
+    }
+
+    const __m128d lane_offsets = _mm_set_pd(SUBPIXEL_SCALE, 0.0);
+    const __m128d inv_double_area = _mm_set1_pd(triangle.inv_double_area);
+    const __m128d zero = _mm_set1_pd(0.0);
+    const __m128d max_unorm = _mm_set1_pd(255.0);
+    const __m128d half = _mm_set1_pd(0.5);
+
+    for (std::int32_t x = x_begin; x < x_end; x += 2) {
+        __m128d px = _mm_add_pd(_mm_set1_pd(x * SUBPIXEL_SCALE + SUBPIXEL_SCALE / 2), lane_offsets);
+        __m128d e0 = _mm_add_pd(_mm_mul_pd(a[0], px), row_e[0]);
+        __m128d e1 = _mm_add_pd(_mm_mul_pd(a[1], px), row_e[1]);
+        __m128d e2 = _mm_add_pd(_mm_mul_pd(a[2], px), row_e[2]);
+
+        __m128d inside = _mm_and_pd(_mm_and_pd(_mm_cmpge_pd(e0, min_value[0]), _mm_cmpge_pd(e1, min_value[1])),
+                _mm_cmpge_pd(e2, min_value[2]));
+        int mask = _mm_movemask_pd(inside);
+        if (x_end - x < 2) {
+            mask &= (1 << (x_end - x)) - 1;
+        }
+        if (mask == 0) {
+            continue;
+        }
+
+        __m128i packed = _mm_set1_epi32(static_cast<std::int32_t>(0xff000000u));
+        for (int k = 0; k < 3; k++) {
+            __m128d value = _mm_add_pd(_mm_add_pd(_mm_mul_pd(e1, _mm_set1_pd(triangle.colors[0][k])),
+                    _mm_mul_pd(e2, _mm_set1_pd(triangle.colors[1][k]))), _mm_mul_pd(e0, _mm_set1_pd(triangle.colors[2][k])));
+            value = _mm_mul_pd(_mm_mul_pd(value, inv_double_area), max_unorm);
+            value = _mm_add_pd(_mm_min_pd(_mm_max_pd(value, zero), max_unorm), half);
+            packed = _mm_or_si128(packed, _mm_slli_epi32(_mm_cvttpd_epi32(value), k * 8));
+        }
+
+        alignas(16) std::uint32_t pixels[4];
+        _mm_store_si128(reinterpret_cast<__m128i *>(pixels), packed);
+        for (int lane = 0; lane < 2; lane++) {
+            if (mask & (1 << lane)) {
+                std::memcpy(row + (x + lane) * 4, &pixels[lane], 4);
+            }
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+static void rasterize_span_avx2(const cpu_triangle &triangle, std::int32_t y, std::int32_t x_begin, std::int32_t x_end, std::uint8_t *row) {
+    double py = y * SUBPIXEL_SCALE + SUBPIXEL_SCALE / 2;
+    __m256d a[3], row_e[3], min_value[3];
+    for (int i = 0; i < 3; i++) {
+        a[i] = _mm256_set1_pd(triangle.a[i]);
+        row_e[i] = _mm256_set1_pd(triangle.b[i] * py + triangle.c[i]);
+        min_value[i] = _mm256_set1_pd(triangle.min_value[i]);
+    }
+
+    const __m256d lane_offsets = _mm256_set_pd(3 * SUBPIXEL_SCALE, 2 * SUBPIXEL_SCALE, SUBPIXEL_SCALE, 0.0);
+    const __m256d inv_double_area = _mm256_set1_pd(triangle.inv_double_area);
+    const __m256d zero = _mm256_set1_pd(0.0);
+    const __m256d max_unorm = _mm256_set1_pd(255.0);
+    const __m256d half = _mm256_set1_pd(0.5);
+    const __m128i lane_bits = _mm_set_epi32(8, 4, 2, 1);
+
+    for (std::int32_t x = x_begin; x < x_end; x += 4) {
+        __m256d px = _mm256_add_pd(_mm256_set1_pd(x * SUBPIXEL_SCALE + SUBPIXEL_SCALE / 2), lane_offsets);
+        __m256d e0 = _mm256_add_pd(_mm256_mul_pd(a[0], px), row_e[0]);
+        __m256d e1 = _mm256_add_pd(_mm256_mul_pd(a[1], px), row_e[1]);
+        __m256d e2 = _mm256_add_pd(_mm256_mul_pd(a[2], px), row_e[2]);
+
+        __m256d inside = _mm256_and_pd(_mm256_and_pd(_mm256_cmp_pd(e0, min_value[0], _CMP_GE_OQ),
+                _mm256_cmp_pd(e1, min_value[1], _CMP_GE_OQ)), _mm256_cmp_pd(e2, min_value[2], _CMP_GE_OQ));
+        int mask = _mm256_movemask_pd(inside);
+        if (x_end - x < 4) {
+            mask &= (1 << (x_end - x)) - 1;
+        }
+        if (mask == 0) {
+            continue;
+        }
+
+        // Pack RGBA8 in integer lanes and store only the covered pixels
+        __m128i packed = _mm_set1_epi32(static_cast<std::int32_t>(0xff000000u));
+        for (int k = 0; k < 3; k++) {
+            __m256d value = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(e1, _mm256_set1_pd(triangle.colors[0][k])),
+                    _mm256_mul_pd(e2, _mm256_set1_pd(triangle.colors[1][k]))), _mm256_mul_pd(e0, _mm256_set1_pd(triangle.colors[2][k])));
+            value = _mm256_mul_pd(_mm256_mul_pd(value, inv_double_area), max_unorm);
+            value = _mm256_add_pd(_mm256_min_pd(_mm256_max_pd(value, zero), max_unorm), half);
+            packed = _mm_or_si128(packed, _mm_slli_epi32(_mm256_cvttpd_epi32(value), k * 8));
+        }
+
+        __m128i store_mask = _mm_cmpgt_epi32(_mm_and_si128(_mm_set1_epi32(mask), lane_bits), _mm_setzero_si128());
+        _mm_maskstore_epi32(reinterpret_cast<int *>(row + x * 4), store_mask, packed);
+    }
+}
+
+#endif
+
+cpu_rasterizer::cpu_rasterizer(std::uint32_t thread_count) {
+    kernel = rasterize_span_scalar;
+    kernel_description = "scalar";
+
+#ifdef CPU_RASTERIZER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        kernel = rasterize_span_avx2;
+        kernel_description = "AVX2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        kernel = rasterize_span_sse2;
+        kernel_description = "SSE2";
+    }
+#endif
+
+    if (thread_count == 0) {
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // The thread calling render() works on tiles too
+    for (std::uint32_t i = 1; i < thread_count; i++) {
+        workers.emplace_back([this]() { worker_loop(); });
+    }
+}
+
+cpu_rasterizer::~cpu_rasterizer() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_ready.notify_all();
+
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+const char *cpu_rasterizer::kernel_name() const {
+    return kernel_description;
+}
+
+std::uint32_t cpu_rasterizer::thread_count() const {
+    return workers.size() + 1;
+}
+
+void cpu_rasterizer::render(const scene_transform &transform, const float clear_color[3], std::uint32_t width, std::uint32_t height,
+        std::vector<std::uint8_t> &pixels) {
+    pixels.resize(static_cast<size_t>(width) * height * 4);
+
+    this->width = width;
+    this->height = height;
+    std::uint8_t clear_value[4] = { to_unorm8(clear_color[0]), to_unorm8(clear_color[1]), to_unorm8(clear_color[2]), 255 };
+    clear_row.resize(CPU_TILE_SIZE * 4);
+    for (std::uint32_t x = 0; x < CPU_TILE_SIZE; x++) {
+        std::copy(clear_value, clear_value + 4, clear_row.begin() + x * 4);
+    }
+    target = pixels.data();
+    tiles_x = (width + CPU_TILE_SIZE - 1) / CPU_TILE_SIZE;
+    tile_count = tiles_x * ((height + CPU_TILE_SIZE - 1) / CPU_TILE_SIZE);
+    next_tile = 0;
+
+    setup_triangle(transform);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        busy_workers = workers.size();
+        generation++;
+    }
+    work_ready.notify_all();
+
+    render_tiles();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    work_done.wait(lock, [this]() { return busy_workers == 0; });
+}
+
+void cpu_rasterizer::setup_triangle(const scene_transform &transform) {
+    triangles.clear();
+
+    // Vertex transform of scene.vert followed by the viewport transform,
+    // in single precision like the device
+    float s = std::sin(transform.rotation);
+    float c = std::cos(transform.rotation);
+    std::vector<clip_vertex> polygon(3);
+    for (int i = 0; i < 3; i++) {
+        float px = positions[i][0] * transform.scale;
+        float py = positions[i][1] * transform.scale;
+        float ndc_x = c * px - s * py + transform.offset[0];
+        float ndc_y = s * px + c * py + transform.offset[1];
+
+        float half_width = width * 0.5f;
+        float half_height = height * 0.5f;
+        polygon[i].x = half_width * ndc_x + half_width;
+        polygon[i].y = half_height * ndc_y + half_height;
+        std::copy(colors[i], colors[i] + 3, polygon[i].color);
+    }
+
+    // Vertices beyond the guard band would lose precision; clipping rather
+    // than moving them keeps the triangle's shape and interpolation intact.
+    // The clipped polygon is drawn as a fan, whose shared edges the top-left
+    // rule keeps from being covered twice.
+    polygon = clip_to_guard_band(std::move(polygon));
+    for (size_t i = 1; i + 1 < polygon.size(); i++) {
+        add_triangle(polygon[0], polygon[i], polygon[i + 1]);
+    }
+}
+
+void cpu_rasterizer::add_triangle(const clip_vertex &v0, const clip_vertex &v1, const clip_vertex &v2) {
+    const clip_vertex *vertices[3] = { &v0, &v1, &v2 };
+    double x[3], y[3];
+    for (int i = 0; i < 3; i++) {
+        x[i] = std::round(vertices[i]->x * SUBPIXEL_SCALE);
+        y[i] = std::round(vertices[i]->y * SUBPIXEL_SCALE);
+    }
+
+    // Positive for triangles that are clockwise in framebuffer coordinates,
+    // the front faces of the pipeline; back faces are culled
+    double double_area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+    if (double_area <= 0.0) {
+        return;
+    }
+
+    cpu_triangle triangle;
+    for (int i = 0; i < 3; i++) {
+        int j = (i + 1) % 3;
+        double dx = x[j] - x[i];
+        double dy = y[j] - y[i];
+
+        triangle.a[i] = -dy;
+        triangle.b[i] = dx;
+        triangle.c[i] = dy * x[i] - dx * y[i];
+
+        bool top_left = dy < 0.0 || (dy == 0.0 && dx > 0.0);
+        triangle.min_value[i] = top_left ? 0.0 : 1.0;
+
+        std::copy(vertices[i]->color, vertices[i]->color + 3, triangle.colors[i]);
+    }
+    triangle.inv_double_area = 1.0 / double_area;
+
+    auto [min_x, max_x] = std::minmax({ x[0], x[1], x[2] });
+    auto [min_y, max_y] = std::minmax({ y[0], y[1], y[2] });
+    triangle.min_x = static_cast<std::int32_t>(std::max(0.0, std::floor(min_x / SUBPIXEL_SCALE)));
+    triangle.min_y = static_cast<std::int32_t>(std::max(0.0, std::floor(min_y / SUBPIXEL_SCALE)));
+    triangle.max_x = static_cast<std::int32_t>(std::min(width - 1.0, std::ceil(max_x / SUBPIXEL_SCALE)));
+    triangle.max_y = static_cast<std::int32_t>(std::min(height - 1.0, std::ceil(max_y / SUBPIXEL_SCALE)));
+
+    if (triangle.min_x <= triangle.max_x && triangle.min_y <= triangle.max_y) {
+        triangles.push_back(triangle);
+    }
+}
+
+void cpu_rasterizer::worker_loop() {
+    std::uint64_t seen_generation = 0;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            work_ready.wait(lock, [&]() { return stopping || generation != seen_generation; });
+            if (stopping) {
+                return;
+            }
+            seen_generation = generation;
+        }
+
+        render_tiles();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--busy_workers == 0) {
+            work_done.notify_one();
+        }
+    }
+}
+
+void cpu_rasterizer::render_tiles() {
+    std::uint32_t tile;
+    while ((tile = next_tile.fetch_add(1)) < tile_count) {
+        render_tile(tile);
+    }
+}
+
+void cpu_rasterizer::render_tile(std::uint32_t tile) {
+    std::int32_t x0 = (tile % tiles_x) * CPU_TILE_SIZE;
+    std::int32_t y0 = (tile / tiles_x) * CPU_TILE_SIZE;
+    std::int32_t x1 = std::min(x0 + CPU_TILE_SIZE, width);
+    std::int32_t y1 = std::min(y0 + CPU_TILE_SIZE, height);
+
+    for (std::int32_t y = y0; y < y1; y++) {
+        std::memcpy(target + (static_cast<size_t>(y) * width + x0) * 4, clear_row.data(), (x1 - x0) * 4);
+    }
+
+    for (const auto &triangle : triangles) {
+        std::int32_t span_x0 = std::max(x0, triangle.min_x);
+        std::int32_t span_x1 = std::min(x1 - 1, triangle.max_x);
+        std::int32_t span_y0 = std::max(y0, triangle.min_y);
+        std::int32_t span_y1 = std::min(y1 - 1, triangle.max_y);
+        if (span_x0 > span_x1 || span_y0 > span_y1) {
+            continue;
+        }
+
+        // Edge functions are linear, so if one is negative at all four
+        // corners of the covered rectangle, none of it is inside
+        bool outside = false;
+        for (int i = 0; i < 3 && !outside; i++) {
+            double max_e = -INFINITY;
+            for (std::int32_t corner_y : { span_y0, span_y1 }) {
+                for (std::int32_t corner_x : { span_x0, span_x1 }) {
+                    double e = triangle.a[i] * (corner_x * SUBPIXEL_SCALE + SUBPIXEL_SCALE / 2)
+                        + triangle.b[i] * (corner_y * SUBPIXEL_SCALE + SUBPIXEL_SCALE / 2) + triangle.c[i];
+                    max_e = std::max(max_e, e);
+                }
+            }
+            outside = max_e < triangle.min_value[i];
+        }
+        if (outside) {
+            continue;
+        }
+
+        for (std::int32_t y = span_y0; y <= span_y1; y++) {
+            kernel(triangle, y, span_x0, span_x1 + 1, target + static_cast<size_t>(y) * width * 4);
+        }
+    }
+}
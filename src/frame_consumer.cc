@@ -0,0 +1,531 @@
+// Sample consumer for frames exported with --export-socket. Imports the
+// exporter's ring of images and takes every frame through the release
+// protocol without the pixels ever passing through host memory on the way;
+// only to prove the frames are real, the centre pixel of each is copied out
+// and the first frame is written to an image file.
+
+#include "frame_export.h"
+#include "image_io.h"
+#include "vulkan_handle.h"
+#include "vulkan_utils.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+struct imported_image {
+    unique_image image;
+    unique_device_memory image_memory;
+};
+
+class frame_consumer {
+    public:
+        ~frame_consumer();
+
+        void connect_to(const std::string &socket_path);
+        void init();
+        void run(const std::string &output_path);
+
+    private:
+        void create_instance();
+        void pick_physical_device();
+        void create_logical_device();
+        void import_images(std::vector<int> &memory_fds);
+        void create_frame_resources();
+        void consume_frame(const export_frame &frame, int sync_fd);
+        void record_command_buffer(VkImage image, bool copy_whole_image);
+
+        int socket_fd = -1;
+        export_hello hello;
+
+        VkInstance instance = VK_NULL_HANDLE;
+        VkPhysicalDevice physical_device = VK_NULL_HANDLE;
+        VkDevice device = VK_NULL_HANDLE;
+        std::uint32_t queue_family;
+        VkQueue queue;
+        PFN_vkGetSemaphoreFdKHR get_semaphore_fd;
+        PFN_vkImportSemaphoreFdKHR import_semaphore_fd;
+
+        std::vector<imported_image> images;
+        unique_command_pool command_pool;
+        VkCommandBuffer command_buffer;
+        unique_fence fence;
+        unique_semaphore acquired_semaphore;
+        unique_semaphore released_semaphore;
+        // The centre pixel of every frame, followed by the whole first frame
+        unique_buffer readback_buffer;
+        unique_device_memory readback_buffer_memory;
+        std::uint8_t *readback_data = nullptr;
+
+        std::uint64_t frames_received = 0;
+        std::uint64_t blank_frames = 0;
+        std::uint64_t expected_frame_number = 0;
+        std::uint64_t skipped_frames = 0;
+};
+
+frame_consumer::~frame_consumer() {
+    if (device != VK_NULL_HANDLE) {
+        vkDeviceWaitIdle(device);
+        readback_buffer_memory.reset();
+        readback_buffer.reset();
+        released_semaphore.reset();
+        acquired_semaphore.reset();
+        fence.reset();
+        command_pool.reset();
+        images.clear();
+        vkDestroyDevice(device, nullptr);
+    }
+    if (instance != VK_NULL_HANDLE) {
+        vkDestroyInstance(instance, nullptr);
+    }
+    if (socket_fd >= 0) {
+        close(socket_fd);
+    }
+}
+
+void frame_consumer::connect_to(const std::string &socket_path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Export socket path is too long!");
+    }
+    std::strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+
+    socket_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (socket_fd < 0 || connect(socket_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+        throw std::runtime_error("Failed to connect to " + socket_path + "!");
+    }
+}
+
+void frame_consumer::init() {
+    std::vector<int> memory_fds;
+    ssize_t size = receive_export_message(socket_fd, &hello, sizeof(hello), memory_fds);
+
+    // The descriptors are ours from here on, whatever happens
+    try {
+        if (size != sizeof(hello) || hello.type != EXPORT_MESSAGE_HELLO) {
+            throw std::runtime_error("Did not receive a hello from the exporter!");
+        }
+        if (hello.version != EXPORT_PROTOCOL_VERSION) {
+            throw std::runtime_error("Exporter speaks protocol version " + std::to_string(hello.version) + "!");
+        }
+        if (memory_fds.size() != hello.image_count || hello.image_count == 0) {
+            throw std::runtime_error("Exporter sent " + std::to_string(memory_fds.size()) + " memory descriptors for "
+                    + std::to_string(hello.image_count) + " images!");
+        }
+
+        create_instance();
+        pick_physical_device();
+        create_logical_device();
+        import_images(memory_fds);
+    } catch (...) {
+        for (int fd : memory_fds) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+        throw;
+    }
+
+    create_frame_resources();
+
+    std::cout << "Imported " << hello.image_count << " images of " << hello.width << "x" << hello.height << std::endl;
+}
+
+void frame_consumer::create_instance() {
+    VkApplicationInfo app_info{};
+    app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+    app_info.pApplicationName = "Vulkan triangle frame consumer";
+    app_info.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
+    app_info.pEngineName = "No engine";
+    app_info.engineVersion = VK_MAKE_VERSION(1, 0, 0);
+    app_info.apiVersion = VK_API_VERSION_1_2;
+
+    VkInstanceCreateInfo create_info{};
+    create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    create_info.pApplicationInfo = &app_info;
+
+    if (vkCreateInstance(&create_info, nullptr, &instance) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create instance!");
+    }
+}
+
+void frame_consumer::pick_physical_device() {
+    std::uint32_t device_count = 0;
+    vkEnumeratePhysicalDevices(instance, &device_count, nullptr);
+
+    std::vector<VkPhysicalDevice> devices(device_count);
+    vkEnumeratePhysicalDevices(instance, &device_count, devices.data());
+
+    // Optimal tiling and opaque fds only mean the same thing to the same
+    // device running the same driver
+    for (const auto &candidate : devices) {
+        VkPhysicalDeviceIDProperties id_properties{};
+        id_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+
+        VkPhysicalDeviceProperties2 properties{};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties.pNext = &id_properties;
+        vkGetPhysicalDeviceProperties2(candidate, &properties);
+
+        if (std::memcmp(id_properties.deviceUUID, hello.device_uuid, VK_UUID_SIZE) == 0 &&
+                std::memcmp(id_properties.driverUUID, hello.driver_uuid, VK_UUID_SIZE) == 0) {
+            physical_device = candidate;
+            std::cout << "Consuming frames on " << properties.properties.deviceName << std::endl;
+            break;
+        }
+    }
+
+    if (physical_device == VK_NULL_HANDLE) {
+        throw std::runtime_error("Failed to find the exporter's device and driver!");
+    }
+
+    std::uint32_t queue_family_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, nullptr);
+
+    std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, queue_families.data());
+
+    // Copies are all this process does; graphics and compute queues can do them too
+    VkQueueFlags copy_capable = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT;
+    for (queue_family = 0; queue_family < queue_family_count; queue_family++) {
+        if (queue_families[queue_family].queueFlags & copy_capable) {
+            return;
+        }
+    }
+
+    throw std::runtime_error("Failed to find a queue family that supports transfers!");
+}
+
+void frame_consumer::create_logical_device() {
+    float queue_priority = 1.0f;
+
+    VkDeviceQueueCreateInfo queue_create_info{};
+    queue_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queue_create_info.queueFamilyIndex = queue_family;
+    queue_create_info.queueCount = 1;
+    queue_create_info.pQueuePriorities = &queue_priority;
+
+    const char *extensions[] = {
+        VK_KHR_EXTERNAL_MEMORY_FD_EXTENSION_NAME,
+        VK_KHR_EXTERNAL_SEMAPHORE_FD_EXTENSION_NAME
+    };
+
+    VkDeviceCreateInfo create_info{};
+    create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    create_info.queueCreateInfoCount = 1;
+    create_info.pQueueCreateInfos = &queue_create_info;
+    create_info.enabledExtensionCount = 2;
+    create_info.ppEnabledExtensionNames = extensions;
+
+    if (vkCreateDevice(physical_device, &create_info, nullptr, &device) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create logical device!");
+    }
+    vkGetDeviceQueue(device, queue_family, 0, &queue);
+
+    get_semaphore_fd = (PFN_vkGetSemaphoreFdKHR) vkGetDeviceProcAddr(device, "vkGetSemaphoreFdKHR");
+    import_semaphore_fd = (PFN_vkImportSemaphoreFdKHR) vkGetDeviceProcAddr(device, "vkImportSemaphoreFdKHR");
+    if (get_semaphore_fd == nullptr || import_semaphore_fd == nullptr) {
+        throw std::runtime_error("Failed to load external semaphore functions!");
+    }
+}
+
+void frame_consumer::import_images(std::vector<int> &memory_fds) {
+    images.resize(hello.image_count);
+
+    for (std::uint32_t i = 0; i < hello.image_count; i++) {
+        VkExternalMemoryImageCreateInfo external_info;
+        VkImageCreateInfo image_info = export_image_info(hello.width, hello.height, external_info);
+        if (vkCreateImage(device, &image_info, nullptr, images[i].image.put(device)) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create image for import!");
+        }
+
+        VkMemoryRequirements memory_requirements;
+        vkGetImageMemoryRequirements(device, images[i].image, &memory_requirements);
+        if (!(memory_requirements.memoryTypeBits & (1u << hello.memory_type_index)) ||
+                memory_requirements.size > hello.allocation_size) {
+            throw std::runtime_error("Exported memory does not fit the image!");
+        }
+
+        VkMemoryDedicatedAllocateInfo dedicated_info{};
+        dedicated_info.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+        dedicated_info.image = images[i].image;
+
+        VkImportMemoryFdInfoKHR import_info{};
+        import_info.sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_FD_INFO_KHR;
+        import_info.pNext = &dedicated_info;
+        import_info.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT;
+        import_info.fd = memory_fds[i];
+
+        VkMemoryAllocateInfo alloc_info{};
+        alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        alloc_info.pNext = &import_info;
+        alloc_info.allocationSize = hello.allocation_size;
+        alloc_info.memoryTypeIndex = hello.memory_type_index;
+
+        if (vkAllocateMemory(device, &alloc_info, nullptr, images[i].image_memory.put(device)) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to import image memory!");
+        }
+        // A successful import takes ownership of the descriptor
+        memory_fds[i] = -1;
+
+        vkBindImageMemory(device, images[i].image, images[i].image_memory, 0);
+    }
+}
+
+void frame_consumer::create_frame_resources() {
+    VkCommandPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    pool_info.queueFamilyIndex = queue_family;
+
+    if (vkCreateCommandPool(device, &pool_info, nullptr, command_pool.put(device)) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create command pool!");
+    }
+
+    VkCommandBufferAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    alloc_info.commandPool = command_pool;
+    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    alloc_info.commandBufferCount = 1;
+
+    if (vkAllocateCommandBuffers(device, &alloc_info, &command_buffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate command buffers!");
+    }
+
+    VkFenceCreateInfo fence_info{};
+    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+    VkExportSemaphoreCreateInfo export_info{};
+    export_info.sType = VK_STRUCTURE_TYPE_EXPORT_SEMAPHORE_CREATE_INFO;
+    export_info.handleTypes = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT;
+
+    VkSemaphoreCreateInfo exported_semaphore_info{};
+    exported_semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    exported_semaphore_info.pNext = &export_info;
+
+    VkSemaphoreCreateInfo semaphore_info{};
+    semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    if (vkCreateFence(device, &fence_info, nullptr, fence.put(device)) != VK_SUCCESS ||
+            vkCreateSemaphore(device, &semaphore_info, nullptr, acquired_semaphore.put(device)) != VK_SUCCESS ||
+            vkCreateSemaphore(device, &exported_semaphore_info, nullptr, released_semaphore.put(device)) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create synchronization objects!");
+    }
+
+    VkDeviceSize frame_size = static_cast<VkDeviceSize>(hello.width) * hello.height * 4;
+    VkBuffer buffer;
+    VkDeviceMemory buffer_memory;
+    create_buffer(physical_device, device, 4 + frame_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            VK_MEMORY_PROPERTY_HOST_CACHED_BIT, buffer, buffer_memory);
+    readback_buffer = unique_buffer(device, buffer);
+    readback_buffer_memory = unique_device_memory(device, buffer_memory);
+
+    void *data;
+    vkMapMemory(device, readback_buffer_memory, 0, 4 + frame_size, 0, &data);
+    readback_data = static_cast<std::uint8_t *>(data);
+}
+
+void frame_consumer::run(const std::string &output_path) {
+    auto start = std::chrono::steady_clock::now();
+
+    while (true) {
+        export_frame frame;
+        std::vector<int> fds;
+        ssize_t size = receive_export_message(socket_fd, &frame, sizeof(frame), fds);
+        if (size == 0) {
+            break;
+        }
+
+        if (size != sizeof(frame) || frame.type != EXPORT_MESSAGE_FRAME || frame.image_index >= images.size() || fds.size() != 1) {
+            for (int fd : fds) {
+                close(fd);
+            }
+            throw std::runtime_error("Exporter sent an invalid frame!");
+        }
+
+        bool first_frame = frames_received == 0;
+        consume_frame(frame, fds[0]);
+
+        if (first_frame) {
+            write_ppm(output_path, hello.width, hello.height, readback_data + 4);
+            std::cout << "Wrote the first frame to " << output_path << std::endl;
+        }
+    }
+
+    double elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Received " << frames_received << " frames in " << elapsed_s << " s ("
+        << frames_received / elapsed_s << " fps), " << skipped_frames << " missing, "
+        << blank_frames << " without the triangle at the centre" << std::endl;
+
+    if (frames_received == 0 || blank_frames > 0) {
+        throw std::runtime_error("Exported frames did not show the triangle!");
+    }
+}
+
+void frame_consumer::consume_frame(const export_frame &frame, int sync_fd) {
+    // The copy waits for the exporter's rendering on the GPU, not here
+    VkImportSemaphoreFdInfoKHR import_info{};
+    import_info.sType = VK_STRUCTURE_TYPE_IMPORT_SEMAPHORE_FD_INFO_KHR;
+    import_info.semaphore = acquired_semaphore;
+    import_info.flags = VK_SEMAPHORE_IMPORT_TEMPORARY_BIT;
+    import_info.handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT;
+    import_info.fd = sync_fd;
+
+    if (import_semaphore_fd(device, &import_info) != VK_SUCCESS) {
+        close(sync_fd);
+        throw std::runtime_error("Failed to import the frame's sync file!");
+    }
+
+    vkResetCommandBuffer(command_buffer, 0);
+    record_command_buffer(images[frame.image_index].image, frames_received == 0);
+
+    VkSemaphore wait_semaphore = acquired_semaphore;
+    VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    VkSemaphore signal_semaphore = released_semaphore;
+
+    VkSubmitInfo submit_info{};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.waitSemaphoreCount = 1;
+    submit_info.pWaitSemaphores = &wait_semaphore;
+    submit_info.pWaitDstStageMask = &wait_stage;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &command_buffer;
+    submit_info.signalSemaphoreCount = 1;
+    submit_info.pSignalSemaphores = &signal_semaphore;
+
+    VkFence submit_fence = fence;
+    if (vkQueueSubmit(queue, 1, &submit_info, submit_fence) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to submit copy command buffer!");
+    }
+
+    // Release the image right away; the exporter's next use of it waits on
+    // this sync file rather than on us
+    VkSemaphoreGetFdInfoKHR get_info{};
+    get_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_GET_FD_INFO_KHR;
+    get_info.semaphore = released_semaphore;
+    get_info.handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT;
+
+    int release_fd;
+    if (get_semaphore_fd(device, &get_info, &release_fd) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to export the release sync file!");
+    }
+
+    export_release release;
+    release.image_index = frame.image_index;
+    try {
+        send_export_message(socket_fd, &release, sizeof(release), { release_fd });
+    } catch (...) {
+        close(release_fd);
+        throw;
+    }
+    close(release_fd);
+
+    // Only the centre pixel check needs the copy to have finished
+    vkWaitForFences(device, 1, &submit_fence, VK_TRUE, std::numeric_limits<std::uint64_t>::max());
+    vkResetFences(device, 1, &submit_fence);
+
+    // The triangle covers the centre however it is rotated
+    if (readback_data[0] == 0 && readback_data[1] == 0 && readback_data[2] == 0) {
+        blank_frames++;
+    }
+
+    if (frame.frame_number > expected_frame_number) {
+        skipped_frames += frame.frame_number - expected_frame_number;
+    }
+    expected_frame_number = frame.frame_number + 1;
+    frames_received++;
+}
+
+void frame_consumer::record_command_buffer(VkImage image, bool copy_whole_image) {
+    VkCommandBufferBeginInfo begin_info{};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to begin recording command buffer!");
+    }
+
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+
+    // Acquire from the exporter, matching the release it recorded
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_EXTERNAL;
+    barrier.dstQueueFamilyIndex = queue_family;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    VkBufferImageCopy regions[2]{};
+    regions[0].bufferOffset = 0;
+    regions[0].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    regions[0].imageSubresource.layerCount = 1;
+    regions[0].imageOffset = { static_cast<std::int32_t>(hello.width / 2), static_cast<std::int32_t>(hello.height / 2), 0 };
+    regions[0].imageExtent = { 1, 1, 1 };
+
+    regions[1].bufferOffset = 4;
+    regions[1].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    regions[1].imageSubresource.layerCount = 1;
+    regions[1].imageOffset = { 0, 0, 0 };
+    regions[1].imageExtent = { hello.width, hello.height, 1 };
+
+    vkCmdCopyImageToBuffer(command_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback_buffer,
+            copy_whole_image ? 2 : 1, regions);
+
+    // And hand it back the way the exporter expects to find it
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barrier.dstAccessMask = 0;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.srcQueueFamilyIndex = queue_family;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_EXTERNAL;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+            0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to record command buffer!");
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2 || argc > 3) {
+        std::cerr << "Usage: " << argv[0] << " SOCKET [OUTPUT.ppm]\n"
+            << "\n"
+            << "Consumes the frames vulkan_triangle --export-socket SOCKET exports and\n"
+            << "writes the first one to OUTPUT.ppm (default exported_frame.ppm).\n";
+        return EXIT_FAILURE;
+    }
+
+    try {
+        frame_consumer consumer;
+        consumer.connect_to(argv[1]);
+        consumer.init();
+        consumer.run(argc == 3 ? argv[2] : "exported_frame.ppm");
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
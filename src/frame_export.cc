@@ -0,0 +1,120 @@
+#include "frame_export.h"
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Enough for the descriptors of the largest ring a hello may carry
+static const std::size_t MAX_ATTACHED_FDS = 16;
+
+VkImageCreateInfo export_image_info(std::uint32_t width, std::uint32_t height, VkExternalMemoryImageCreateInfo &external_info) {
+    external_info = {};
+    external_info.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_IMAGE_CREATE_INFO;
+    external_info.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT;
+
+    VkImageCreateInfo image_info{};
+    image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.pNext = &external_info;
+    image_info.imageType = VK_IMAGE_TYPE_2D;
+    image_info.extent.width = width;
+    image_info.extent.height = height;
+    image_info.extent.depth = 1;
+    image_info.mipLevels = 1;
+    image_info.arrayLayers = 1;
+    image_info.format = EXPORT_IMAGE_FORMAT;
+    // Optimal tiling is only safe to share because both sides check that
+    // they run on the same device and driver
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    image_info.usage = EXPORT_IMAGE_USAGE;
+    image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    return image_info;
+}
+
+void send_export_message(int socket_fd, const void *message, std::size_t size, const std::vector<int> &fds) {
+    if (fds.size() > MAX_ATTACHED_FDS) {
+        throw std::runtime_error("Too many descriptors for one export message!");
+    }
+
+    iovec data{};
+    data.iov_base = const_cast<void *>(message);
+    data.iov_len = size;
+
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * MAX_ATTACHED_FDS)];
+    msghdr header{};
+    header.msg_iov = &data;
+    header.msg_iovlen = 1;
+
+    if (!fds.empty()) {
+        header.msg_control = control;
+        header.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+
+        cmsghdr *rights = CMSG_FIRSTHDR(&header);
+        rights->cmsg_level = SOL_SOCKET;
+        rights->cmsg_type = SCM_RIGHTS;
+        rights->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+        std::memcpy(CMSG_DATA(rights), fds.data(), sizeof(int) * fds.size());
+    }
+
+    ssize_t sent;
+    do {
+        sent = sendmsg(socket_fd, &header, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+
+    if (sent != static_cast<ssize_t>(size)) {
+        throw std::runtime_error("Failed to send export message!");
+    }
+}
+
+ssize_t receive_export_message(int socket_fd, void *message, std::size_t size, std::vector<int> &fds, bool wait) {
+    fds.clear();
+
+    iovec data{};
+    data.iov_base = message;
+    data.iov_len = size;
+
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * MAX_ATTACHED_FDS)];
+    msghdr header{};
+    header.msg_iov = &data;
+    header.msg_iovlen = 1;
+    header.msg_control = control;
+    header.msg_controllen = sizeof(control);
+
+    ssize_t received;
+    do {
+        received = recvmsg(socket_fd, &header, MSG_CMSG_CLOEXEC | (wait ? 0 : MSG_DONTWAIT));
+    } while (received < 0 && errno == EINTR);
+
+    if (received < 0) {
+        if (!wait && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return -1;
+        }
+        throw std::runtime_error("Failed to receive export message!");
+    }
+
+    for (cmsghdr *rights = CMSG_FIRSTHDR(&header); rights != nullptr; rights = CMSG_NXTHDR(&header, rights)) {
+        if (rights->cmsg_level == SOL_SOCKET && rights->cmsg_type == SCM_RIGHTS) {
+            std::size_t count = (rights->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            std::size_t first = fds.size();
+            fds.resize(first + count);
+            std::memcpy(fds.data() + first, CMSG_DATA(rights), sizeof(int) * count);
+        }
+    }
+
+    if (header.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) {
+        for (int fd : fds) {
+            close(fd);
+        }
+        fds.clear();
+        throw std::runtime_error("Received a malformed export message!");
+    }
+
+    return received;
+}
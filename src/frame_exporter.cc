@@ -0,0 +1,514 @@
+#include "frame_exporter.h"
+#include "config.h"
+#include "frame_export.h"
+#include "vulkan_utils.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+void frame_exporter::run(const std::string &socket_path, std::uint32_t frame_count, VkExtent2D extent) {
+    init(extent);
+    open_socket(socket_path);
+    accept_consumer();
+    send_hello();
+
+    auto start = std::chrono::steady_clock::now();
+    double blocked_ms = 0.0;
+    std::uint64_t exported_frames = 0;
+
+    for (std::uint64_t frame = 0; frame < frame_count && consumer_connected; frame++) {
+        std::uint32_t image_index = frame % ring.size();
+
+        // Take whatever releases have arrived, and only block if the
+        // consumer still holds the image that is up next
+        while (consumer_connected && receive_release(false)) {
+        }
+        if (ring[image_index].with_consumer) {
+            auto wait_start = std::chrono::steady_clock::now();
+            while (consumer_connected && ring[image_index].with_consumer) {
+                receive_release(true);
+            }
+            blocked_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wait_start).count();
+        }
+        if (!consumer_connected) {
+            break;
+        }
+
+        render_frame(image_index, frame);
+        exported_frames++;
+    }
+
+    double elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Exported " << exported_frames << " frames of " << extent.width << "x" << extent.height << " in "
+        << elapsed_s << " s (" << exported_frames / elapsed_s << " fps), waited " << blocked_ms
+        << " ms for the consumer to release images" << std::endl;
+    if (!consumer_connected) {
+        std::cout << "The consumer disconnected early" << std::endl;
+    }
+
+    cleanup();
+}
+
+void frame_exporter::init(VkExtent2D extent) {
+    this->extent = extent;
+
+    shared.init(1, { VK_KHR_EXTERNAL_MEMORY_FD_EXTENSION_NAME, VK_KHR_EXTERNAL_SEMAPHORE_FD_EXTENSION_NAME });
+    queue = &shared.queue_for_context(0);
+
+    load_extension_functions();
+    check_external_handle_support();
+    create_command_pool();
+    create_ring();
+}
+
+void frame_exporter::cleanup() {
+    // The consumer's imports keep the memory alive on its side
+    vkDeviceWaitIdle(shared.device);
+
+    if (consumer_fd >= 0) {
+        close(consumer_fd);
+        consumer_fd = -1;
+    }
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        unlink(socket_path.c_str());
+        listen_fd = -1;
+    }
+
+    ring.clear();
+    command_pool.reset();
+    shared.cleanup();
+}
+
+void frame_exporter::load_extension_functions() {
+    get_memory_fd = (PFN_vkGetMemoryFdKHR) vkGetDeviceProcAddr(shared.device, "vkGetMemoryFdKHR");
+    get_semaphore_fd = (PFN_vkGetSemaphoreFdKHR) vkGetDeviceProcAddr(shared.device, "vkGetSemaphoreFdKHR");
+    import_semaphore_fd = (PFN_vkImportSemaphoreFdKHR) vkGetDeviceProcAddr(shared.device, "vkImportSemaphoreFdKHR");
+
+    if (get_memory_fd == nullptr || get_semaphore_fd == nullptr || import_semaphore_fd == nullptr) {
+        throw std::runtime_error("Failed to load external memory and semaphore functions!");
+    }
+}
+
+void frame_exporter::check_external_handle_support() {
+    VkPhysicalDeviceExternalImageFormatInfo external_image_info{};
+    external_image_info.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_IMAGE_FORMAT_INFO;
+    external_image_info.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT;
+
+    VkPhysicalDeviceImageFormatInfo2 format_info{};
+    format_info.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGE_FORMAT_INFO_2;
+    format_info.pNext = &external_image_info;
+    format_info.format = EXPORT_IMAGE_FORMAT;
+    format_info.type = VK_IMAGE_TYPE_2D;
+    format_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    format_info.usage = EXPORT_IMAGE_USAGE;
+
+    VkExternalImageFormatProperties external_properties{};
+    external_properties.sType = VK_STRUCTURE_TYPE_EXTERNAL_IMAGE_FORMAT_PROPERTIES;
+
+    VkImageFormatProperties2 format_properties{};
+    format_properties.sType = VK_STRUCTURE_TYPE_IMAGE_FORMAT_PROPERTIES_2;
+    format_properties.pNext = &external_properties;
+
+    if (vkGetPhysicalDeviceImageFormatProperties2(shared.physical_device, &format_info, &format_properties) != VK_SUCCESS ||
+            !(external_properties.externalMemoryProperties.externalMemoryFeatures & VK_EXTERNAL_MEMORY_FEATURE_EXPORTABLE_BIT)) {
+        throw std::runtime_error("Device cannot export render targets as opaque fds!");
+    }
+
+    VkPhysicalDeviceExternalSemaphoreInfo semaphore_info{};
+    semaphore_info.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_SEMAPHORE_INFO;
+    semaphore_info.handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT;
+
+    VkExternalSemaphoreProperties semaphore_properties{};
+    semaphore_properties.sType = VK_STRUCTURE_TYPE_EXTERNAL_SEMAPHORE_PROPERTIES;
+    vkGetPhysicalDeviceExternalSemaphoreProperties(shared.physical_device, &semaphore_info, &semaphore_properties);
+
+    VkExternalSemaphoreFeatureFlags sync_fd_features =
+        VK_EXTERNAL_SEMAPHORE_FEATURE_EXPORTABLE_BIT | VK_EXTERNAL_SEMAPHORE_FEATURE_IMPORTABLE_BIT;
+    if ((semaphore_properties.externalSemaphoreFeatures & sync_fd_features) != sync_fd_features) {
+        throw std::runtime_error("Device cannot exchange semaphores as sync files!");
+    }
+}
+
+void frame_exporter::create_command_pool() {
+    VkCommandPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    pool_info.queueFamilyIndex = shared.queue_family;
+
+    if (vkCreateCommandPool(shared.device, &pool_info, nullptr, command_pool.put(shared.device)) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create command pool!");
+    }
+}
+
+void frame_exporter::create_ring() {
+    VkDevice device = shared.device;
+    ring.resize(EXPORT_RING_SIZE);
+
+    for (std::size_t i = 0; i < ring.size(); i++) {
+        ring_image &target = ring[i];
+
+        VkExternalMemoryImageCreateInfo external_info;
+        VkImageCreateInfo image_info = export_image_info(extent.width, extent.height, external_info);
+        if (vkCreateImage(device, &image_info, nullptr, target.image.put(device)) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create exportable image!");
+        }
+
+        VkMemoryRequirements memory_requirements;
+        vkGetImageMemoryRequirements(device, target.image, &memory_requirements);
+
+        // Dedicated allocations are what drivers expect for shared images,
+        // and the consumer has to import them the same way
+        VkMemoryDedicatedAllocateInfo dedicated_info{};
+        dedicated_info.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+        dedicated_info.image = target.image;
+
+        VkExportMemoryAllocateInfo export_info{};
+        export_info.sType = VK_STRUCTURE_TYPE_EXPORT_MEMORY_ALLOCATE_INFO;
+        export_info.pNext = &dedicated_info;
+        export_info.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT;
+
+        VkMemoryAllocateInfo alloc_info{};
+        alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        alloc_info.pNext = &export_info;
+        alloc_info.allocationSize = memory_requirements.size;
+        alloc_info.memoryTypeIndex = find_memory_type(shared.physical_device, memory_requirements.memoryTypeBits,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        // The hello describes every image with the same size and type
+        if (i == 0) {
+            memory_type_index = alloc_info.memoryTypeIndex;
+            allocation_size = alloc_info.allocationSize;
+        } else if (memory_type_index != alloc_info.memoryTypeIndex || allocation_size != alloc_info.allocationSize) {
+            throw std::runtime_error("Exportable images differ in their memory requirements!");
+        }
+
+        if (vkAllocateMemory(device, &alloc_info, nullptr, target.image_memory.put(device)) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate exportable image memory!");
+        }
+        vkBindImageMemory(device, target.image, target.image_memory, 0);
+
+        target.image_view = unique_image_view(device,
+                create_image_view(device, target.image, EXPORT_IMAGE_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT));
+
+        VkImageView attachment = target.image_view;
+        VkFramebufferCreateInfo framebuffer_info{};
+        framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebuffer_info.renderPass = shared.render_pass;
+        framebuffer_info.attachmentCount = 1;
+        framebuffer_info.pAttachments = &attachment;
+        framebuffer_info.width = extent.width;
+        framebuffer_info.height = extent.height;
+        framebuffer_info.layers = 1;
+
+        if (vkCreateFramebuffer(device, &framebuffer_info, nullptr, target.framebuffer.put(device)) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create framebuffer!");
+        }
+
+        VkCommandBufferAllocateInfo command_buffer_info{};
+        command_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        command_buffer_info.commandPool = command_pool;
+        command_buffer_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        command_buffer_info.commandBufferCount = 1;
+
+        if (vkAllocateCommandBuffers(device, &command_buffer_info, &target.command_buffer) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate command buffers!");
+        }
+
+        VkFenceCreateInfo fence_info{};
+        fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+        VkExportSemaphoreCreateInfo export_semaphore_info{};
+        export_semaphore_info.sType = VK_STRUCTURE_TYPE_EXPORT_SEMAPHORE_CREATE_INFO;
+        export_semaphore_info.handleTypes = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT;
+
+        VkSemaphoreCreateInfo exported_semaphore_info{};
+        exported_semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        exported_semaphore_info.pNext = &export_semaphore_info;
+
+        VkSemaphoreCreateInfo semaphore_info{};
+        semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+        if (vkCreateFence(device, &fence_info, nullptr, target.fence.put(device)) != VK_SUCCESS ||
+                vkCreateSemaphore(device, &exported_semaphore_info, nullptr, target.rendered_semaphore.put(device)) != VK_SUCCESS ||
+                vkCreateSemaphore(device, &semaphore_info, nullptr, target.released_semaphore.put(device)) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create synchronization objects for the export ring!");
+        }
+    }
+}
+
+void frame_exporter::open_socket(const std::string &socket_path) {
+    this->socket_path = socket_path;
+
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Export socket path is too long!");
+    }
+    std::strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+
+    // Sequenced packets keep each message and its descriptors together
+    listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        throw std::runtime_error("Failed to create export socket!");
+    }
+
+    // A socket file left behind by an earlier run would make bind() fail
+    unlink(socket_path.c_str());
+    if (bind(listen_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(listen_fd, 1) != 0) {
+        close(listen_fd);
+        listen_fd = -1;
+        throw std::runtime_error("Failed to listen on export socket " + socket_path + "!");
+    }
+}
+
+void frame_exporter::accept_consumer() {
+    std::cout << "Waiting for a consumer on " << socket_path << std::endl;
+
+    consumer_fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (consumer_fd < 0) {
+        throw std::runtime_error("Failed to accept a consumer!");
+    }
+    consumer_connected = true;
+}
+
+void frame_exporter::send_hello() {
+    VkPhysicalDeviceIDProperties id_properties{};
+    id_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+
+    VkPhysicalDeviceProperties2 properties{};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties.pNext = &id_properties;
+    vkGetPhysicalDeviceProperties2(shared.physical_device, &properties);
+
+    export_hello hello;
+    hello.width = extent.width;
+    hello.height = extent.height;
+    hello.image_count = ring.size();
+    hello.memory_type_index = memory_type_index;
+    hello.allocation_size = allocation_size;
+    std::memcpy(hello.device_uuid, id_properties.deviceUUID, VK_UUID_SIZE);
+    std::memcpy(hello.driver_uuid, id_properties.driverUUID, VK_UUID_SIZE);
+
+    // Every call exports a new descriptor; ours are closed once the
+    // consumer has its copies
+    std::vector<int> memory_fds;
+    for (auto &target : ring) {
+        VkMemoryGetFdInfoKHR get_info{};
+        get_info.sType = VK_STRUCTURE_TYPE_MEMORY_GET_FD_INFO_KHR;
+        get_info.memory = target.image_memory;
+        get_info.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT;
+
+        int fd;
+        if (get_memory_fd(shared.device, &get_info, &fd) != VK_SUCCESS) {
+            for (int exported_fd : memory_fds) {
+                close(exported_fd);
+            }
+            throw std::runtime_error("Failed to export image memory!");
+        }
+        memory_fds.push_back(fd);
+    }
+
+    try {
+        send_export_message(consumer_fd, &hello, sizeof(hello), memory_fds);
+    } catch (...) {
+        for (int fd : memory_fds) {
+            close(fd);
+        }
+        throw;
+    }
+    for (int fd : memory_fds) {
+        close(fd);
+    }
+}
+
+bool frame_exporter::receive_release(bool wait) {
+    export_release release;
+    std::vector<int> fds;
+    ssize_t size = receive_export_message(consumer_fd, &release, sizeof(release), fds, wait);
+    if (size < 0) {
+        return false;
+    }
+    if (size == 0) {
+        consumer_connected = false;
+        return false;
+    }
+
+    if (size != sizeof(release) || release.type != EXPORT_MESSAGE_RELEASE || release.image_index >= ring.size() ||
+            !ring[release.image_index].with_consumer || fds.size() > 1) {
+        for (int fd : fds) {
+            close(fd);
+        }
+        throw std::runtime_error("Consumer sent an invalid release!");
+    }
+
+    ring_image &target = ring[release.image_index];
+    target.with_consumer = false;
+
+    // A release without a sync file means the consumer is already done
+    if (!fds.empty()) {
+        VkImportSemaphoreFdInfoKHR import_info{};
+        import_info.sType = VK_STRUCTURE_TYPE_IMPORT_SEMAPHORE_FD_INFO_KHR;
+        import_info.semaphore = target.released_semaphore;
+        import_info.flags = VK_SEMAPHORE_IMPORT_TEMPORARY_BIT;
+        import_info.handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT;
+        import_info.fd = fds[0];
+
+        // On success the semaphore owns the descriptor
+        if (import_semaphore_fd(shared.device, &import_info) != VK_SUCCESS) {
+            close(fds[0]);
+            throw std::runtime_error("Failed to import the consumer's release sync file!");
+        }
+        target.release_pending = true;
+    }
+
+    return true;
+}
+
+void frame_exporter::render_frame(std::uint32_t image_index, std::uint64_t frame_number) {
+    ring_image &target = ring[image_index];
+
+    VkFence fence = target.fence;
+    vkWaitForFences(shared.device, 1, &fence, VK_TRUE, std::numeric_limits<std::uint64_t>::max());
+    vkResetFences(shared.device, 1, &fence);
+
+    vkResetCommandBuffer(target.command_buffer, 0);
+    record_command_buffer(target, frame_number);
+
+    VkSemaphore wait_semaphore = target.released_semaphore;
+    VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    VkSemaphore signal_semaphore = target.rendered_semaphore;
+
+    VkSubmitInfo submit_info{};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    if (target.release_pending) {
+        submit_info.waitSemaphoreCount = 1;
+        submit_info.pWaitSemaphores = &wait_semaphore;
+        submit_info.pWaitDstStageMask = &wait_stage;
+    }
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &target.command_buffer;
+    submit_info.signalSemaphoreCount = 1;
+    submit_info.pSignalSemaphores = &signal_semaphore;
+
+    {
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        if (vkQueueSubmit(queue->queue, 1, &submit_info, fence) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to submit draw command buffer!");
+        }
+    }
+    target.release_pending = false;
+
+    // Exporting a sync file takes the pending signal with it and leaves the
+    // semaphore unsignalled, ready for the image's next frame
+    VkSemaphoreGetFdInfoKHR get_info{};
+    get_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_GET_FD_INFO_KHR;
+    get_info.semaphore = target.rendered_semaphore;
+    get_info.handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT;
+
+    int sync_fd;
+    if (get_semaphore_fd(shared.device, &get_info, &sync_fd) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to export the frame's sync file!");
+    }
+
+    export_frame frame;
+    frame.image_index = image_index;
+    frame.frame_number = frame_number;
+
+    try {
+        send_export_message(consumer_fd, &frame, sizeof(frame), { sync_fd });
+    } catch (const std::runtime_error &) {
+        // Most likely the consumer went away between two frames
+        consumer_connected = false;
+    }
+    close(sync_fd);
+    target.with_consumer = consumer_connected;
+}
+
+void frame_exporter::record_command_buffer(ring_image &target, std::uint64_t frame_number) {
+    VkCommandBuffer command_buffer = target.command_buffer;
+
+    VkCommandBufferBeginInfo begin_info{};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to begin recording command buffer!");
+    }
+
+    // The render pass starts from an undefined layout and clears, so the
+    // consumer's last contents are discarded and the image needs no acquire
+    // barrier from the external queue family
+    VkRenderPassBeginInfo render_pass_info{};
+    render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    render_pass_info.renderPass = shared.render_pass;
+    render_pass_info.framebuffer = target.framebuffer;
+    render_pass_info.renderArea.offset = { 0, 0 };
+    render_pass_info.renderArea.extent = extent;
+    VkClearValue clear_color = { { { 0.0f, 0.0f, 0.0f, 1.0f } } };
+    render_pass_info.clearValueCount = 1;
+    render_pass_info.pClearValues = &clear_color;
+
+    vkCmdBeginRenderPass(command_buffer, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
+
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shared.graphics_pipeline);
+
+    VkViewport viewport{};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = static_cast<float>(extent.width);
+    viewport.height = static_cast<float>(extent.height);
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+
+    VkRect2D scissor{};
+    scissor.offset = { 0, 0 };
+    scissor.extent = extent;
+    vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+
+    // One turn every two seconds at 60 frames per second
+    scene_transform transform{};
+    transform.rotation = static_cast<float>(frame_number % 120) * static_cast<float>(2.0 * M_PI / 120.0);
+    vkCmdPushConstants(command_buffer, shared.pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(transform), &transform);
+
+    vkCmdDraw(command_buffer, 3, 1, 0, 0);
+
+    vkCmdEndRenderPass(command_buffer);
+
+    // Hand the image over in the layout the protocol promises
+    VkImageMemoryBarrier release_barrier{};
+    release_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    release_barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    release_barrier.dstAccessMask = 0;
+    release_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    release_barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    release_barrier.srcQueueFamilyIndex = shared.queue_family;
+    release_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_EXTERNAL;
+    release_barrier.image = target.image;
+    release_barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    release_barrier.subresourceRange.baseMipLevel = 0;
+    release_barrier.subresourceRange.levelCount = 1;
+    release_barrier.subresourceRange.baseArrayLayer = 0;
+    release_barrier.subresourceRange.layerCount = 1;
+
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+            0, 0, nullptr, 0, nullptr, 1, &release_barrier);
+
+    if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to record command buffer!");
+    }
+}
@@ -0,0 +1,588 @@
+#include "headless_renderer.h"
+#include "config.h"
+#include "vulkan_utils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const char *PIPELINE_CACHE_FILE = "pipeline_cache.bin";
+
+void headless_device::init(std::uint32_t requested_queue_count, const std::vector<const char *> &extensions) {
+    create_instance();
+    pick_physical_device();
+    create_logical_device(requested_queue_count, extensions);
+    pipeline_cache = load_pipeline_cache(device, PIPELINE_CACHE_FILE);
+    create_shader_modules();
+    create_render_pass();
+    create_graphics_pipeline();
+}
+
+void headless_device::create_instance() {
+    bool use_validation_layers = enable_validation_layers && check_validation_layer_support();
+
+    VkApplicationInfo app_info{};
+    app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+    app_info.pApplicationName = "Vulkan triangle (headless)";
+    app_info.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
+    app_info.pEngineName = "No engine";
+    app_info.engineVersion = VK_MAKE_VERSION(1, 0, 0);
+    app_info.apiVersion = VK_API_VERSION_1_2;
+
+    // No surface, so no window system extensions are needed
+    VkInstanceCreateInfo create_info{};
+    create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    create_info.pApplicationInfo = &app_info;
+    create_info.enabledExtensionCount = 0;
+    create_info.ppEnabledExtensionNames = nullptr;
+    create_info.enabledLayerCount = 0;
+
+    if (use_validation_layers) {
+        create_info.enabledLayerCount = validation_layers.size();
+        create_info.ppEnabledLayerNames = validation_layers.data();
+    }
+
+    VkResult result = vkCreateInstance(&create_info, nullptr, &instance);
+    if (result == VK_ERROR_INCOMPATIBLE_DRIVER) {
+        throw no_vulkan_device_error("Failed to find a Vulkan implementation!");
+    } else if (result != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create instance!");
+    }
+}
+
+void headless_device::pick_physical_device() {
+    std::uint32_t device_count = 0;
+    vkEnumeratePhysicalDevices(instance, &device_count, nullptr);
+
+    if (device_count == 0) {
+        vkDestroyInstance(instance, nullptr);
+        throw no_vulkan_device_error("Failed to find GPUs with Vulkan support!");
+    }
+
+    std::vector<VkPhysicalDevice> devices(device_count);
+    vkEnumeratePhysicalDevices(instance, &device_count, devices.data());
+
+    for (const auto &candidate : devices) {
+        std::uint32_t queue_family_count = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(candidate, &queue_family_count, nullptr);
+
+        std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
+        vkGetPhysicalDeviceQueueFamilyProperties(candidate, &queue_family_count, queue_families.data());
+
+        for (std::uint32_t i = 0; i < queue_family_count; i++) {
+            if (queue_families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+                physical_device = candidate;
+                queue_family = i;
+                break;
+            }
+        }
+
+        if (physical_device != VK_NULL_HANDLE) {
+            break;
+        }
+    }
+
+    if (physical_device == VK_NULL_HANDLE) {
+        throw std::runtime_error("Failed to find a suitable GPU!");
+    }
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+    std::cout << "Headless rendering on " << properties.deviceName << std::endl;
+}
+
+void headless_device::create_logical_device(std::uint32_t requested_queue_count, const std::vector<const char *> &extensions) {
+    std::uint32_t queue_family_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, nullptr);
+
+    std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, queue_families.data());
+
+    // One queue per context where the family allows it, otherwise contexts
+    // are spread round-robin over the queues there are
+    std::uint32_t count = std::clamp(requested_queue_count, 1u, queue_families[queue_family].queueCount);
+    std::vector<float> queue_priorities(count, 1.0f);
+
+    VkDeviceQueueCreateInfo queue_create_info{};
+    queue_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queue_create_info.queueFamilyIndex = queue_family;
+    queue_create_info.queueCount = count;
+    queue_create_info.pQueuePriorities = queue_priorities.data();
+
+    std::uint32_t extension_count;
+    vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &extension_count, nullptr);
+
+    std::vector<VkExtensionProperties> available_extensions(extension_count);
+    vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &extension_count, available_extensions.data());
+
+    for (const char *extension : extensions) {
+        bool found = std::any_of(available_extensions.begin(), available_extensions.end(),
+                [extension](const VkExtensionProperties &properties) { return std::strcmp(properties.extensionName, extension) == 0; });
+        if (!found) {
+            throw std::runtime_error(std::string("Device does not support ") + extension + "!");
+        }
+    }
+
+    VkPhysicalDeviceFeatures device_features{};
+
+    VkDeviceCreateInfo create_info{};
+    create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    create_info.queueCreateInfoCount = 1;
+    create_info.pQueueCreateInfos = &queue_create_info;
+    create_info.pEnabledFeatures = &device_features;
+    create_info.enabledExtensionCount = extensions.size();
+    create_info.ppEnabledExtensionNames = extensions.data();
+    create_info.enabledLayerCount = 0;
+
+    if (vkCreateDevice(physical_device, &create_info, nullptr, &device) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create logical device!");
+    }
+
+    queues.clear();
+    for (std::uint32_t i = 0; i < count; i++) {
+        auto queue = std::make_unique<shared_queue>();
+        vkGetDeviceQueue(device, queue_family, i, &queue->queue);
+        queues.push_back(std::move(queue));
+    }
+}
+
+shared_queue &headless_device::queue_for_context(std::uint32_t context_index) {
+    return *queues[context_index % queues.size()];
+}
+
+std::uint32_t headless_device::queue_count() const {
+    return queues.size();
+}
+
+void headless_device::create_shader_modules() {
+    vert_shader_module = create_shader_module(device, read_file("scene.vert.spv"));
+    frag_shader_module = create_shader_module(device, read_file("shader.frag.spv"));
+}
+
+void headless_device::create_render_pass() {
+    VkAttachmentDescription color_attachment{};
+    color_attachment.format = color_format;
+    color_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    color_attachment.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+    VkAttachmentReference color_attachment_ref{};
+    color_attachment_ref.attachment = 0;
+    color_attachment_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    VkSubpassDescription subpass{};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = 1;
+    subpass.pColorAttachments = &color_attachment_ref;
+
+    VkSubpassDependency dependencies[2]{};
+    // Whatever read the target last time round must be done with it
+    dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[0].dstSubpass = 0;
+    dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+    dependencies[0].srcAccessMask = 0;
+    dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+    // Rendered images are read back with transfers
+    dependencies[1].srcSubpass = 0;
+    dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    dependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+    VkRenderPassCreateInfo render_pass_info{};
+    render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    render_pass_info.attachmentCount = 1;
+    render_pass_info.pAttachments = &color_attachment;
+    render_pass_info.subpassCount = 1;
+    render_pass_info.pSubpasses = &subpass;
+    render_pass_info.dependencyCount = 2;
+    render_pass_info.pDependencies = dependencies;
+
+    if (vkCreateRenderPass(device, &render_pass_info, nullptr, &render_pass) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create render pass!");
+    }
+}
+
+void headless_device::create_graphics_pipeline() {
+    VkPipelineShaderStageCreateInfo vert_shader_stage_info{};
+    vert_shader_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    vert_shader_stage_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
+    vert_shader_stage_info.module = vert_shader_module;
+    vert_shader_stage_info.pName = "main";
+
+    VkPipelineShaderStageCreateInfo frag_shader_stage_info{};
+    frag_shader_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    frag_shader_stage_info.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    frag_shader_stage_info.module = frag_shader_module;
+    frag_shader_stage_info.pName = "main";
+
+    VkPipelineShaderStageCreateInfo shader_stages[] = {
+        vert_shader_stage_info, frag_shader_stage_info
+    };
+
+    std::vector<VkDynamicState> dynamic_states = {
+        VK_DYNAMIC_STATE_VIEWPORT,
+        VK_DYNAMIC_STATE_SCISSOR
+    };
+
+    VkPipelineDynamicStateCreateInfo dynamic_state{};
+    dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamic_state.dynamicStateCount = dynamic_states.size();
+    dynamic_state.pDynamicStates = dynamic_states.data();
+
+    VkPipelineVertexInputStateCreateInfo vertex_input_info{};
+    vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+    VkPipelineInputAssemblyStateCreateInfo input_assembly{};
+    input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    input_assembly.primitiveRestartEnable = VK_FALSE;
+
+    VkPipelineViewportStateCreateInfo viewport_state{};
+    viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewport_state.viewportCount = 1;
+    viewport_state.scissorCount = 1;
+
+    VkPipelineRasterizationStateCreateInfo rasterizer{};
+    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.depthClampEnable = VK_FALSE;
+    rasterizer.rasterizerDiscardEnable = VK_FALSE;
+    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizer.lineWidth = 1.0f;
+    rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+    rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
+    rasterizer.depthBiasEnable = VK_FALSE;
+
+    VkPipelineMultisampleStateCreateInfo multisampling{};
+    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.sampleShadingEnable = VK_FALSE;
+    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+    multisampling.minSampleShading = 1.0f;
+
+    VkPipelineColorBlendAttachmentState color_blend_attachment{};
+    color_blend_attachment.colorWriteMask =
+        VK_COLOR_COMPONENT_R_BIT |
+        VK_COLOR_COMPONENT_G_BIT |
+        VK_COLOR_COMPONENT_B_BIT |
+        VK_COLOR_COMPONENT_A_BIT;
+    color_blend_attachment.blendEnable = VK_FALSE;
+
+    VkPipelineColorBlendStateCreateInfo color_blending{};
+    color_blending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    color_blending.logicOpEnable = VK_FALSE;
+    color_blending.logicOp = VK_LOGIC_OP_COPY;
+    color_blending.attachmentCount = 1;
+    color_blending.pAttachments = &color_blend_attachment;
+
+    VkPipelineLayoutCreateInfo pipeline_layout_info{};
+    pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    VkPushConstantRange push_constant_range{};
+    push_constant_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    push_constant_range.offset = 0;
+    push_constant_range.size = sizeof(scene_transform);
+
+    pipeline_layout_info.setLayoutCount = 0;
+    pipeline_layout_info.pushConstantRangeCount = 1;
+    pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+
+    if (vkCreatePipelineLayout(device, &pipeline_layout_info, nullptr, &pipeline_layout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create pipeline layout!");
+    }
+
+    VkGraphicsPipelineCreateInfo pipeline_info{};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipeline_info.stageCount = 2;
+    pipeline_info.pStages = shader_stages;
+    pipeline_info.pVertexInputState = &vertex_input_info;
+    pipeline_info.pInputAssemblyState = &input_assembly;
+    pipeline_info.pViewportState = &viewport_state;
+    pipeline_info.pRasterizationState = &rasterizer;
+    pipeline_info.pMultisampleState = &multisampling;
+    pipeline_info.pDepthStencilState = nullptr;
+    pipeline_info.pColorBlendState = &color_blending;
+    pipeline_info.pDynamicState = &dynamic_state;
+    pipeline_info.layout = pipeline_layout;
+    pipeline_info.renderPass = render_pass;
+    pipeline_info.subpass = 0;
+    pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
+    pipeline_info.basePipelineIndex = -1;
+
+    if (vkCreateGraphicsPipelines(device, pipeline_cache, 1, &pipeline_info, nullptr, &graphics_pipeline) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create graphics pipeline!");
+    }
+}
+
+void headless_device::cleanup() {
+    save_pipeline_cache(device, pipeline_cache, PIPELINE_CACHE_FILE);
+
+    vkDestroyPipeline(device, graphics_pipeline, nullptr);
+    vkDestroyPipelineLayout(device, pipeline_layout, nullptr);
+    vkDestroyRenderPass(device, render_pass, nullptr);
+    vkDestroyShaderModule(device, frag_shader_module, nullptr);
+    vkDestroyShaderModule(device, vert_shader_module, nullptr);
+    vkDestroyPipelineCache(device, pipeline_cache, nullptr);
+    vkDestroyDevice(device, nullptr);
+    vkDestroyInstance(instance, nullptr);
+    queues.clear();
+}
+
+void render_context::init(headless_device &shared_device, std::uint32_t context_index, VkExtent2D render_extent) {
+    shared = &shared_device;
+    queue = &shared_device.queue_for_context(context_index);
+    extent = render_extent;
+
+    create_command_pool();
+    create_command_buffers();
+    create_sync_objects();
+    create_offscreen_targets();
+}
+
+void render_context::create_command_pool() {
+    VkCommandPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    pool_info.queueFamilyIndex = shared->queue_family;
+
+    if (vkCreateCommandPool(shared->device, &pool_info, nullptr, &command_pool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create command pool!");
+    }
+}
+
+void render_context::create_command_buffers() {
+    command_buffers.resize(MAX_FRAMES_IN_FLIGHT);
+
+    VkCommandBufferAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    alloc_info.commandPool = command_pool;
+    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    alloc_info.commandBufferCount = command_buffers.size();
+
+    if (vkAllocateCommandBuffers(shared->device, &alloc_info, command_buffers.data()) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate command buffers!");
+    }
+}
+
+void render_context::create_sync_objects() {
+    in_flight_fences.resize(MAX_FRAMES_IN_FLIGHT);
+
+    VkFenceCreateInfo fence_info{};
+    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        if (vkCreateFence(shared->device, &fence_info, nullptr, &in_flight_fences[i]) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create sync objects!");
+        }
+    }
+}
+
+void render_context::create_offscreen_targets() {
+    offscreen_images.resize(MAX_FRAMES_IN_FLIGHT);
+    offscreen_image_memories.resize(MAX_FRAMES_IN_FLIGHT);
+    offscreen_image_views.resize(MAX_FRAMES_IN_FLIGHT);
+    offscreen_framebuffers.resize(MAX_FRAMES_IN_FLIGHT);
+
+    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        create_image(shared->physical_device, shared->device, extent.width, extent.height, VK_SAMPLE_COUNT_1_BIT,
+                shared->color_format, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, offscreen_images[i], offscreen_image_memories[i]);
+        offscreen_image_views[i] = create_image_view(shared->device, offscreen_images[i], shared->color_format, VK_IMAGE_ASPECT_COLOR_BIT);
+
+        VkFramebufferCreateInfo framebuffer_info{};
+        framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebuffer_info.renderPass = shared->render_pass;
+        framebuffer_info.attachmentCount = 1;
+        framebuffer_info.pAttachments = &offscreen_image_views[i];
+        framebuffer_info.width = extent.width;
+        framebuffer_info.height = extent.height;
+        framebuffer_info.layers = 1;
+
+        if (vkCreateFramebuffer(shared->device, &framebuffer_info, nullptr, &offscreen_framebuffers[i]) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create framebuffer!");
+        }
+    }
+}
+
+void render_context::record_command_buffer(VkCommandBuffer command_buffer) {
+    VkCommandBufferBeginInfo begin_info{};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to begin recording command buffer!");
+    }
+
+    VkRenderPassBeginInfo render_pass_info{};
+    render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    render_pass_info.renderPass = shared->render_pass;
+    render_pass_info.framebuffer = offscreen_framebuffers[current_frame];
+    render_pass_info.renderArea.offset = { 0, 0 };
+    render_pass_info.renderArea.extent = extent;
+    VkClearValue clear_color = { { { 0.0f, 0.0f, 0.0f, 1.0f } } };
+    render_pass_info.clearValueCount = 1;
+    render_pass_info.pClearValues = &clear_color;
+
+    vkCmdBeginRenderPass(command_buffer, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
+
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shared->graphics_pipeline);
+
+    VkViewport viewport{};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = static_cast<float>(extent.width);
+    viewport.height = static_cast<float>(extent.height);
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+
+    VkRect2D scissor{};
+    scissor.offset = { 0, 0 };
+    scissor.extent = extent;
+    vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+
+    scene_transform transform{};
+    vkCmdPushConstants(command_buffer, shared->pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(transform), &transform);
+
+    vkCmdDraw(command_buffer, 3, 1, 0, 0);
+
+    vkCmdEndRenderPass(command_buffer);
+
+    if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to record command buffer!");
+    }
+}
+
+void render_context::draw_frame() {
+    vkWaitForFences(shared->device, 1, &in_flight_fences[current_frame], VK_TRUE, std::numeric_limits<std::uint64_t>::max());
+    vkResetFences(shared->device, 1, &in_flight_fences[current_frame]);
+
+    vkResetCommandBuffer(command_buffers[current_frame], 0);
+    record_command_buffer(command_buffers[current_frame]);
+
+    VkSubmitInfo submit_info{};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &command_buffers[current_frame];
+
+    {
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        if (vkQueueSubmit(queue->queue, 1, &submit_info, in_flight_fences[current_frame]) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to submit draw command buffer!");
+        }
+    }
+
+    current_frame = (current_frame + 1) % MAX_FRAMES_IN_FLIGHT;
+}
+
+void render_context::render_frames(std::uint32_t frame_count, std::vector<double> *frame_times_ms) {
+    for (std::uint32_t i = 0; i < frame_count; i++) {
+        auto start = std::chrono::steady_clock::now();
+        draw_frame();
+        if (frame_times_ms) {
+            frame_times_ms->push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+    }
+    wait_idle();
+}
+
+void render_context::wait_idle() {
+    vkWaitForFences(shared->device, in_flight_fences.size(), in_flight_fences.data(), VK_TRUE, std::numeric_limits<std::uint64_t>::max());
+}
+
+void render_context::cleanup() {
+    wait_idle();
+
+    for (size_t i = 0; i < offscreen_images.size(); i++) {
+        vkDestroyFramebuffer(shared->device, offscreen_framebuffers[i], nullptr);
+        vkDestroyImageView(shared->device, offscreen_image_views[i], nullptr);
+        vkDestroyImage(shared->device, offscreen_images[i], nullptr);
+        vkFreeMemory(shared->device, offscreen_image_memories[i], nullptr);
+    }
+    for (auto fence : in_flight_fences) {
+        vkDestroyFence(shared->device, fence, nullptr);
+    }
+    vkDestroyCommandPool(shared->device, command_pool, nullptr);
+}
+
+void headless_benchmark::run(std::uint32_t max_contexts, std::uint32_t frames_per_context, VkExtent2D render_extent) {
+    shared.init(max_contexts);
+
+    std::cout << "Rendering " << frames_per_context << " frames of " << render_extent.width << "x" << render_extent.height
+        << " per context on " << shared.queue_count() << " queue(s)" << std::endl;
+    if (shared.queue_count() < max_contexts) {
+        std::cout << "The queue family has fewer queues than contexts; contexts sharing a queue serialize their "
+            "submissions" << std::endl;
+    }
+    std::cout << std::setw(10) << "contexts" << std::setw(8) << "queues" << std::setw(14) << "frames/s"
+        << std::setw(22) << "frames/s per context" << std::setw(10) << "scaling" << std::endl;
+
+    double single_context_fps = 0.0;
+    for (std::uint32_t count = 1; count <= max_contexts; count = (count == max_contexts) ? count + 1 : std::min(count * 2, max_contexts)) {
+        double fps = measure(count, frames_per_context, render_extent);
+        if (count == 1) {
+            single_context_fps = fps;
+        }
+
+        std::cout << std::fixed << std::setprecision(1)
+            << std::setw(10) << count << std::setw(8) << std::min(count, shared.queue_count())
+            << std::setw(14) << fps << std::setw(22) << fps / count
+            << std::setw(9) << fps / single_context_fps << "x" << std::endl;
+    }
+
+    shared.cleanup();
+}
+
+double headless_benchmark::measure(std::uint32_t context_count, std::uint32_t frames_per_context, VkExtent2D render_extent) {
+    std::vector<render_context> contexts(context_count);
+    for (std::uint32_t i = 0; i < context_count; i++) {
+        contexts[i].init(shared, i, render_extent);
+        // Warm up outside the timed region
+        contexts[i].render_frames(MAX_FRAMES_IN_FLIGHT);
+    }
+
+    std::vector<std::exception_ptr> errors(context_count);
+    std::vector<std::thread> threads;
+
+    auto start = std::chrono::steady_clock::now();
+    for (std::uint32_t i = 0; i < context_count; i++) {
+        threads.emplace_back([&, i]() {
+            try {
+                contexts[i].render_frames(frames_per_context);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    for (auto &context : contexts) {
+        context.cleanup();
+    }
+    for (auto &error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    return static_cast<double>(context_count) * frames_per_context / seconds;
+}
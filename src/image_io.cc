@@ -0,0 +1,102 @@
+#include "image_io.h"
+
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+void write_ppm(const std::string &filename, std::uint32_t width, std::uint32_t height, const std::uint8_t *rgba) {
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open file " + filename + "!");
+    }
+
+    file << "P6\n" << width << " " << height << "\n255\n";
+
+    std::vector<std::uint8_t> row(static_cast<size_t>(width) * 3);
+    for (std::uint32_t y = 0; y < height; y++) {
+        const std::uint8_t *source = rgba + static_cast<size_t>(y) * width * 4;
+        for (std::uint32_t x = 0; x < width; x++) {
+            row[x * 3 + 0] = source[x * 4 + 0];
+            row[x * 3 + 1] = source[x * 4 + 1];
+            row[x * 3 + 2] = source[x * 4 + 2];
+        }
+        file.write(reinterpret_cast<const char *>(row.data()), row.size());
+    }
+
+    if (!file) {
+        throw std::runtime_error("Failed to write file " + filename + "!");
+    }
+}
+
+// Reads one header field, skipping the whitespace and comments before it
+static std::uint32_t read_ppm_field(const std::uint8_t *data, std::size_t size, std::size_t &position) {
+    while (position < size) {
+        if (data[position] == '#') {
+            while (position < size && data[position] != '\n') {
+                position++;
+            }
+        } else if (std::isspace(data[position])) {
+            position++;
+        } else {
+            break;
+        }
+    }
+
+    std::uint64_t value = 0;
+    std::size_t digits = 0;
+    while (position < size && std::isdigit(data[position]) && digits < 10) {
+        value = value * 10 + (data[position] - '0');
+        position++;
+        digits++;
+    }
+
+    if (digits == 0 || value == 0 || value > UINT32_MAX) {
+        throw std::runtime_error("Invalid PPM header!");
+    }
+
+    return static_cast<std::uint32_t>(value);
+}
+
+ppm_header parse_ppm_header(const std::uint8_t *data, std::size_t size) {
+    if (size < 2 || data[0] != 'P' || data[1] != '6') {
+        throw std::runtime_error("Not a binary PPM file!");
+    }
+
+    std::size_t position = 2;
+    ppm_header header;
+    header.width = read_ppm_field(data, size, position);
+    header.height = read_ppm_field(data, size, position);
+    std::uint32_t max_value = read_ppm_field(data, size, position);
+    if (max_value != 255) {
+        throw std::runtime_error("Only PPM files with 8-bit samples are supported!");
+    }
+
+    // Exactly one whitespace character separates the header from the pixels
+    if (position >= size || !std::isspace(data[position])) {
+        throw std::runtime_error("Invalid PPM header!");
+    }
+    header.pixel_offset = position + 1;
+
+    std::uint64_t pixel_bytes = static_cast<std::uint64_t>(header.width) * header.height * 3;
+    if (pixel_bytes > size - header.pixel_offset) {
+        throw std::runtime_error("PPM file is truncated!");
+    }
+
+    return header;
+}
+
+void decode_ppm(const std::uint8_t *data, const ppm_header &header, std::uint8_t *rgba) {
+    const std::uint8_t *source = data + header.pixel_offset;
+    std::size_t pixel_count = static_cast<std::size_t>(header.width) * header.height;
+    for (std::size_t i = 0; i < pixel_count; i++) {
+        rgba[i * 4 + 0] = source[i * 3 + 0];
+        rgba[i * 4 + 1] = source[i * 3 + 1];
+        rgba[i * 4 + 2] = source[i * 3 + 2];
+        rgba[i * 4 + 3] = 255;
+    }
+}
@@ -1,13 +1,66 @@
 #include "triangle_application.h"
+#include "batch_renderer.h"
+#include "config.h"
+#include "cpu_rasterizer.h"
+#include "frame_exporter.h"
+#include "headless_renderer.h"
+#include "image_io.h"
+#include "options.h"
+#include "perf_gate.h"
+#include "rasterizer_check.h"
+#include "vulkan_utils.h"
+#include <cstdint>
 #include <cstdlib>
 #include <exception>
 #include <iostream>
+#include <vector>
 
-int main() {
-    triangle_application app;
+// Without Vulkan there is no window surface to present to, so the frame the
+// window would have shown is written to a file
+static void render_on_cpu(std::uint32_t width, std::uint32_t height) {
+    cpu_rasterizer rasterizer;
+    std::vector<std::uint8_t> pixels;
+    const float clear_color[3] = { 0.0f, 0.0f, 0.0f };
 
+    rasterizer.render(scene_transform{}, clear_color, width, height, pixels);
+    write_ppm(CPU_FALLBACK_OUTPUT, width, height, pixels.data());
+
+    std::cout << "Rendered " << width << "x" << height << " on the CPU (" << rasterizer.kernel_name() << ") to "
+        << CPU_FALLBACK_OUTPUT << std::endl;
+}
+
+int main(int argc, char **argv) {
     try {
-        app.run();
+        options opts = parse_options(argc, argv);
+
+        if (opts.show_help) {
+            print_usage(argv[0]);
+        } else if (opts.cpu_check) {
+            run_rasterizer_check(opts.frames, { opts.width, opts.height });
+        } else if (opts.batch) {
+            batch_renderer renderer;
+            renderer.run(opts.batch_socket, opts.use_cpu);
+        } else if (opts.bench_contexts > 0) {
+            headless_benchmark benchmark;
+            benchmark.run(opts.bench_contexts, opts.frames, { opts.width, opts.height });
+        } else if (!opts.perf_record.empty()) {
+            record_perf_baseline(opts.perf_record, opts.perf_runs, opts.frames, { opts.width, opts.height });
+        } else if (!opts.perf_check.empty()) {
+            run_perf_check(opts.perf_check, opts.perf_runs);
+        } else if (!opts.export_socket.empty()) {
+            frame_exporter exporter;
+            exporter.run(opts.export_socket, opts.frames, { opts.width, opts.height });
+        } else if (opts.use_cpu) {
+            render_on_cpu(opts.width, opts.height);
+        } else {
+            try {
+                triangle_application app(opts);
+                app.run();
+            } catch (const no_vulkan_device_error &e) {
+                std::cerr << e.what() << " Rendering on the CPU instead." << std::endl;
+                render_on_cpu(opts.width, opts.height);
+            }
+        }
     } catch (const std::exception &e) {
         std::cerr << e.what() << std::endl;
         return EXIT_FAILURE;
@@ -0,0 +1,46 @@
+#include "mapped_file.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+mapped_file::mapped_file(const std::string &filename) {
+    int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open file " + filename + "!");
+    }
+
+    struct stat status;
+    if (fstat(fd, &status) != 0) {
+        close(fd);
+        throw std::runtime_error("Failed to read the size of " + filename + "!");
+    }
+    length = static_cast<std::size_t>(status.st_size);
+
+    // mmap rejects empty mappings; an empty file simply has no data
+    if (length > 0) {
+        void *mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("Failed to map file " + filename + "!");
+        }
+        // Files are read front to back exactly once
+        madvise(mapping, length, MADV_SEQUENTIAL);
+        bytes = static_cast<const std::uint8_t *>(mapping);
+    }
+
+    // The mapping keeps the file referenced
+    close(fd);
+}
+
+mapped_file::~mapped_file() {
+    if (bytes != nullptr) {
+        munmap(const_cast<std::uint8_t *>(bytes), length);
+    }
+}
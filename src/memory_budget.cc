@@ -0,0 +1,76 @@
+#include "memory_budget.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+void memory_budget::init(VkPhysicalDevice physical_device, bool budget_extension_enabled, VkDeviceSize budget_limit) {
+    this->physical_device = physical_device;
+    this->budget_extension_enabled = budget_extension_enabled;
+    this->budget_limit = budget_limit;
+    update();
+}
+
+void memory_budget::update() {
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budget_properties{};
+    budget_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+    VkPhysicalDeviceMemoryProperties2 memory_properties{};
+    memory_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    if (budget_extension_enabled) {
+        memory_properties.pNext = &budget_properties;
+    }
+    vkGetPhysicalDeviceMemoryProperties2(physical_device, &memory_properties);
+
+    const VkPhysicalDeviceMemoryProperties &properties = memory_properties.memoryProperties;
+    heap_usages.resize(properties.memoryHeapCount);
+    for (std::uint32_t i = 0; i < properties.memoryHeapCount; i++) {
+        memory_heap_usage &heap = heap_usages[i];
+        heap.size = properties.memoryHeaps[i].size;
+        heap.device_local = (properties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+
+        if (budget_extension_enabled) {
+            heap.budget = budget_properties.heapBudget[i];
+            heap.usage = budget_properties.heapUsage[i];
+        } else {
+            heap.budget = heap.size;
+            heap.usage = heap.device_local ? estimated_usage : 0;
+        }
+
+        if (budget_limit != 0 && heap.device_local) {
+            heap.budget = std::min(heap.budget, budget_limit);
+        }
+    }
+}
+
+double memory_budget::device_local_pressure(VkDeviceSize extra_usage) const {
+    if (!tracks_usage()) {
+        return 0.0;
+    }
+
+    double pressure = 0.0;
+    for (const auto &heap : heap_usages) {
+        if (heap.device_local && heap.budget > 0) {
+            pressure = std::max(pressure, static_cast<double>(heap.usage + extra_usage) / heap.budget);
+        }
+    }
+    return pressure;
+}
+
+void memory_budget::print(std::ostream &out) const {
+    const double mib = 1024.0 * 1024.0;
+    for (std::size_t i = 0; i < heap_usages.size(); i++) {
+        const memory_heap_usage &heap = heap_usages[i];
+        out << (i == 0 ? "" : ", ") << "heap " << i << (heap.device_local ? " (device) " : " ");
+        if (budget_extension_enabled) {
+            out << static_cast<std::uint64_t>(heap.usage / mib) << "/" << static_cast<std::uint64_t>(heap.budget / mib) << " MiB";
+        } else if (budget_limit != 0 && heap.device_local) {
+            out << "about " << static_cast<std::uint64_t>(heap.usage / mib) << "/" << static_cast<std::uint64_t>(heap.budget / mib)
+                << " MiB (estimated)";
+        } else {
+            out << static_cast<std::uint64_t>(heap.size / mib) << " MiB, usage unknown";
+        }
+    }
+}
@@ -0,0 +1,438 @@
+// Offline converter from Wavefront OBJ to the binary mesh format. Parsing,
+// vertex deduplication and meshlet building all happen here, so loading the
+// result at run time is a matter of mapping it and copying it to the GPU.
+
+#include "mapped_file.h"
+#include "mesh_format.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct obj_data {
+    std::vector<float> positions;
+    std::vector<float> normals;
+    // Per corner, three per triangle: 0-based position and normal indices,
+    // the normal being -1 when the face has none
+    std::vector<std::int64_t> corner_positions;
+    std::vector<std::int64_t> corner_normals;
+};
+
+struct converted_mesh {
+    std::vector<mesh_vertex> vertices;
+    std::vector<std::uint32_t> indices;
+    std::vector<mesh_meshlet> meshlets;
+    float bounds_min[3];
+    float bounds_max[3];
+};
+
+static const char *skip_spaces(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) {
+        p++;
+    }
+    return p;
+}
+
+// Resolves a 1-based or negative (relative to the end) OBJ index
+static std::int64_t resolve_obj_index(long value, std::size_t count, std::size_t line_number) {
+    std::int64_t index = value > 0 ? value - 1 : static_cast<std::int64_t>(count) + value;
+    if (value == 0 || index < 0 || index >= static_cast<std::int64_t>(count)) {
+        throw std::runtime_error("Invalid vertex reference on line " + std::to_string(line_number) + "!");
+    }
+    return index;
+}
+
+static obj_data parse_obj(const mapped_file &file) {
+    obj_data obj;
+    const char *p = reinterpret_cast<const char *>(file.data());
+    const char *end = p + file.size();
+    std::size_t line_number = 0;
+
+    std::vector<std::int64_t> face_positions;
+    std::vector<std::int64_t> face_normals;
+
+    // Each line is copied so strtof and strtol stop at its terminator
+    // instead of running on into the next line or past the mapping
+    std::string buffer;
+
+    while (p < end) {
+        const char *newline = static_cast<const char *>(std::memchr(p, '\n', end - p));
+        const char *next_line = newline == nullptr ? end : newline + 1;
+        buffer.assign(p, newline == nullptr ? end : newline);
+        p = next_line;
+        line_number++;
+
+        const char *line = buffer.c_str();
+        const char *line_end = line + buffer.size();
+        line = skip_spaces(line, line_end);
+        if (line_end - line >= 2 && line[0] == 'v' && (line[1] == ' ' || line[1] == 't' || line[1] == 'n')) {
+            if (line[1] == 't') {
+                continue;
+            }
+            std::vector<float> &target = line[1] == ' ' ? obj.positions : obj.normals;
+            char *cursor = const_cast<char *>(line + 2);
+            for (int i = 0; i < 3; i++) {
+                char *next;
+                float value = std::strtof(cursor, &next);
+                if (next == cursor) {
+                    throw std::runtime_error("Invalid vertex on line " + std::to_string(line_number) + "!");
+                }
+                target.push_back(value);
+                cursor = next;
+            }
+        } else if (line_end - line >= 2 && line[0] == 'f' && line[1] == ' ') {
+            face_positions.clear();
+            face_normals.clear();
+
+            char *cursor = const_cast<char *>(line + 2);
+            while (true) {
+                cursor = const_cast<char *>(skip_spaces(cursor, line_end));
+                if (cursor >= line_end) {
+                    break;
+                }
+
+                // v, v/vt, v//vn or v/vt/vn
+                char *next;
+                long position = std::strtol(cursor, &next, 10);
+                if (next == cursor) {
+                    throw std::runtime_error("Invalid face on line " + std::to_string(line_number) + "!");
+                }
+                cursor = next;
+                std::int64_t normal = -1;
+                if (*cursor == '/') {
+                    cursor++;
+                    if (*cursor != '/') {
+                        std::strtol(cursor, &next, 10);
+                        cursor = next;
+                    }
+                    if (*cursor == '/') {
+                        cursor++;
+                        long normal_value = std::strtol(cursor, &next, 10);
+                        if (next == cursor) {
+                            throw std::runtime_error("Invalid face on line " + std::to_string(line_number) + "!");
+                        }
+                        cursor = next;
+                        normal = resolve_obj_index(normal_value, obj.normals.size() / 3, line_number);
+                    }
+                }
+
+                face_positions.push_back(resolve_obj_index(position, obj.positions.size() / 3, line_number));
+                face_normals.push_back(normal);
+            }
+
+            if (face_positions.size() < 3) {
+                throw std::runtime_error("Face with fewer than three vertices on line " + std::to_string(line_number) + "!");
+            }
+
+            // Polygons are triangulated as fans
+            for (std::size_t i = 1; i + 1 < face_positions.size(); i++) {
+                for (std::size_t corner : { std::size_t(0), i, i + 1 }) {
+                    obj.corner_positions.push_back(face_positions[corner]);
+                    obj.corner_normals.push_back(face_normals[corner]);
+                }
+            }
+        }
+    }
+
+    return obj;
+}
+
+static void cross(const float a[3], const float b[3], float result[3]) {
+    result[0] = a[1] * b[2] - a[2] * b[1];
+    result[1] = a[2] * b[0] - a[0] * b[2];
+    result[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static float dot(const float a[3], const float b[3]) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static bool normalize(float v[3]) {
+    float length = std::sqrt(dot(v, v));
+    if (length <= 0.0f) {
+        return false;
+    }
+    for (int i = 0; i < 3; i++) {
+        v[i] /= length;
+    }
+    return true;
+}
+
+static std::int8_t pack_snorm(float value) {
+    return static_cast<std::int8_t>(std::lround(std::clamp(value, -1.0f, 1.0f) * 127.0f));
+}
+
+static void triangle_normal(const converted_mesh &mesh, std::size_t triangle, float normal[3]) {
+    const float *a = mesh.vertices[mesh.indices[triangle * 3 + 0]].position;
+    const float *b = mesh.vertices[mesh.indices[triangle * 3 + 1]].position;
+    const float *c = mesh.vertices[mesh.indices[triangle * 3 + 2]].position;
+    float ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+    float ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+    cross(ab, ac, normal);
+    if (!normalize(normal)) {
+        normal[0] = normal[1] = normal[2] = 0.0f;
+    }
+}
+
+// One vertex per distinct position/normal pair. Corners without a normal
+// get the area-weighted average of the faces around their position.
+static void build_vertices(const obj_data &obj, converted_mesh &mesh) {
+    std::size_t position_count = obj.positions.size() / 3;
+    std::vector<float> smooth_normals(position_count * 3, 0.0f);
+    for (std::size_t corner = 0; corner < obj.corner_positions.size(); corner += 3) {
+        const float *p[3];
+        for (int i = 0; i < 3; i++) {
+            p[i] = &obj.positions[obj.corner_positions[corner + i] * 3];
+        }
+        float ab[3] = { p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2] };
+        float ac[3] = { p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2] };
+        float face_normal[3];
+        cross(ab, ac, face_normal);
+        for (int i = 0; i < 3; i++) {
+            for (int axis = 0; axis < 3; axis++) {
+                smooth_normals[obj.corner_positions[corner + i] * 3 + axis] += face_normal[axis];
+            }
+        }
+    }
+
+    std::unordered_map<std::uint64_t, std::uint32_t> vertex_ids;
+    std::uint64_t normal_count = obj.normals.size() / 3;
+    mesh.indices.reserve(obj.corner_positions.size());
+
+    for (std::size_t corner = 0; corner < obj.corner_positions.size(); corner++) {
+        std::int64_t position = obj.corner_positions[corner];
+        std::int64_t normal = obj.corner_normals[corner];
+        std::uint64_t key = static_cast<std::uint64_t>(position) * (normal_count + 1) + static_cast<std::uint64_t>(normal + 1);
+
+        auto found = vertex_ids.find(key);
+        if (found != vertex_ids.end()) {
+            mesh.indices.push_back(found->second);
+            continue;
+        }
+
+        if (mesh.vertices.size() >= std::numeric_limits<std::uint32_t>::max()) {
+            throw std::runtime_error("Mesh has too many vertices for 32-bit indices!");
+        }
+
+        mesh_vertex vertex{};
+        float n[3];
+        for (int axis = 0; axis < 3; axis++) {
+            vertex.position[axis] = obj.positions[position * 3 + axis];
+            n[axis] = normal >= 0 ? obj.normals[normal * 3 + axis] : smooth_normals[position * 3 + axis];
+        }
+        if (!normalize(n)) {
+            n[0] = 0.0f;
+            n[1] = 0.0f;
+            n[2] = 1.0f;
+        }
+        for (int axis = 0; axis < 3; axis++) {
+            vertex.normal[axis] = pack_snorm(n[axis]);
+        }
+        vertex.normal[3] = 0;
+
+        std::uint32_t id = static_cast<std::uint32_t>(mesh.vertices.size());
+        vertex_ids.emplace(key, id);
+        mesh.vertices.push_back(vertex);
+        mesh.indices.push_back(id);
+    }
+}
+
+static void finish_meshlet(const converted_mesh &mesh, const std::vector<std::uint32_t> &meshlet_vertices, mesh_meshlet &meshlet) {
+    float min[3], max[3];
+    for (int axis = 0; axis < 3; axis++) {
+        min[axis] = std::numeric_limits<float>::max();
+        max[axis] = std::numeric_limits<float>::lowest();
+    }
+    for (std::uint32_t id : meshlet_vertices) {
+        for (int axis = 0; axis < 3; axis++) {
+            min[axis] = std::min(min[axis], mesh.vertices[id].position[axis]);
+            max[axis] = std::max(max[axis], mesh.vertices[id].position[axis]);
+        }
+    }
+
+    float radius = 0.0f;
+    for (int axis = 0; axis < 3; axis++) {
+        meshlet.center[axis] = (min[axis] + max[axis]) * 0.5f;
+    }
+    for (std::uint32_t id : meshlet_vertices) {
+        const float *p = mesh.vertices[id].position;
+        float d[3] = { p[0] - meshlet.center[0], p[1] - meshlet.center[1], p[2] - meshlet.center[2] };
+        radius = std::max(radius, std::sqrt(dot(d, d)));
+    }
+    meshlet.radius = radius;
+
+    std::size_t first_triangle = meshlet.first_index / 3;
+    std::size_t triangle_count = meshlet.index_count / 3;
+    float axis_sum[3] = { 0.0f, 0.0f, 0.0f };
+    for (std::size_t t = first_triangle; t < first_triangle + triangle_count; t++) {
+        float n[3];
+        triangle_normal(mesh, t, n);
+        for (int axis = 0; axis < 3; axis++) {
+            axis_sum[axis] += n[axis];
+        }
+    }
+
+    meshlet.cone_cutoff = -1.0f;
+    if (normalize(axis_sum)) {
+        float cutoff = 1.0f;
+        for (std::size_t t = first_triangle; t < first_triangle + triangle_count; t++) {
+            float n[3];
+            triangle_normal(mesh, t, n);
+            cutoff = std::min(cutoff, dot(n, axis_sum));
+        }
+        meshlet.cone_cutoff = cutoff;
+    } else {
+        axis_sum[0] = 0.0f;
+        axis_sum[1] = 0.0f;
+        axis_sum[2] = 1.0f;
+    }
+    for (int axis = 0; axis < 3; axis++) {
+        meshlet.cone_axis[axis] = axis_sum[axis];
+    }
+}
+
+// Greedily groups consecutive triangles, starting a new meshlet whenever the
+// next triangle would exceed the vertex or triangle limit
+static void build_meshlets(converted_mesh &mesh) {
+    std::vector<std::uint32_t> meshlet_vertices;
+    mesh_meshlet meshlet{};
+
+    std::size_t triangle_count = mesh.indices.size() / 3;
+    for (std::size_t t = 0; t < triangle_count; t++) {
+        std::uint32_t new_vertices = 0;
+        for (int corner = 0; corner < 3; corner++) {
+            std::uint32_t id = mesh.indices[t * 3 + corner];
+            if (std::find(meshlet_vertices.begin(), meshlet_vertices.end(), id) == meshlet_vertices.end()) {
+                new_vertices++;
+            }
+        }
+
+        if (meshlet.index_count / 3 == MESHLET_MAX_TRIANGLES ||
+                meshlet_vertices.size() + new_vertices > MESHLET_MAX_VERTICES) {
+            finish_meshlet(mesh, meshlet_vertices, meshlet);
+            mesh.meshlets.push_back(meshlet);
+            meshlet = mesh_meshlet{};
+            meshlet.first_index = static_cast<std::uint32_t>(t * 3);
+            meshlet_vertices.clear();
+        }
+
+        for (int corner = 0; corner < 3; corner++) {
+            std::uint32_t id = mesh.indices[t * 3 + corner];
+            if (std::find(meshlet_vertices.begin(), meshlet_vertices.end(), id) == meshlet_vertices.end()) {
+                meshlet_vertices.push_back(id);
+            }
+        }
+        meshlet.index_count += 3;
+    }
+
+    if (meshlet.index_count > 0) {
+        finish_meshlet(mesh, meshlet_vertices, meshlet);
+        mesh.meshlets.push_back(meshlet);
+    }
+}
+
+static void write_block(std::ofstream &file, std::uint64_t offset, const void *data, std::uint64_t size) {
+    file.seekp(static_cast<std::streamoff>(offset));
+    file.write(static_cast<const char *>(data), static_cast<std::streamsize>(size));
+}
+
+static void write_mesh(const std::string &filename, const converted_mesh &mesh) {
+    mesh_file_header header{};
+    header.magic = MESH_FILE_MAGIC;
+    header.version = MESH_FILE_VERSION;
+    header.vertex_count = static_cast<std::uint32_t>(mesh.vertices.size());
+    header.vertex_stride = sizeof(mesh_vertex);
+    header.index_count = static_cast<std::uint32_t>(mesh.indices.size());
+    header.meshlet_count = static_cast<std::uint32_t>(mesh.meshlets.size());
+    if (!mesh.indices.empty()) {
+        header.max_index = *std::max_element(mesh.indices.begin(), mesh.indices.end());
+    }
+    header.vertex_offset = align_mesh_offset(sizeof(mesh_file_header));
+    header.index_offset = align_mesh_offset(header.vertex_offset + mesh.vertices.size() * sizeof(mesh_vertex));
+    header.meshlet_offset = align_mesh_offset(header.index_offset + mesh.indices.size() * sizeof(std::uint32_t));
+    header.file_size = align_mesh_offset(header.meshlet_offset + mesh.meshlets.size() * sizeof(mesh_meshlet));
+    for (int axis = 0; axis < 3; axis++) {
+        header.bounds_min[axis] = mesh.bounds_min[axis];
+        header.bounds_max[axis] = mesh.bounds_max[axis];
+    }
+
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open file " + filename + "!");
+    }
+
+    write_block(file, 0, &header, sizeof(header));
+    write_block(file, header.vertex_offset, mesh.vertices.data(), mesh.vertices.size() * sizeof(mesh_vertex));
+    write_block(file, header.index_offset, mesh.indices.data(), mesh.indices.size() * sizeof(std::uint32_t));
+    write_block(file, header.meshlet_offset, mesh.meshlets.data(), mesh.meshlets.size() * sizeof(mesh_meshlet));
+
+    // Pad to the full size; the gaps between blocks are zero-filled by seekp
+    std::uint64_t written = header.meshlet_offset + mesh.meshlets.size() * sizeof(mesh_meshlet);
+    std::vector<char> padding(header.file_size - written, 0);
+    write_block(file, written, padding.data(), padding.size());
+
+    if (!file) {
+        throw std::runtime_error("Failed to write file " + filename + "!");
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " INPUT.obj OUTPUT.vtm\n"
+            << "\n"
+            << "Converts a Wavefront OBJ mesh to the binary mesh format loaded with --mesh.\n";
+        return EXIT_FAILURE;
+    }
+
+    try {
+        auto start = std::chrono::steady_clock::now();
+
+        converted_mesh mesh;
+        {
+            mapped_file file(argv[1]);
+            obj_data obj = parse_obj(file);
+            if (obj.corner_positions.empty()) {
+                throw std::runtime_error(std::string(argv[1]) + " has no faces!");
+            }
+            if (obj.corner_positions.size() > std::numeric_limits<std::uint32_t>::max()) {
+                throw std::runtime_error("Mesh has too many triangles!");
+            }
+            build_vertices(obj, mesh);
+        }
+
+        for (int axis = 0; axis < 3; axis++) {
+            mesh.bounds_min[axis] = std::numeric_limits<float>::max();
+            mesh.bounds_max[axis] = std::numeric_limits<float>::lowest();
+        }
+        for (const auto &vertex : mesh.vertices) {
+            for (int axis = 0; axis < 3; axis++) {
+                mesh.bounds_min[axis] = std::min(mesh.bounds_min[axis], vertex.position[axis]);
+                mesh.bounds_max[axis] = std::max(mesh.bounds_max[axis], vertex.position[axis]);
+            }
+        }
+
+        build_meshlets(mesh);
+        write_mesh(argv[2], mesh);
+
+        double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Converted " << argv[1] << ": " << mesh.vertices.size() << " vertices, "
+            << mesh.indices.size() / 3 << " triangles, " << mesh.meshlets.size() << " meshlets in "
+            << elapsed_ms << " ms" << std::endl;
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
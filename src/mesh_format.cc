@@ -0,0 +1,42 @@
+#include "mesh_format.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+// Blocks are used in place, without byte swapping
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "Mesh files can only be mapped on little-endian hosts");
+
+static bool block_fits(std::uint64_t offset, std::uint64_t count, std::uint64_t element_size, std::uint64_t file_size) {
+    return offset % MESH_BLOCK_ALIGNMENT == 0 && offset <= file_size && count <= (file_size - offset) / element_size;
+}
+
+const mesh_file_header &validate_mesh_file(const std::uint8_t *data, std::size_t size, const std::string &filename) {
+    if (size < sizeof(mesh_file_header)) {
+        throw std::runtime_error(filename + " is too small to be a mesh file!");
+    }
+
+    // The mapping is page aligned, so the header is suitably aligned too
+    const auto &header = *reinterpret_cast<const mesh_file_header *>(data);
+    if (header.magic != MESH_FILE_MAGIC) {
+        throw std::runtime_error(filename + " is not a mesh file!");
+    }
+    if (header.version != MESH_FILE_VERSION) {
+        throw std::runtime_error(filename + " has unsupported mesh format version " + std::to_string(header.version) + "!");
+    }
+
+    if (header.file_size != size || size % MESH_BLOCK_ALIGNMENT != 0 ||
+            header.vertex_stride != sizeof(mesh_vertex) || header.index_count % 3 != 0 ||
+            !block_fits(header.vertex_offset, header.vertex_count, sizeof(mesh_vertex), size) ||
+            !block_fits(header.index_offset, header.index_count, sizeof(std::uint32_t), size) ||
+            !block_fits(header.meshlet_offset, header.meshlet_count, sizeof(mesh_meshlet), size) ||
+            header.vertex_offset < sizeof(mesh_file_header)) {
+        throw std::runtime_error(filename + " is corrupt or truncated!");
+    }
+    if (header.index_count > 0 && header.max_index >= header.vertex_count) {
+        throw std::runtime_error(filename + " has indices past its " + std::to_string(header.vertex_count) + " vertices!");
+    }
+
+    return header;
+}
@@ -0,0 +1,227 @@
+#include "mesh_loader.h"
+#include "config.h"
+#include "mapped_file.h"
+#include "mesh_format.h"
+#include "vulkan_utils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+// Records and submits a copy of size bytes, blocking on the fence before
+// the command buffer is reused
+static void submit_copy(VkDevice device, VkQueue queue, VkCommandBuffer command_buffer, VkFence fence,
+        VkBuffer source, VkDeviceSize source_offset, VkBuffer destination, VkDeviceSize destination_offset, VkDeviceSize size) {
+    vkWaitForFences(device, 1, &fence, VK_TRUE, std::numeric_limits<std::uint64_t>::max());
+    vkResetFences(device, 1, &fence);
+    vkResetCommandBuffer(command_buffer, 0);
+
+    VkCommandBufferBeginInfo begin_info{};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(command_buffer, &begin_info);
+
+    VkBufferCopy region{};
+    region.srcOffset = source_offset;
+    region.dstOffset = destination_offset;
+    region.size = size;
+    vkCmdCopyBuffer(command_buffer, source, destination, 1, &region);
+
+    if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to record mesh upload!");
+    }
+
+    VkSubmitInfo submit_info{};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &command_buffer;
+
+    if (vkQueueSubmit(queue, 1, &submit_info, fence) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to submit mesh upload!");
+    }
+}
+
+// Imports the mapped file as host memory; returns false if the device
+// cannot use this mapping, in which case nothing has been created
+static bool import_host_mapping(VkPhysicalDevice physical_device, VkDevice device, const mapped_file &file,
+        unique_buffer &buffer, unique_device_memory &buffer_memory) {
+    VkPhysicalDeviceExternalMemoryHostPropertiesEXT host_properties{};
+    host_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT;
+
+    VkPhysicalDeviceProperties2 properties{};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties.pNext = &host_properties;
+    vkGetPhysicalDeviceProperties2(physical_device, &properties);
+
+    // The mapping starts on a page and the file is padded to MESH_BLOCK_ALIGNMENT
+    VkDeviceSize alignment = host_properties.minImportedHostPointerAlignment;
+    if (alignment == 0 || reinterpret_cast<std::uintptr_t>(file.data()) % alignment != 0 || file.size() % alignment != 0) {
+        return false;
+    }
+
+    auto get_host_pointer_properties = (PFN_vkGetMemoryHostPointerPropertiesEXT) vkGetDeviceProcAddr(device, "vkGetMemoryHostPointerPropertiesEXT");
+    if (get_host_pointer_properties == nullptr) {
+        return false;
+    }
+
+    // Only ever read by the GPU, as the source of the copy
+    void *host_pointer = const_cast<std::uint8_t *>(file.data());
+
+    VkMemoryHostPointerPropertiesEXT pointer_properties{};
+    pointer_properties.sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT;
+    if (get_host_pointer_properties(device, VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT, host_pointer,
+            &pointer_properties) != VK_SUCCESS || pointer_properties.memoryTypeBits == 0) {
+        return false;
+    }
+
+    VkExternalMemoryBufferCreateInfo external_info{};
+    external_info.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO;
+    external_info.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+
+    VkBufferCreateInfo buffer_info{};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.pNext = &external_info;
+    buffer_info.size = file.size();
+    buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateBuffer(device, &buffer_info, nullptr, buffer.put(device)) != VK_SUCCESS) {
+        return false;
+    }
+
+    VkMemoryRequirements memory_requirements;
+    vkGetBufferMemoryRequirements(device, buffer, &memory_requirements);
+    std::uint32_t type_bits = memory_requirements.memoryTypeBits & pointer_properties.memoryTypeBits;
+    if (type_bits == 0) {
+        buffer.reset();
+        return false;
+    }
+
+    VkImportMemoryHostPointerInfoEXT import_info{};
+    import_info.sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT;
+    import_info.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+    import_info.pHostPointer = host_pointer;
+
+    VkMemoryAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    alloc_info.pNext = &import_info;
+    alloc_info.allocationSize = file.size();
+    alloc_info.memoryTypeIndex = find_memory_type(physical_device, type_bits, 0);
+
+    if (vkAllocateMemory(device, &alloc_info, nullptr, buffer_memory.put(device)) != VK_SUCCESS) {
+        buffer.reset();
+        return false;
+    }
+
+    vkBindBufferMemory(device, buffer, buffer_memory, 0);
+    return true;
+}
+
+gpu_mesh load_mesh(VkPhysicalDevice physical_device, VkDevice device, VkQueue queue, std::uint32_t queue_family,
+        bool host_pointer_import, const std::string &filename) {
+    auto start = std::chrono::steady_clock::now();
+
+    mapped_file file(filename);
+    const mesh_file_header &header = validate_mesh_file(file.data(), file.size(), filename);
+
+    gpu_mesh mesh;
+    mesh.vertex_offset = header.vertex_offset;
+    mesh.index_offset = header.index_offset;
+    mesh.meshlet_offset = header.meshlet_offset;
+    mesh.vertex_count = header.vertex_count;
+    mesh.index_count = header.index_count;
+    mesh.meshlet_count = header.meshlet_count;
+    std::copy(header.bounds_min, header.bounds_min + 3, mesh.bounds_min);
+    std::copy(header.bounds_max, header.bounds_max + 3, mesh.bounds_max);
+
+    VkBuffer buffer;
+    VkDeviceMemory buffer_memory;
+    create_buffer(physical_device, device, file.size(),
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, buffer, buffer_memory);
+    mesh.buffer = unique_buffer(device, buffer);
+    mesh.buffer_memory = unique_device_memory(device, buffer_memory);
+
+    VkCommandPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    pool_info.queueFamilyIndex = queue_family;
+
+    unique_command_pool command_pool;
+    if (vkCreateCommandPool(device, &pool_info, nullptr, command_pool.put(device)) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create mesh upload command pool!");
+    }
+
+    VkCommandBuffer command_buffers[2];
+    VkCommandBufferAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    alloc_info.commandPool = command_pool;
+    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    alloc_info.commandBufferCount = 2;
+    if (vkAllocateCommandBuffers(device, &alloc_info, command_buffers) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate mesh upload command buffers!");
+    }
+
+    VkFenceCreateInfo fence_info{};
+    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+    unique_fence fences[2];
+    for (auto &fence : fences) {
+        if (vkCreateFence(device, &fence_info, nullptr, fence.put(device)) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create mesh upload fences!");
+        }
+    }
+
+    unique_buffer host_buffer;
+    unique_device_memory host_buffer_memory;
+    bool imported = host_pointer_import && import_host_mapping(physical_device, device, file, host_buffer, host_buffer_memory);
+
+    if (imported) {
+        submit_copy(device, queue, command_buffers[0], fences[0], host_buffer, 0, mesh.buffer, 0, file.size());
+    } else {
+        // While the GPU copies one half of the staging buffer, the CPU fills
+        // the other; submit_copy waits for a half's previous copy to finish
+        VkDeviceSize chunk_size = std::min<VkDeviceSize>(MESH_STAGING_CHUNK_SIZE, file.size());
+
+        VkBuffer staging_buffer;
+        VkDeviceMemory staging_buffer_memory;
+        create_buffer(physical_device, device, chunk_size * 2, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                0, staging_buffer, staging_buffer_memory);
+        host_buffer = unique_buffer(device, staging_buffer);
+        host_buffer_memory = unique_device_memory(device, staging_buffer_memory);
+
+        void *data;
+        vkMapMemory(device, host_buffer_memory, 0, chunk_size * 2, 0, &data);
+        auto staging = static_cast<std::uint8_t *>(data);
+
+        std::uint32_t half = 0;
+        for (VkDeviceSize offset = 0; offset < file.size(); offset += chunk_size) {
+            VkDeviceSize size = std::min(chunk_size, file.size() - offset);
+            VkFence fence = fences[half];
+            vkWaitForFences(device, 1, &fence, VK_TRUE, std::numeric_limits<std::uint64_t>::max());
+
+            std::memcpy(staging + half * chunk_size, file.data() + offset, size);
+            submit_copy(device, queue, command_buffers[half], fence, host_buffer, half * chunk_size, mesh.buffer, offset, size);
+            half = 1 - half;
+        }
+    }
+
+    VkFence all_fences[2] = { fences[0], fences[1] };
+    vkWaitForFences(device, 2, all_fences, VK_TRUE, std::numeric_limits<std::uint64_t>::max());
+
+    double elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double mib = file.size() / (1024.0 * 1024.0);
+    std::cout << "Loaded " << filename << ": " << mesh.vertex_count << " vertices, " << mesh.index_count / 3
+        << " triangles, " << mesh.meshlet_count << " meshlets, " << mib << " MiB in " << elapsed_s * 1000.0 << " ms ("
+        << mib / elapsed_s << " MiB/s, " << (imported ? "imported host mapping" : "staging copy") << ")" << std::endl;
+
+    return mesh;
+}
@@ -0,0 +1,550 @@
+#include "occlusion_culler.h"
+#include "config.h"
+#include "procedural_geometry.h"
+#include "vulkan_utils.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+// Push constants of occlusion_cull.comp
+struct cull_parameters {
+    std::uint32_t instance_count;
+    std::uint32_t phase;
+    std::uint32_t hiz_levels;
+    std::uint32_t groups_per_row;
+    std::uint32_t render_size[2];
+    float time;
+};
+
+// Push constants of hiz_build.comp
+struct hiz_parameters {
+    std::uint32_t source_size[2];
+    std::uint32_t size[2];
+    std::uint32_t level;
+};
+
+// Push constants of culled.vert
+struct draw_parameters {
+    float time;
+    std::uint32_t first_instance;
+};
+
+// Down to a single texel
+static std::uint32_t mip_level_count(VkExtent2D extent) {
+    std::uint32_t levels = 1;
+    for (std::uint32_t size = std::max(extent.width, extent.height); size > 1; size >>= 1) {
+        levels++;
+    }
+    return levels;
+}
+
+static void global_barrier(VkCommandBuffer command_buffer, VkPipelineStageFlags src_stages, VkAccessFlags src_access,
+        VkPipelineStageFlags dst_stages, VkAccessFlags dst_access) {
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = src_access;
+    barrier.dstAccessMask = dst_access;
+    vkCmdPipelineBarrier(command_buffer, src_stages, dst_stages, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+static VkDescriptorSetLayoutBinding layout_binding(std::uint32_t binding, VkDescriptorType type, VkShaderStageFlags stages) {
+    VkDescriptorSetLayoutBinding layout_binding{};
+    layout_binding.binding = binding;
+    layout_binding.descriptorType = type;
+    layout_binding.descriptorCount = 1;
+    layout_binding.stageFlags = stages;
+    return layout_binding;
+}
+
+static void create_set_layout(VkDevice device, const VkDescriptorSetLayoutBinding *bindings, std::uint32_t binding_count,
+        unique_descriptor_set_layout &set_layout) {
+    VkDescriptorSetLayoutCreateInfo layout_info{};
+    layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_info.bindingCount = binding_count;
+    layout_info.pBindings = bindings;
+
+    if (vkCreateDescriptorSetLayout(device, &layout_info, nullptr, set_layout.put(device)) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create occlusion culling descriptor set layout!");
+    }
+}
+
+static void create_layout(VkDevice device, VkDescriptorSetLayout set_layout, VkShaderStageFlags push_constant_stages,
+        std::uint32_t push_constant_size, unique_pipeline_layout &pipeline_layout) {
+    VkPushConstantRange push_constant_range{};
+    push_constant_range.stageFlags = push_constant_stages;
+    push_constant_range.offset = 0;
+    push_constant_range.size = push_constant_size;
+
+    VkPipelineLayoutCreateInfo pipeline_layout_info{};
+    pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipeline_layout_info.setLayoutCount = 1;
+    pipeline_layout_info.pSetLayouts = &set_layout;
+    pipeline_layout_info.pushConstantRangeCount = 1;
+    pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+
+    if (vkCreatePipelineLayout(device, &pipeline_layout_info, nullptr, pipeline_layout.put(device)) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create occlusion culling pipeline layout!");
+    }
+}
+
+static void create_compute_pipeline(VkDevice device, VkPipelineLayout layout, const std::string &filename,
+        unique_pipeline &pipeline) {
+    unique_shader_module shader_module(device, create_shader_module(device, read_file(filename)));
+
+    VkComputePipelineCreateInfo pipeline_info{};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipeline_info.stage.module = shader_module;
+    pipeline_info.stage.pName = "main";
+    pipeline_info.layout = layout;
+
+    if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, pipeline.put(device)) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create occlusion culling compute pipeline!");
+    }
+}
+
+static VkWriteDescriptorSet buffer_write(VkDescriptorSet set, std::uint32_t binding, const VkDescriptorBufferInfo *buffer_info) {
+    VkWriteDescriptorSet descriptor_write{};
+    descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptor_write.dstSet = set;
+    descriptor_write.dstBinding = binding;
+    descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptor_write.descriptorCount = 1;
+    descriptor_write.pBufferInfo = buffer_info;
+    return descriptor_write;
+}
+
+static VkWriteDescriptorSet image_write(VkDescriptorSet set, std::uint32_t binding, VkDescriptorType type,
+        const VkDescriptorImageInfo *image_info) {
+    VkWriteDescriptorSet descriptor_write{};
+    descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptor_write.dstSet = set;
+    descriptor_write.dstBinding = binding;
+    descriptor_write.descriptorType = type;
+    descriptor_write.descriptorCount = 1;
+    descriptor_write.pImageInfo = image_info;
+    return descriptor_write;
+}
+
+void occlusion_culler::init(VkPhysicalDevice physical_device, VkDevice device, std::uint32_t instance_count,
+        std::uint32_t frame_slots) {
+    this->physical_device = physical_device;
+    this->device = device;
+    this->instance_count = instance_count;
+    visibility_cleared = false;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+
+    VkDeviceSize list_size = static_cast<VkDeviceSize>(instance_count) * 2 * sizeof(std::uint32_t);
+    if (instance_count == 0 || list_size > properties.limits.maxStorageBufferRange) {
+        throw std::runtime_error("Occlusion culling instance count is out of range!");
+    }
+    std::uint64_t group_count = (instance_count + OCCLUSION_CULL_GROUP_SIZE - 1) / OCCLUSION_CULL_GROUP_SIZE;
+    if (!split_dispatch(group_count, properties.limits.maxComputeWorkGroupCount, cull_group_counts)) {
+        throw std::runtime_error("Occlusion culling needs too many compute work groups!");
+    }
+
+    VkBuffer buffer;
+    VkDeviceMemory buffer_memory;
+    create_buffer(physical_device, device, static_cast<VkDeviceSize>(instance_count) * sizeof(std::uint32_t),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0,
+            buffer, buffer_memory);
+    visibility_buffer = unique_buffer(device, buffer);
+    visibility_buffer_memory = unique_device_memory(device, buffer_memory);
+
+    create_buffer(physical_device, device, 2 * sizeof(VkDrawIndirectCommand),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, buffer, buffer_memory);
+    draw_buffer = unique_buffer(device, buffer);
+    draw_buffer_memory = unique_device_memory(device, buffer_memory);
+
+    create_buffer(physical_device, device, list_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, buffer, buffer_memory);
+    instance_list_buffer = unique_buffer(device, buffer);
+    instance_list_buffer_memory = unique_device_memory(device, buffer_memory);
+
+    VkDeviceSize count_size = static_cast<VkDeviceSize>(frame_slots) * 2 * sizeof(VkDrawIndirectCommand);
+    create_buffer(physical_device, device, count_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+            buffer, buffer_memory);
+    count_buffer = unique_buffer(device, buffer);
+    count_buffer_memory = unique_device_memory(device, buffer_memory);
+
+    void *mapped;
+    if (vkMapMemory(device, count_buffer_memory, 0, count_size, 0, &mapped) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to map occlusion culling counts!");
+    }
+    counts = static_cast<const VkDrawIndirectCommand *>(mapped);
+
+    create_pipelines();
+    create_static_descriptors();
+}
+
+void occlusion_culler::cleanup() {
+    hiz_descriptor_sets.clear();
+    pyramid_descriptor_pool.reset();
+    pyramid_level_views.clear();
+    pyramid_view.reset();
+    pyramid_image.reset();
+    pyramid_image_memory.reset();
+    pyramid_levels = 0;
+
+    static_descriptor_pool.reset();
+    cull_pipeline.reset();
+    hiz_pipeline.reset();
+    cull_pipeline_layout.reset();
+    hiz_pipeline_layout.reset();
+    draw_pipeline_layout.reset();
+    cull_descriptor_set_layout.reset();
+    hiz_descriptor_set_layout.reset();
+    draw_descriptor_set_layout.reset();
+    sampler.reset();
+
+    // Freeing the memory unmaps it
+    counts = nullptr;
+    count_buffer.reset();
+    count_buffer_memory.reset();
+    instance_list_buffer.reset();
+    instance_list_buffer_memory.reset();
+    draw_buffer.reset();
+    draw_buffer_memory.reset();
+    visibility_buffer.reset();
+    visibility_buffer_memory.reset();
+}
+
+void occlusion_culler::create_pipelines() {
+    VkDescriptorSetLayoutBinding cull_bindings[] = {
+        layout_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT),
+        layout_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT),
+        layout_binding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT),
+        layout_binding(3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT),
+    };
+    create_set_layout(device, cull_bindings, 4, cull_descriptor_set_layout);
+
+    VkDescriptorSetLayoutBinding hiz_bindings[] = {
+        layout_binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT),
+        layout_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT),
+        layout_binding(2, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT),
+    };
+    create_set_layout(device, hiz_bindings, 3, hiz_descriptor_set_layout);
+
+    VkDescriptorSetLayoutBinding draw_binding = layout_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT);
+    create_set_layout(device, &draw_binding, 1, draw_descriptor_set_layout);
+
+    create_layout(device, cull_descriptor_set_layout, VK_SHADER_STAGE_COMPUTE_BIT, sizeof(cull_parameters),
+            cull_pipeline_layout);
+    create_layout(device, hiz_descriptor_set_layout, VK_SHADER_STAGE_COMPUTE_BIT, sizeof(hiz_parameters),
+            hiz_pipeline_layout);
+    create_layout(device, draw_descriptor_set_layout, VK_SHADER_STAGE_VERTEX_BIT, sizeof(draw_parameters),
+            draw_pipeline_layout);
+
+    create_compute_pipeline(device, cull_pipeline_layout, "occlusion_cull.comp.spv", cull_pipeline);
+    create_compute_pipeline(device, hiz_pipeline_layout, "hiz_build.comp.spv", hiz_pipeline);
+
+    // Only ever read with texelFetch
+    VkSamplerCreateInfo sampler_info{};
+    sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler_info.magFilter = VK_FILTER_NEAREST;
+    sampler_info.minFilter = VK_FILTER_NEAREST;
+    sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.maxLod = VK_LOD_CLAMP_NONE;
+
+    if (vkCreateSampler(device, &sampler_info, nullptr, sampler.put(device)) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create occlusion culling sampler!");
+    }
+}
+
+void occlusion_culler::create_static_descriptors() {
+    VkDescriptorPoolSize pool_size{};
+    pool_size.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    pool_size.descriptorCount = 1;
+
+    VkDescriptorPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.poolSizeCount = 1;
+    pool_info.pPoolSizes = &pool_size;
+    pool_info.maxSets = 1;
+
+    if (vkCreateDescriptorPool(device, &pool_info, nullptr, static_descriptor_pool.put(device)) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create occlusion culling descriptor pool!");
+    }
+
+    VkDescriptorSetLayout set_layout = draw_descriptor_set_layout;
+    VkDescriptorSetAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool = static_descriptor_pool;
+    alloc_info.descriptorSetCount = 1;
+    alloc_info.pSetLayouts = &set_layout;
+
+    if (vkAllocateDescriptorSets(device, &alloc_info, &draw_descriptor_set) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate occlusion culling descriptor set!");
+    }
+
+    VkDescriptorBufferInfo list_info{ instance_list_buffer, 0, VK_WHOLE_SIZE };
+    VkWriteDescriptorSet descriptor_write = buffer_write(draw_descriptor_set, 0, &list_info);
+    vkUpdateDescriptorSets(device, 1, &descriptor_write, 0, nullptr);
+}
+
+void occlusion_culler::set_depth_target(VkImageView depth_view, VkExtent2D extent, deletion_queue &retired,
+        std::uint64_t last_use_frame) {
+    if (pyramid_image) {
+        hiz_descriptor_sets.clear();
+        retired.retire(last_use_frame, std::move(pyramid_descriptor_pool));
+        for (auto &view : pyramid_level_views) {
+            retired.retire(last_use_frame, std::move(view));
+        }
+        pyramid_level_views.clear();
+        retired.retire(last_use_frame, std::move(pyramid_view));
+        retired.retire(last_use_frame, std::move(pyramid_image));
+        retired.retire(last_use_frame, std::move(pyramid_image_memory));
+    }
+
+    create_pyramid(extent);
+    create_pyramid_descriptors(depth_view);
+}
+
+void occlusion_culler::create_pyramid(VkExtent2D extent) {
+    pyramid_extent = extent;
+    pyramid_levels = mip_level_count(extent);
+
+    VkImage image;
+    VkDeviceMemory image_memory;
+    create_image(physical_device, device, extent.width, extent.height, pyramid_levels, VK_SAMPLE_COUNT_1_BIT,
+            VK_FORMAT_R32_SFLOAT, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, image, image_memory);
+    pyramid_image = unique_image(device, image);
+    pyramid_image_memory = unique_device_memory(device, image_memory);
+    pyramid_view = unique_image_view(device,
+            create_image_view(device, pyramid_image, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, pyramid_levels));
+
+    // Storage image views may only see one level
+    for (std::uint32_t level = 0; level < pyramid_levels; level++) {
+        VkImageViewCreateInfo view_info{};
+        view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        view_info.image = pyramid_image;
+        view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        view_info.format = VK_FORMAT_R32_SFLOAT;
+        view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        view_info.subresourceRange.baseMipLevel = level;
+        view_info.subresourceRange.levelCount = 1;
+        view_info.subresourceRange.baseArrayLayer = 0;
+        view_info.subresourceRange.layerCount = 1;
+
+        unique_image_view view;
+        if (vkCreateImageView(device, &view_info, nullptr, view.put(device)) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create hierarchical Z level view!");
+        }
+        pyramid_level_views.push_back(std::move(view));
+    }
+}
+
+void occlusion_culler::create_pyramid_descriptors(VkImageView depth_view) {
+    VkDescriptorPoolSize pool_sizes[3]{};
+    pool_sizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    pool_sizes[0].descriptorCount = 3;
+    pool_sizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    pool_sizes[1].descriptorCount = 1 + pyramid_levels;
+    pool_sizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    pool_sizes[2].descriptorCount = 2 * pyramid_levels;
+
+    VkDescriptorPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.poolSizeCount = 3;
+    pool_info.pPoolSizes = pool_sizes;
+    pool_info.maxSets = 1 + pyramid_levels;
+
+    if (vkCreateDescriptorPool(device, &pool_info, nullptr, pyramid_descriptor_pool.put(device)) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create hierarchical Z descriptor pool!");
+    }
+
+    std::vector<VkDescriptorSetLayout> set_layouts(1 + pyramid_levels, hiz_descriptor_set_layout);
+    set_layouts[0] = cull_descriptor_set_layout;
+    std::vector<VkDescriptorSet> sets(set_layouts.size());
+
+    VkDescriptorSetAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool = pyramid_descriptor_pool;
+    alloc_info.descriptorSetCount = static_cast<std::uint32_t>(set_layouts.size());
+    alloc_info.pSetLayouts = set_layouts.data();
+
+    if (vkAllocateDescriptorSets(device, &alloc_info, sets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate hierarchical Z descriptor sets!");
+    }
+    cull_descriptor_set = sets[0];
+    hiz_descriptor_sets.assign(sets.begin() + 1, sets.end());
+
+    VkDescriptorBufferInfo visibility_info{ visibility_buffer, 0, VK_WHOLE_SIZE };
+    VkDescriptorBufferInfo draw_info{ draw_buffer, 0, VK_WHOLE_SIZE };
+    VkDescriptorBufferInfo list_info{ instance_list_buffer, 0, VK_WHOLE_SIZE };
+    VkDescriptorImageInfo pyramid_info{ sampler, pyramid_view, VK_IMAGE_LAYOUT_GENERAL };
+    VkDescriptorImageInfo depth_info{ sampler, depth_view, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL };
+
+    std::vector<VkDescriptorImageInfo> level_infos(pyramid_levels);
+    for (std::uint32_t level = 0; level < pyramid_levels; level++) {
+        level_infos[level] = { VK_NULL_HANDLE, pyramid_level_views[level], VK_IMAGE_LAYOUT_GENERAL };
+    }
+
+    std::vector<VkWriteDescriptorSet> descriptor_writes = {
+        buffer_write(cull_descriptor_set, 0, &visibility_info),
+        buffer_write(cull_descriptor_set, 1, &draw_info),
+        buffer_write(cull_descriptor_set, 2, &list_info),
+        image_write(cull_descriptor_set, 3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &pyramid_info),
+    };
+    for (std::uint32_t level = 0; level < pyramid_levels; level++) {
+        // Level 0 reads the depth attachment instead, but the source still
+        // has to be bound
+        std::uint32_t source = level > 0 ? level - 1 : 0;
+        descriptor_writes.push_back(image_write(hiz_descriptor_sets[level], 0,
+                VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &depth_info));
+        descriptor_writes.push_back(image_write(hiz_descriptor_sets[level], 1,
+                VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, &level_infos[source]));
+        descriptor_writes.push_back(image_write(hiz_descriptor_sets[level], 2,
+                VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, &level_infos[level]));
+    }
+    vkUpdateDescriptorSets(device, static_cast<std::uint32_t>(descriptor_writes.size()), descriptor_writes.data(),
+            0, nullptr);
+}
+
+void occlusion_culler::dispatch_cull(VkCommandBuffer command_buffer, std::uint32_t phase, VkExtent2D render_extent,
+        std::uint32_t hiz_levels, float time) {
+    cull_parameters parameters;
+    parameters.instance_count = instance_count;
+    parameters.phase = phase;
+    parameters.hiz_levels = hiz_levels;
+    parameters.groups_per_row = cull_group_counts[0];
+    parameters.render_size[0] = render_extent.width;
+    parameters.render_size[1] = render_extent.height;
+    parameters.time = time;
+
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, cull_pipeline);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, cull_pipeline_layout, 0, 1,
+            &cull_descriptor_set, 0, nullptr);
+    vkCmdPushConstants(command_buffer, cull_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(parameters),
+            &parameters);
+    vkCmdDispatch(command_buffer, cull_group_counts[0], cull_group_counts[1], 1);
+
+    global_barrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+            VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT);
+}
+
+void occlusion_culler::record_first_phase(VkCommandBuffer command_buffer, float time) {
+    // The previous frame's culling, draws and count copy are done with the
+    // buffers about to be reset
+    global_barrier(command_buffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+            VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    // Nothing was visible before the first frame, so it is all drawn in phase 1
+    if (!visibility_cleared) {
+        vkCmdFillBuffer(command_buffer, visibility_buffer, 0, VK_WHOLE_SIZE, 0);
+        visibility_cleared = true;
+    }
+
+    VkDrawIndirectCommand draws[2] = {
+        { 3, 0, 0, 0 },
+        { 3, 0, 0, 0 },
+    };
+    vkCmdUpdateBuffer(command_buffer, draw_buffer, 0, sizeof(draws), draws);
+
+    global_barrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    dispatch_cull(command_buffer, 0, VkExtent2D{ 1, 1 }, 1, time);
+}
+
+void occlusion_culler::record_second_phase(VkCommandBuffer command_buffer, VkExtent2D render_extent, float time) {
+    std::uint32_t hiz_levels = std::min(mip_level_count(render_extent), pyramid_levels);
+
+    // Last frame's contents are of no use
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = pyramid_image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = pyramid_levels;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+            0, nullptr, 0, nullptr, 1, &barrier);
+
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, hiz_pipeline);
+
+    VkExtent2D source_size = render_extent;
+    VkExtent2D size = render_extent;
+    for (std::uint32_t level = 0; level < hiz_levels; level++) {
+        if (level > 0) {
+            source_size = size;
+            size = { std::max(size.width >> 1, 1u), std::max(size.height >> 1, 1u) };
+        }
+
+        hiz_parameters parameters;
+        parameters.source_size[0] = source_size.width;
+        parameters.source_size[1] = source_size.height;
+        parameters.size[0] = size.width;
+        parameters.size[1] = size.height;
+        parameters.level = level;
+
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, hiz_pipeline_layout, 0, 1,
+                &hiz_descriptor_sets[level], 0, nullptr);
+        vkCmdPushConstants(command_buffer, hiz_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(parameters),
+                &parameters);
+        vkCmdDispatch(command_buffer, (size.width + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE,
+                (size.height + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, 1);
+
+        global_barrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+    }
+
+    dispatch_cull(command_buffer, 1, render_extent, hiz_levels, time);
+}
+
+void occlusion_culler::draw(VkCommandBuffer command_buffer, std::uint32_t phase, float time) {
+    // Offset through the push constant rather than firstInstance, which
+    // would need the drawIndirectFirstInstance feature
+    draw_parameters parameters;
+    parameters.time = time;
+    parameters.first_instance = phase * instance_count;
+
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, draw_pipeline_layout, 0, 1,
+            &draw_descriptor_set, 0, nullptr);
+    vkCmdPushConstants(command_buffer, draw_pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(parameters),
+            &parameters);
+    vkCmdDrawIndirect(command_buffer, draw_buffer, phase * sizeof(VkDrawIndirectCommand), 1,
+            sizeof(VkDrawIndirectCommand));
+}
+
+void occlusion_culler::record_counts(VkCommandBuffer command_buffer, std::uint32_t frame_slot) {
+    global_barrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+
+    VkBufferCopy region{};
+    region.srcOffset = 0;
+    region.dstOffset = static_cast<VkDeviceSize>(frame_slot) * 2 * sizeof(VkDrawIndirectCommand);
+    region.size = 2 * sizeof(VkDrawIndirectCommand);
+    vkCmdCopyBuffer(command_buffer, draw_buffer, count_buffer, 1, &region);
+
+    global_barrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+}
+
+void occlusion_culler::read_counts(std::uint32_t frame_slot, std::uint32_t &first_phase, std::uint32_t &second_phase) const {
+    first_phase = counts[frame_slot * 2].instanceCount;
+    second_phase = counts[frame_slot * 2 + 1].instanceCount;
+}
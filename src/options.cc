@@ -0,0 +1,149 @@
+#include "options.h"
+#include "config.h"
+
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+static std::uint32_t parse_count(const std::string &option, const std::string &value) {
+    std::size_t end = 0;
+    unsigned long count = 0;
+    try {
+        count = std::stoul(value, &end);
+    } catch (const std::exception &) {
+        end = 0;
+    }
+
+    if (end != value.size() || count == 0 || count > UINT32_MAX) {
+        throw std::invalid_argument("Invalid value for " + option + ": " + value);
+    }
+
+    return static_cast<std::uint32_t>(count);
+}
+
+options parse_options(int argc, char **argv) {
+    options result;
+    result.width = WINDOW_WIDTH;
+    result.height = WINDOW_HEIGHT;
+    result.perf_runs = PERF_RUNS;
+
+    for (int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+
+        auto next_value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                throw std::invalid_argument("Missing value for " + option);
+            }
+            return argv[++i];
+        };
+
+        if (option == "--help" || option == "-h") {
+            result.show_help = true;
+        } else if (option == "--bench-contexts") {
+            result.bench_contexts = parse_count(option, next_value());
+        } else if (option == "--batch") {
+            result.batch = true;
+        } else if (option == "--batch-socket") {
+            result.batch = true;
+            result.batch_socket = next_value();
+        } else if (option == "--cpu") {
+            result.use_cpu = true;
+        } else if (option == "--cpu-check") {
+            result.cpu_check = true;
+        } else if (option == "--mesh") {
+            result.mesh_file = next_value();
+        } else if (option == "--memory-budget") {
+            result.memory_budget_mib = parse_count(option, next_value());
+        } else if (option == "--export-socket") {
+            result.export_socket = next_value();
+        } else if (option == "--perf-record") {
+            result.perf_record = next_value();
+        } else if (option == "--perf-check") {
+            result.perf_check = next_value();
+        } else if (option == "--perf-runs") {
+            result.perf_runs = parse_count(option, next_value());
+        } else if (option == "--windows") {
+            result.window_count = parse_count(option, next_value());
+        } else if (option == "--headless-surface") {
+            result.headless_surface = true;
+        } else if (option == "--tessellate") {
+            result.tessellate_segments = parse_count(option, next_value());
+        } else if (option == "--sierpinski") {
+            result.sierpinski_levels = parse_count(option, next_value());
+        } else if (option == "--no-mesh-shaders") {
+            result.no_mesh_shaders = true;
+        } else if (option == "--occlusion-cull") {
+            result.occlusion_cull_instances = parse_count(option, next_value());
+        } else if (option == "--texture") {
+            result.texture_files.push_back(next_value());
+        } else if (option == "--frames") {
+            result.frames = parse_count(option, next_value());
+        } else if (option == "--size") {
+            std::string value = next_value();
+            std::size_t separator = value.find('x');
+            if (separator == std::string::npos) {
+                throw std::invalid_argument("Invalid value for --size, expected WIDTHxHEIGHT: " + value);
+            }
+            result.width = parse_count(option, value.substr(0, separator));
+            result.height = parse_count(option, value.substr(separator + 1));
+        } else {
+            throw std::invalid_argument("Unknown option: " + option);
+        }
+    }
+
+    // The tessellated triangle replaces the scene, the mesh would never be drawn
+    if ((result.tessellate_segments > 0 || result.sierpinski_levels > 0) && !result.mesh_file.empty()) {
+        throw std::invalid_argument("--tessellate and --sierpinski cannot be combined with --mesh");
+    }
+
+    return result;
+}
+
+void print_usage(const char *program) {
+    std::cerr << "Usage: " << program << " [options]\n"
+        << "\n"
+        << "Without options, the triangle is rendered in a window. Without a Vulkan\n"
+        << "device, it is rendered on the CPU to " << CPU_FALLBACK_OUTPUT << " instead.\n"
+        << "\n"
+        << "  --cpu                Render with the CPU rasterizer: the window's image is\n"
+        << "                       written to " << CPU_FALLBACK_OUTPUT << ", batch jobs as usual\n"
+        << "  --cpu-check          Compare the CPU rasterizer with the Vulkan device and\n"
+        << "                       benchmark both at --size for --frames frames\n"
+        << "  --windows N          Show the window's scene in N windows, rendered once\n"
+        << "                       and presented to all of them together\n"
+        << "  --headless-surface   Present to VK_EXT_headless_surface surfaces instead of\n"
+        << "                       windows for --frames frames, for testing\n"
+        << "  --mesh PATH          Show a mesh converted with mesh_converter in the window\n"
+        << "  --texture PATH       Stream a binary PPM onto the GPU and show it in the\n"
+        << "                       window; may be repeated\n"
+        << "  --tessellate N       Subdivide the window's triangle into N*N triangles on\n"
+        << "                       the GPU to stress vertex throughput\n"
+        << "  --sierpinski LEVELS  Like --tessellate, but draw a Sierpinski gasket of\n"
+        << "                       3^LEVELS triangles\n"
+        << "  --no-mesh-shaders    Tessellate with a compute pre-pass into a vertex\n"
+        << "                       buffer even if VK_EXT_mesh_shader is supported\n"
+        << "  --occlusion-cull N   Draw N instances behind a few occluders, culled on\n"
+        << "                       the GPU against a hierarchical Z pyramid\n"
+        << "  --memory-budget MIB  Keep the window's device-local memory under MIB,\n"
+        << "                       giving up MSAA and resolution to stay inside it\n"
+        << "  --bench-contexts N   Render headless with 1 up to N parallel contexts and\n"
+        << "                       report aggregate frames per second\n"
+        << "  --export-socket PATH Render --frames frames of --size and hand them to a\n"
+        << "                       consumer such as frame_consumer on a Unix socket,\n"
+        << "                       without copying them\n"
+        << "  --perf-record PATH   Run the headless benchmark at --size for --frames\n"
+        << "                       frames --perf-runs times and save a baseline\n"
+        << "  --perf-check PATH    Rerun the baseline's benchmark and fail if startup,\n"
+        << "                       p99 frame time or memory use regressed\n"
+        << "  --perf-runs N        Runs per measurement (default " << PERF_RUNS << ", at least 5 to detect\n"
+        << "                       a regression)\n"
+        << "  --frames N           Frames rendered per context (default 1000)\n"
+        << "  --size WxH           Offscreen render size (default "
+        << WINDOW_WIDTH << "x" << WINDOW_HEIGHT << ")\n"
+        << "  --batch              Render jobs read from stdin, one per line:\n"
+        << "                         output=PATH [size=WxH] [clear=R,G,B] [offset=X,Y]\n"
+        << "                         [scale=S] [rotation=DEGREES]\n"
+        << "  --batch-socket PATH  Like --batch, but accept jobs on a Unix socket until a\n"
+        << "                       client sends \"quit\"\n";
+}
@@ -0,0 +1,521 @@
+#include "perf_gate.h"
+#include "config.h"
+#include "headless_renderer.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+struct perf_run {
+    double startup_ms;
+    double median_frame_ms;
+    double p99_frame_ms;
+    double peak_memory_mib;
+};
+
+struct perf_results {
+    std::string device;
+    VkExtent2D extent;
+    std::uint32_t frames;
+    std::vector<perf_run> runs;
+};
+
+// Sent from the child process measuring a run
+struct child_report {
+    perf_run run;
+    char device[VK_MAX_PHYSICAL_DEVICE_NAME_SIZE];
+};
+
+// Nearest rank
+static double percentile(std::vector<double> values, double fraction) {
+    std::sort(values.begin(), values.end());
+    std::size_t rank = static_cast<std::size_t>(std::ceil(fraction * values.size()));
+    return values[std::clamp<std::size_t>(rank, 1, values.size()) - 1];
+}
+
+static double median(const std::vector<double> &values) {
+    std::vector<double> sorted = values;
+    std::sort(sorted.begin(), sorted.end());
+    std::size_t middle = sorted.size() / 2;
+    return sorted.size() % 2 ? sorted[middle] : 0.5 * (sorted[middle - 1] + sorted[middle]);
+}
+
+static void measure_in_child(int fd, std::uint32_t frames, VkExtent2D extent) {
+    auto start = std::chrono::steady_clock::now();
+
+    headless_device shared;
+    shared.init(1);
+    render_context context;
+    context.init(shared, 0, extent);
+    context.render_frames(1);
+
+    child_report report{};
+    report.run.startup_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<double> frame_times_ms;
+    frame_times_ms.reserve(frames);
+    context.render_frames(frames, &frame_times_ms);
+    report.run.median_frame_ms = percentile(frame_times_ms, 0.5);
+    report.run.p99_frame_ms = percentile(frame_times_ms, 0.99);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(shared.physical_device, &properties);
+    std::strncpy(report.device, properties.deviceName, sizeof(report.device) - 1);
+
+    context.cleanup();
+    shared.cleanup();
+
+    // The peak includes device memory on CPU implementations such as lavapipe
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    report.run.peak_memory_mib = usage.ru_maxrss / 1024.0;
+
+    const char *data = reinterpret_cast<const char *>(&report);
+    for (std::size_t written = 0; written < sizeof(report);) {
+        ssize_t result = write(fd, data + written, sizeof(report) - written);
+        if (result <= 0) {
+            throw std::runtime_error("Failed to send benchmark results!");
+        }
+        written += result;
+    }
+}
+
+// Every run gets a process of its own, so that startup includes loading the
+// driver and the peak memory is that run's alone
+static perf_run run_in_child(std::uint32_t frames, VkExtent2D extent, std::string &device) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        throw std::runtime_error("Failed to create benchmark pipe!");
+    }
+
+    // Anything still buffered would be written by both processes
+    std::cout.flush();
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        throw std::runtime_error("Failed to start benchmark process!");
+    }
+
+    if (pid == 0) {
+        close(fds[0]);
+        int null_fd = open("/dev/null", O_WRONLY);
+        if (null_fd >= 0) {
+            dup2(null_fd, STDOUT_FILENO);
+            close(null_fd);
+        }
+
+        int status = EXIT_SUCCESS;
+        try {
+            measure_in_child(fds[1], frames, extent);
+        } catch (const std::exception &e) {
+            std::cerr << e.what() << std::endl;
+            status = EXIT_FAILURE;
+        }
+        _exit(status);
+    }
+
+    close(fds[1]);
+    child_report report;
+    std::size_t received = 0;
+    char *data = reinterpret_cast<char *>(&report);
+    while (received < sizeof(report)) {
+        ssize_t result = read(fds[0], data + received, sizeof(report) - received);
+        if (result <= 0) {
+            break;
+        }
+        received += result;
+    }
+    close(fds[0]);
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (received != sizeof(report) || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+        throw std::runtime_error("Benchmark run failed!");
+    }
+
+    report.device[sizeof(report.device) - 1] = '\0';
+    device = report.device;
+    return report.run;
+}
+
+static std::string warm_up(std::uint32_t frames, VkExtent2D extent) {
+    // Fills the pipeline cache and the page cache, so every measured run
+    // starts from the same state
+    std::string device;
+    run_in_child(frames, extent, device);
+    return device;
+}
+
+static perf_results measure(const std::string &device, std::uint32_t runs, std::uint32_t frames, VkExtent2D extent) {
+    if (runs < 2) {
+        throw std::runtime_error("Performance comparisons need at least 2 runs!");
+    }
+
+    perf_results results;
+    results.device = device;
+    results.extent = extent;
+    results.frames = frames;
+
+    std::cout << "Measuring " << runs << " runs of " << frames << " frames at " << extent.width << "x" << extent.height
+        << " on " << device << std::endl;
+    for (std::uint32_t i = 0; i < runs; i++) {
+        std::string run_device;
+        perf_run run = run_in_child(frames, extent, run_device);
+        std::cout << std::fixed << std::setprecision(3)
+            << "  run " << i + 1 << ": startup " << run.startup_ms << " ms, median frame " << run.median_frame_ms
+            << " ms, p99 frame " << run.p99_frame_ms << " ms, peak memory " << run.peak_memory_mib << " MiB" << std::endl;
+        results.runs.push_back(run);
+    }
+    std::cout.unsetf(std::ios::floatfield);
+
+    return results;
+}
+
+// Just enough JSON for baselines: objects, arrays, strings and numbers
+struct json_value {
+    enum { NUMBER, STRING, ARRAY, OBJECT } type = NUMBER;
+    double number = 0.0;
+    std::string string;
+    std::vector<json_value> items;
+    std::vector<std::pair<std::string, json_value>> members;
+
+    const json_value &at(const std::string &key) const {
+        for (const auto &member : members) {
+            if (member.first == key) {
+                return member.second;
+            }
+        }
+        throw std::runtime_error("Baseline has no \"" + key + "\"!");
+    }
+};
+
+class json_parser {
+    public:
+        explicit json_parser(const std::string &text) : text(text) {}
+
+        json_value parse() {
+            json_value value = parse_value();
+            skip_whitespace();
+            if (position != text.size()) {
+                fail();
+            }
+            return value;
+        }
+
+    private:
+        [[noreturn]] void fail() {
+            throw std::runtime_error("Baseline is not valid JSON at offset " + std::to_string(position) + "!");
+        }
+
+        void skip_whitespace() {
+            while (position < text.size() && std::isspace(static_cast<unsigned char>(text[position]))) {
+                position++;
+            }
+        }
+
+        bool consume(char c) {
+            skip_whitespace();
+            if (position < text.size() && text[position] == c) {
+                position++;
+                return true;
+            }
+            return false;
+        }
+
+        void expect(char c) {
+            if (!consume(c)) {
+                fail();
+            }
+        }
+
+        std::string parse_string() {
+            expect('"');
+            std::string result;
+            while (position < text.size() && text[position] != '"') {
+                char c = text[position++];
+                if (c == '\\') {
+                    if (position >= text.size()) {
+                        fail();
+                    }
+                    c = text[position++];
+                    if (c == 'n') c = '\n';
+                    else if (c == 't') c = '\t';
+                    else if (c != '"' && c != '\\' && c != '/') fail();
+                }
+                result += c;
+            }
+            expect('"');
+            return result;
+        }
+
+        json_value parse_value() {
+            json_value value;
+            skip_whitespace();
+            if (position >= text.size()) {
+                fail();
+            }
+
+            if (text[position] == '{') {
+                value.type = json_value::OBJECT;
+                position++;
+                if (!consume('}')) {
+                    do {
+                        std::string key = parse_string();
+                        expect(':');
+                        value.members.emplace_back(key, parse_value());
+                    } while (consume(','));
+                    expect('}');
+                }
+            } else if (text[position] == '[') {
+                value.type = json_value::ARRAY;
+                position++;
+                if (!consume(']')) {
+                    do {
+                        value.items.push_back(parse_value());
+                    } while (consume(','));
+                    expect(']');
+                }
+            } else if (text[position] == '"') {
+                value.type = json_value::STRING;
+                value.string = parse_string();
+            } else {
+                const char *start = text.c_str() + position;
+                char *end = nullptr;
+                value.number = std::strtod(start, &end);
+                if (end == start) {
+                    fail();
+                }
+                position += end - start;
+            }
+            return value;
+        }
+
+        const std::string &text;
+        std::size_t position = 0;
+};
+
+static std::string json_string(const std::string &value) {
+    std::string result = "\"";
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            result += '\\';
+        }
+        result += c;
+    }
+    return result + "\"";
+}
+
+static void write_baseline(const std::string &path, const perf_results &results) {
+    std::ofstream file(path);
+    if (!file) {
+        throw std::runtime_error("Failed to open " + path + " for writing!");
+    }
+
+    file << std::setprecision(6)
+        << "{\n"
+        << "  \"device\": " << json_string(results.device) << ",\n"
+        << "  \"width\": " << results.extent.width << ",\n"
+        << "  \"height\": " << results.extent.height << ",\n"
+        << "  \"frames\": " << results.frames << ",\n"
+        << "  \"runs\": [\n";
+    for (std::size_t i = 0; i < results.runs.size(); i++) {
+        const perf_run &run = results.runs[i];
+        file << "    { \"startup_ms\": " << run.startup_ms
+            << ", \"median_frame_ms\": " << run.median_frame_ms
+            << ", \"p99_frame_ms\": " << run.p99_frame_ms
+            << ", \"peak_memory_mib\": " << run.peak_memory_mib << " }"
+            << (i + 1 < results.runs.size() ? ",\n" : "\n");
+    }
+    file << "  ]\n"
+        << "}\n";
+
+    if (!file) {
+        throw std::runtime_error("Failed to write " + path + "!");
+    }
+}
+
+static perf_results read_baseline(const std::string &path) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("Failed to open baseline " + path + ", record one with --perf-record!");
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    std::string text = buffer.str();
+
+    json_value root = json_parser(text).parse();
+    perf_results results;
+    results.device = root.at("device").string;
+    results.extent.width = static_cast<std::uint32_t>(root.at("width").number);
+    results.extent.height = static_cast<std::uint32_t>(root.at("height").number);
+    results.frames = static_cast<std::uint32_t>(root.at("frames").number);
+    for (const auto &item : root.at("runs").items) {
+        perf_run run;
+        run.startup_ms = item.at("startup_ms").number;
+        run.median_frame_ms = item.at("median_frame_ms").number;
+        run.p99_frame_ms = item.at("p99_frame_ms").number;
+        run.peak_memory_mib = item.at("peak_memory_mib").number;
+        results.runs.push_back(run);
+    }
+
+    if (results.extent.width == 0 || results.extent.height == 0 || results.frames == 0 || results.runs.size() < 2) {
+        throw std::runtime_error("Baseline " + path + " does not describe a usable scenario!");
+    }
+    return results;
+}
+
+// Upper tail of the normal approximation to the Mann-Whitney U distribution,
+// with continuity correction; tie_term sums t³ - t over groups of t ties
+static double mann_whitney_tail(double u, std::size_t baseline_size, std::size_t candidate_size, double tie_term) {
+    double n1 = static_cast<double>(baseline_size);
+    double n2 = static_cast<double>(candidate_size);
+    double n = n1 + n2;
+    double variance = n1 * n2 / 12.0 * ((n + 1.0) - tie_term / (n * (n - 1.0)));
+    if (variance <= 0.0) {
+        return 1.0;
+    }
+
+    double z = (u - n1 * n2 / 2.0 - 0.5) / std::sqrt(variance);
+    return 0.5 * std::erfc(z / std::sqrt(2.0));
+}
+
+// One-sided p-value for the candidate samples tending to be larger than the
+// baseline ones, from the normal approximation to the Mann-Whitney U
+// distribution with tie and continuity corrections
+static double mann_whitney_greater(const std::vector<double> &baseline, const std::vector<double> &candidate) {
+    std::vector<std::pair<double, bool>> pooled;
+    for (double value : baseline) pooled.emplace_back(value, false);
+    for (double value : candidate) pooled.emplace_back(value, true);
+    std::sort(pooled.begin(), pooled.end());
+
+    double candidate_rank_sum = 0.0;
+    double tie_term = 0.0;
+    for (std::size_t i = 0; i < pooled.size();) {
+        std::size_t j = i;
+        while (j < pooled.size() && pooled[j].first == pooled[i].first) {
+            j++;
+        }
+        // Ties share the average of their ranks
+        double rank = 0.5 * (i + 1 + j);
+        for (std::size_t k = i; k < j; k++) {
+            if (pooled[k].second) {
+                candidate_rank_sum += rank;
+            }
+        }
+        double tied = static_cast<double>(j - i);
+        tie_term += tied * tied * tied - tied;
+        i = j;
+    }
+
+    double n2 = static_cast<double>(candidate.size());
+    double u = candidate_rank_sum - n2 * (n2 + 1.0) / 2.0;
+    return mann_whitney_tail(u, baseline.size(), candidate.size(), tie_term);
+}
+
+// The p-value when every candidate sample is above every baseline one. With
+// few runs even that is not significant, and nothing could ever regress.
+static void check_run_counts(std::size_t baseline_runs, std::size_t candidate_runs) {
+    double smallest_p = mann_whitney_tail(static_cast<double>(baseline_runs) * candidate_runs, baseline_runs, candidate_runs, 0.0);
+    if (smallest_p >= PERF_SIGNIFICANCE) {
+        throw std::runtime_error("Comparing " + std::to_string(baseline_runs) + " baseline and " +
+                std::to_string(candidate_runs) + " candidate runs can never show a significant regression, use more runs!");
+    }
+}
+
+// Prints a report row; true if the metric regressed
+static bool compare_metric(const char *name, const std::vector<double> &baseline, const std::vector<double> &candidate,
+        double threshold, bool needs_significance, bool gated) {
+    double baseline_median = median(baseline);
+    double candidate_median = median(candidate);
+    double change = baseline_median > 0.0 ? (candidate_median - baseline_median) / baseline_median : 0.0;
+    double p_value = mann_whitney_greater(baseline, candidate);
+
+    bool regressed = gated && change > threshold && (!needs_significance || p_value < PERF_SIGNIFICANCE);
+    const char *verdict = !gated ? "info" : regressed ? "REGRESSED" : "ok";
+
+    std::cout << std::left << std::setw(22) << name << std::right << std::fixed << std::setprecision(3)
+        << std::setw(12) << baseline_median << std::setw(12) << candidate_median
+        << std::showpos << std::setprecision(1) << std::setw(9) << change * 100.0 << "%" << std::noshowpos
+        << std::setprecision(4) << std::setw(10) << p_value << "  " << verdict << std::endl;
+    std::cout.unsetf(std::ios::floatfield);
+    return regressed;
+}
+
+void record_perf_baseline(const std::string &path, std::uint32_t runs, std::uint32_t frames, VkExtent2D extent) {
+    // Checks are usually run with as many runs as the baseline has
+    check_run_counts(runs, runs);
+    std::string device = warm_up(frames, extent);
+    perf_results results = measure(device, runs, frames, extent);
+    write_baseline(path, results);
+    std::cout << "Wrote the baseline to " << path << std::endl;
+}
+
+void run_perf_check(const std::string &baseline_path, std::uint32_t runs) {
+    perf_results baseline = read_baseline(baseline_path);
+    check_run_counts(baseline.runs.size(), runs);
+
+    std::string device = warm_up(baseline.frames, baseline.extent);
+    if (device != baseline.device) {
+        throw std::runtime_error("Baseline was recorded on " + baseline.device + ", not on " + device + "!");
+    }
+    perf_results candidate = measure(device, runs, baseline.frames, baseline.extent);
+
+    auto collect = [](const perf_results &results, double perf_run::*metric) {
+        std::vector<double> values;
+        for (const auto &run : results.runs) {
+            values.push_back(run.*metric);
+        }
+        return values;
+    };
+
+    std::cout << "\nMedians over " << baseline.runs.size() << " baseline and " << candidate.runs.size()
+        << " candidate runs, one-sided Mann-Whitney p-values:\n"
+        << std::left << std::setw(22) << "metric" << std::right << std::setw(12) << "baseline" << std::setw(12)
+        << "candidate" << std::setw(10) << "change" << std::setw(10) << "p" << "  result" << std::endl;
+
+    std::vector<std::string> regressions;
+    if (compare_metric("startup (ms)", collect(baseline, &perf_run::startup_ms), collect(candidate, &perf_run::startup_ms),
+            PERF_STARTUP_THRESHOLD, true, true)) {
+        regressions.push_back("startup time");
+    }
+    compare_metric("median frame (ms)", collect(baseline, &perf_run::median_frame_ms),
+            collect(candidate, &perf_run::median_frame_ms), PERF_FRAME_TIME_THRESHOLD, true, false);
+    if (compare_metric("p99 frame (ms)", collect(baseline, &perf_run::p99_frame_ms),
+            collect(candidate, &perf_run::p99_frame_ms), PERF_FRAME_TIME_THRESHOLD, true, true)) {
+        regressions.push_back("p99 frame time");
+    }
+    // Peak memory is close to identical from run to run, so the test has
+    // little to work with; the threshold alone decides
+    if (compare_metric("peak memory (MiB)", collect(baseline, &perf_run::peak_memory_mib),
+            collect(candidate, &perf_run::peak_memory_mib), PERF_MEMORY_THRESHOLD, false, true)) {
+        regressions.push_back("memory use");
+    }
+
+    if (!regressions.empty()) {
+        std::string list;
+        for (const auto &regression : regressions) {
+            list += (list.empty() ? "" : ", ") + regression;
+        }
+        throw std::runtime_error("Performance regressed against " + baseline_path + ": " + list + "!");
+    }
+    std::cout << "No regressions against " << baseline_path << std::endl;
+}
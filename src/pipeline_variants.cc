@@ -0,0 +1,254 @@
+#include "pipeline_variants.h"
+#include "vulkan_utils.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+bool pipeline_key::operator==(const pipeline_key &other) const {
+    return cull_mode == other.cull_mode && front_face == other.front_face && samples == other.samples &&
+        blend == other.blend && depth_test == other.depth_test && material == other.material;
+}
+
+std::size_t pipeline_key_hash::operator()(const pipeline_key &key) const {
+    // Every field is small, so packing them into one word loses nothing
+    std::uint64_t packed = static_cast<std::uint64_t>(key.cull_mode) |
+        static_cast<std::uint64_t>(key.front_face) << 4 |
+        static_cast<std::uint64_t>(key.samples) << 8 |
+        static_cast<std::uint64_t>(key.blend) << 16 |
+        static_cast<std::uint64_t>(key.depth_test) << 17 |
+        static_cast<std::uint64_t>(key.material) << 32;
+    return std::hash<std::uint64_t>()(packed);
+}
+
+void pipeline_variants::init(VkDevice device, VkPipelineCache pipeline_cache, VkPipelineLayout layout,
+        VkRenderPass render_pass, const std::string &vert_shader_file, const std::string &frag_shader_file,
+        std::vector<VkVertexInputBindingDescription> vertex_bindings,
+        std::vector<VkVertexInputAttributeDescription> vertex_attributes) {
+    this->device = device;
+    this->pipeline_cache = pipeline_cache;
+    this->layout = layout;
+    this->render_pass = render_pass;
+    this->vert_shader_file = vert_shader_file;
+    const std::string mesh_suffix = ".mesh.spv";
+    mesh_shader = vert_shader_file.size() >= mesh_suffix.size() &&
+        vert_shader_file.compare(vert_shader_file.size() - mesh_suffix.size(), mesh_suffix.size(), mesh_suffix) == 0;
+    this->vertex_bindings = std::move(vertex_bindings);
+    this->vertex_attributes = std::move(vertex_attributes);
+
+    vert_shader_module = unique_shader_module(device, create_shader_module(device, read_file(vert_shader_file)));
+    frag_shader_module = unique_shader_module(device, create_shader_module(device, read_file(frag_shader_file)));
+}
+
+void pipeline_variants::cleanup() {
+    pipelines.clear();
+    frag_shader_module.reset();
+    vert_shader_module.reset();
+}
+
+void pipeline_variants::precompile(const std::vector<pipeline_key> &keys) {
+    std::vector<pipeline_key> missing;
+    for (const auto &key : keys) {
+        if (pipelines.count(key) == 0 && std::find(missing.begin(), missing.end(), key) == missing.end()) {
+            missing.push_back(key);
+        }
+    }
+    if (missing.empty()) {
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    // Workers take keys in turn and fill in their own slots, so the map is
+    // only touched on this thread once they are done. The pipeline cache is
+    // internally synchronized.
+    std::vector<unique_pipeline> created(missing.size());
+    std::atomic<std::size_t> next_key{0};
+    std::uint32_t thread_count = std::min<std::size_t>(std::max(1u, std::thread::hardware_concurrency()), missing.size());
+
+    std::vector<std::exception_ptr> errors(thread_count);
+    std::vector<std::thread> threads;
+    for (std::uint32_t i = 0; i < thread_count; i++) {
+        threads.emplace_back([&, i]() {
+            try {
+                for (std::size_t k = next_key++; k < missing.size(); k = next_key++) {
+                    created[k] = create_pipeline(missing[k]);
+                }
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    for (auto &error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    for (std::size_t k = 0; k < missing.size(); k++) {
+        pipelines.emplace(missing[k], std::move(created[k]));
+    }
+
+    double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Precompiled " << missing.size() << " pipeline variants of " << vert_shader_file << " in "
+        << elapsed_ms << " ms on " << thread_count << " threads" << std::endl;
+}
+
+VkPipeline pipeline_variants::get(const pipeline_key &key) {
+    auto it = pipelines.find(key);
+    if (it != pipelines.end()) {
+        return it->second;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    it = pipelines.emplace(key, create_pipeline(key)).first;
+    late_compiles++;
+
+    double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Compiled a pipeline variant of " << vert_shader_file << " on first use (material " << key.material
+        << ", " << key.samples << "x MSAA, " << (key.blend ? "blended" : "opaque") << ") in " << elapsed_ms << " ms"
+        << std::endl;
+
+    return it->second;
+}
+
+unique_pipeline pipeline_variants::create_pipeline(const pipeline_key &key) const {
+    VkSpecializationMapEntry material_entry{};
+    material_entry.constantID = 0;
+    material_entry.offset = 0;
+    material_entry.size = sizeof(std::uint32_t);
+
+    VkSpecializationInfo specialization_info{};
+    specialization_info.mapEntryCount = 1;
+    specialization_info.pMapEntries = &material_entry;
+    specialization_info.dataSize = sizeof(std::uint32_t);
+    specialization_info.pData = &key.material;
+
+    VkPipelineShaderStageCreateInfo vert_shader_stage_info{};
+    vert_shader_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    vert_shader_stage_info.stage = mesh_shader ? VK_SHADER_STAGE_MESH_BIT_EXT : VK_SHADER_STAGE_VERTEX_BIT;
+    vert_shader_stage_info.module = vert_shader_module;
+    vert_shader_stage_info.pName = "main";
+
+    VkPipelineShaderStageCreateInfo frag_shader_stage_info{};
+    frag_shader_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    frag_shader_stage_info.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    frag_shader_stage_info.module = frag_shader_module;
+    frag_shader_stage_info.pName = "main";
+    frag_shader_stage_info.pSpecializationInfo = &specialization_info;
+
+    VkPipelineShaderStageCreateInfo shader_stages[] = {
+        vert_shader_stage_info, frag_shader_stage_info
+    };
+
+    std::vector<VkDynamicState> dynamic_states = {
+        VK_DYNAMIC_STATE_VIEWPORT,
+        VK_DYNAMIC_STATE_SCISSOR
+    };
+
+    VkPipelineDynamicStateCreateInfo dynamic_state{};
+    dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamic_state.dynamicStateCount = dynamic_states.size();
+    dynamic_state.pDynamicStates = dynamic_states.data();
+
+    VkPipelineVertexInputStateCreateInfo vertex_input_info{};
+    vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertex_input_info.vertexBindingDescriptionCount = vertex_bindings.size();
+    vertex_input_info.pVertexBindingDescriptions = vertex_bindings.data();
+    vertex_input_info.vertexAttributeDescriptionCount = vertex_attributes.size();
+    vertex_input_info.pVertexAttributeDescriptions = vertex_attributes.data();
+
+    VkPipelineInputAssemblyStateCreateInfo input_assembly{};
+    input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    input_assembly.primitiveRestartEnable = VK_FALSE;
+
+    VkPipelineViewportStateCreateInfo viewport_state{};
+    viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewport_state.viewportCount = 1;
+    viewport_state.scissorCount = 1;
+
+    VkPipelineRasterizationStateCreateInfo rasterizer{};
+    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.depthClampEnable = VK_FALSE;
+    rasterizer.rasterizerDiscardEnable = VK_FALSE;
+    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizer.lineWidth = 1.0f;
+    rasterizer.cullMode = key.cull_mode;
+    rasterizer.frontFace = key.front_face;
+    rasterizer.depthBiasEnable = VK_FALSE;
+
+    VkPipelineMultisampleStateCreateInfo multisampling{};
+    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.sampleShadingEnable = VK_FALSE;
+    multisampling.rasterizationSamples = key.samples;
+    multisampling.minSampleShading = 1.0f;
+
+    // Ignored by subpasses without a depth attachment
+    VkPipelineDepthStencilStateCreateInfo depth_stencil{};
+    depth_stencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depth_stencil.depthTestEnable = key.depth_test ? VK_TRUE : VK_FALSE;
+    depth_stencil.depthWriteEnable = key.depth_test ? VK_TRUE : VK_FALSE;
+    depth_stencil.depthCompareOp = VK_COMPARE_OP_LESS;
+    depth_stencil.depthBoundsTestEnable = VK_FALSE;
+    depth_stencil.stencilTestEnable = VK_FALSE;
+
+    VkPipelineColorBlendAttachmentState color_blend_attachment{};
+    color_blend_attachment.colorWriteMask =
+        VK_COLOR_COMPONENT_R_BIT |
+        VK_COLOR_COMPONENT_G_BIT |
+        VK_COLOR_COMPONENT_B_BIT |
+        VK_COLOR_COMPONENT_A_BIT;
+    color_blend_attachment.blendEnable = key.blend ? VK_TRUE : VK_FALSE;
+    color_blend_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    color_blend_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    color_blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;
+    color_blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    color_blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+    color_blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+    VkPipelineColorBlendStateCreateInfo color_blending{};
+    color_blending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    color_blending.logicOpEnable = VK_FALSE;
+    color_blending.attachmentCount = 1;
+    color_blending.pAttachments = &color_blend_attachment;
+
+    VkGraphicsPipelineCreateInfo pipeline_info{};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipeline_info.stageCount = 2;
+    pipeline_info.pStages = shader_stages;
+    // Mesh shaders assemble their own primitives
+    pipeline_info.pVertexInputState = mesh_shader ? nullptr : &vertex_input_info;
+    pipeline_info.pInputAssemblyState = mesh_shader ? nullptr : &input_assembly;
+    pipeline_info.pViewportState = &viewport_state;
+    pipeline_info.pRasterizationState = &rasterizer;
+    pipeline_info.pMultisampleState = &multisampling;
+    pipeline_info.pDepthStencilState = &depth_stencil;
+    pipeline_info.pColorBlendState = &color_blending;
+    pipeline_info.pDynamicState = &dynamic_state;
+    pipeline_info.layout = layout;
+    pipeline_info.renderPass = render_pass;
+    pipeline_info.subpass = 0;
+    pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
+    pipeline_info.basePipelineIndex = -1;
+
+    unique_pipeline pipeline;
+    if (vkCreateGraphicsPipelines(device, pipeline_cache, 1, &pipeline_info, nullptr, pipeline.put(device)) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create graphics pipeline!");
+    }
+
+    return pipeline;
+}
@@ -0,0 +1,276 @@
+#include "procedural_geometry.h"
+#include "config.h"
+#include "vulkan_utils.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Matches PATTERN_* in tessellation.glsl
+static const std::uint32_t PATTERN_UNIFORM = 0;
+static const std::uint32_t PATTERN_SIERPINSKI = 1;
+
+// One packed R16G16_SNORM position per vertex
+static const VkDeviceSize TESSELLATED_VERTEX_SIZE = 4;
+static const VkDeviceSize TESSELLATED_TRIANGLE_SIZE = 3 * TESSELLATED_VERTEX_SIZE;
+
+// Every driver can allocate this much at once (maxMemoryAllocationSize)
+static const VkDeviceSize MAX_CHUNK_SIZE = VkDeviceSize(1) << 30;
+
+std::uint32_t tessellation_settings::triangle_count() const {
+    std::uint64_t count = 1;
+    if (sierpinski) {
+        for (std::uint32_t level = 0; level < detail && count <= UINT32_MAX; level++) {
+            count *= 3;
+        }
+    } else {
+        count = static_cast<std::uint64_t>(detail) * detail;
+    }
+
+    // Every vertex is drawn on its own, so the vertex count has to fit too
+    if (count * 3 > UINT32_MAX) {
+        throw std::runtime_error("Tessellation is too fine to draw!");
+    }
+    return static_cast<std::uint32_t>(count);
+}
+
+bool split_dispatch(std::uint64_t group_count, const std::uint32_t max_counts[3], std::uint32_t counts[2]) {
+    counts[0] = static_cast<std::uint32_t>(std::min<std::uint64_t>(std::max<std::uint64_t>(group_count, 1), max_counts[0]));
+    std::uint64_t rows = (group_count + counts[0] - 1) / counts[0];
+    counts[1] = static_cast<std::uint32_t>(std::max<std::uint64_t>(rows, 1));
+    return rows <= max_counts[1];
+}
+
+tessellation_parameters make_tessellation_parameters(const tessellation_settings &settings, std::uint32_t groups_per_row) {
+    tessellation_parameters parameters;
+    parameters.pattern = settings.sierpinski ? PATTERN_SIERPINSKI : PATTERN_UNIFORM;
+    parameters.detail = settings.detail;
+    parameters.triangle_count = settings.triangle_count();
+    parameters.groups_per_row = groups_per_row;
+    parameters.first_triangle = 0;
+    return parameters;
+}
+
+gpu_tessellation generate_tessellation(VkPhysicalDevice physical_device, VkDevice device, VkQueue queue,
+        std::uint32_t queue_family, const tessellation_settings &settings) {
+    auto start = std::chrono::steady_clock::now();
+
+    std::uint32_t triangle_count = settings.triangle_count();
+    VkDeviceSize buffer_size = static_cast<VkDeviceSize>(triangle_count) * TESSELLATED_TRIANGLE_SIZE;
+
+    // The shader sees one chunk at a time through a storage buffer, so no
+    // chunk can be larger than the range one may have
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+    VkDeviceSize max_chunk_size = std::min<VkDeviceSize>(properties.limits.maxStorageBufferRange, MAX_CHUNK_SIZE);
+    std::uint32_t chunk_triangles = static_cast<std::uint32_t>(max_chunk_size / TESSELLATED_TRIANGLE_SIZE);
+    if (chunk_triangles == 0) {
+        throw std::runtime_error("Tessellated vertices do not fit in a storage buffer!");
+    }
+    std::uint32_t chunk_count = static_cast<std::uint32_t>(
+            (static_cast<std::uint64_t>(triangle_count) + chunk_triangles - 1) / chunk_triangles);
+
+    gpu_tessellation tessellation;
+    std::vector<tessellation_parameters> chunk_parameters;
+    std::vector<std::array<std::uint32_t, 2>> chunk_group_counts;
+    for (std::uint32_t chunk = 0; chunk < chunk_count; chunk++) {
+        std::uint32_t first = chunk * chunk_triangles;
+        std::uint32_t count = std::min(chunk_triangles, triangle_count - first);
+
+        std::array<std::uint32_t, 2> group_counts;
+        std::uint64_t group_count = (count + TESSELLATION_COMPUTE_GROUP_SIZE - 1) / TESSELLATION_COMPUTE_GROUP_SIZE;
+        if (!split_dispatch(group_count, properties.limits.maxComputeWorkGroupCount, group_counts.data())) {
+            throw std::runtime_error("Tessellation needs too many compute work groups!");
+        }
+
+        tessellation_parameters parameters = make_tessellation_parameters(settings, group_counts[0]);
+        parameters.first_triangle = first;
+        parameters.triangle_count = first + count;
+        chunk_parameters.push_back(parameters);
+        chunk_group_counts.push_back(group_counts);
+
+        VkBuffer buffer;
+        VkDeviceMemory buffer_memory;
+        create_buffer(physical_device, device, static_cast<VkDeviceSize>(count) * TESSELLATED_TRIANGLE_SIZE,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0,
+                buffer, buffer_memory);
+
+        tessellation_chunk output;
+        output.buffer = unique_buffer(device, buffer);
+        output.buffer_memory = unique_device_memory(device, buffer_memory);
+        output.vertex_count = count * 3;
+        tessellation.chunks.push_back(std::move(output));
+    }
+
+    // Everything but the buffers only lives for the pre-pass
+    VkDescriptorSetLayoutBinding binding{};
+    binding.binding = 0;
+    binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    binding.descriptorCount = 1;
+    binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutCreateInfo layout_info{};
+    layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_info.bindingCount = 1;
+    layout_info.pBindings = &binding;
+
+    unique_descriptor_set_layout set_layout;
+    if (vkCreateDescriptorSetLayout(device, &layout_info, nullptr, set_layout.put(device)) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create tessellation descriptor set layout!");
+    }
+
+    VkPushConstantRange push_constant_range{};
+    push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    push_constant_range.offset = 0;
+    push_constant_range.size = sizeof(tessellation_parameters);
+
+    VkDescriptorSetLayout set_layouts[] = { set_layout };
+    VkPipelineLayoutCreateInfo pipeline_layout_info{};
+    pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipeline_layout_info.setLayoutCount = 1;
+    pipeline_layout_info.pSetLayouts = set_layouts;
+    pipeline_layout_info.pushConstantRangeCount = 1;
+    pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+
+    unique_pipeline_layout pipeline_layout;
+    if (vkCreatePipelineLayout(device, &pipeline_layout_info, nullptr, pipeline_layout.put(device)) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create tessellation pipeline layout!");
+    }
+
+    unique_shader_module shader_module(device, create_shader_module(device, read_file("tessellate.comp.spv")));
+
+    VkComputePipelineCreateInfo pipeline_info{};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipeline_info.stage.module = shader_module;
+    pipeline_info.stage.pName = "main";
+    pipeline_info.layout = pipeline_layout;
+
+    unique_pipeline pipeline;
+    if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, pipeline.put(device)) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create tessellation pipeline!");
+    }
+
+    VkDescriptorPoolSize pool_size{};
+    pool_size.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    pool_size.descriptorCount = chunk_count;
+
+    VkDescriptorPoolCreateInfo descriptor_pool_info{};
+    descriptor_pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    descriptor_pool_info.poolSizeCount = 1;
+    descriptor_pool_info.pPoolSizes = &pool_size;
+    descriptor_pool_info.maxSets = chunk_count;
+
+    unique_descriptor_pool descriptor_pool;
+    if (vkCreateDescriptorPool(device, &descriptor_pool_info, nullptr, descriptor_pool.put(device)) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create tessellation descriptor pool!");
+    }
+
+    std::vector<VkDescriptorSetLayout> chunk_set_layouts(chunk_count, set_layout);
+    VkDescriptorSetAllocateInfo set_alloc_info{};
+    set_alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    set_alloc_info.descriptorPool = descriptor_pool;
+    set_alloc_info.descriptorSetCount = chunk_count;
+    set_alloc_info.pSetLayouts = chunk_set_layouts.data();
+
+    std::vector<VkDescriptorSet> descriptor_sets(chunk_count);
+    if (vkAllocateDescriptorSets(device, &set_alloc_info, descriptor_sets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate tessellation descriptor sets!");
+    }
+
+    std::vector<VkDescriptorBufferInfo> buffer_infos(chunk_count);
+    std::vector<VkWriteDescriptorSet> descriptor_writes(chunk_count);
+    for (std::uint32_t chunk = 0; chunk < chunk_count; chunk++) {
+        buffer_infos[chunk].buffer = tessellation.chunks[chunk].buffer;
+        buffer_infos[chunk].offset = 0;
+        buffer_infos[chunk].range = VK_WHOLE_SIZE;
+
+        descriptor_writes[chunk].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptor_writes[chunk].dstSet = descriptor_sets[chunk];
+        descriptor_writes[chunk].dstBinding = 0;
+        descriptor_writes[chunk].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptor_writes[chunk].descriptorCount = 1;
+        descriptor_writes[chunk].pBufferInfo = &buffer_infos[chunk];
+    }
+    vkUpdateDescriptorSets(device, chunk_count, descriptor_writes.data(), 0, nullptr);
+
+    VkCommandPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    pool_info.queueFamilyIndex = queue_family;
+
+    unique_command_pool command_pool;
+    if (vkCreateCommandPool(device, &pool_info, nullptr, command_pool.put(device)) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create tessellation command pool!");
+    }
+
+    VkCommandBuffer command_buffer;
+    VkCommandBufferAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    alloc_info.commandPool = command_pool;
+    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    alloc_info.commandBufferCount = 1;
+    if (vkAllocateCommandBuffers(device, &alloc_info, &command_buffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate tessellation command buffer!");
+    }
+
+    VkCommandBufferBeginInfo begin_info{};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(command_buffer, &begin_info);
+
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    for (std::uint32_t chunk = 0; chunk < chunk_count; chunk++) {
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout, 0, 1, &descriptor_sets[chunk],
+                0, nullptr);
+        vkCmdPushConstants(command_buffer, pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(tessellation_parameters),
+                &chunk_parameters[chunk]);
+        vkCmdDispatch(command_buffer, chunk_group_counts[chunk][0], chunk_group_counts[chunk][1], 1);
+    }
+
+    // Covers every chunk, and the draws in later submissions too
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0,
+            1, &barrier, 0, nullptr, 0, nullptr);
+
+    if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to record tessellation pre-pass!");
+    }
+
+    VkFenceCreateInfo fence_info{};
+    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+    unique_fence fence;
+    if (vkCreateFence(device, &fence_info, nullptr, fence.put(device)) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create tessellation fence!");
+    }
+
+    VkSubmitInfo submit_info{};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &command_buffer;
+
+    VkFence submit_fence = fence;
+    if (vkQueueSubmit(queue, 1, &submit_info, submit_fence) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to submit tessellation pre-pass!");
+    }
+    vkWaitForFences(device, 1, &submit_fence, VK_TRUE, std::numeric_limits<std::uint64_t>::max());
+
+    double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Tessellated the triangle into " << triangle_count << " triangles ("
+        << buffer_size / (1024.0 * 1024.0) << " MiB of vertices in " << chunk_count << " buffer(s)) with a compute pre-pass in "
+        << elapsed_ms << " ms" << std::endl;
+
+    return tessellation;
+}
@@ -0,0 +1,133 @@
+#include "rasterizer_check.h"
+#include "batch_renderer.h"
+#include "cpu_rasterizer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Coverage has to match exactly; interpolated colors may be rounded to a
+// neighbouring value by the device
+static const int COLOR_TOLERANCE = 1;
+
+struct check_scene {
+    const char *name;
+    VkExtent2D extent;
+    float offset[2];
+    float scale;
+    float rotation_degrees;
+};
+
+static std::vector<render_job> check_jobs(VkExtent2D extent) {
+    // Sizes divisible by 4 put the default triangle's vertices on pixel
+    // corners and its edges through pixel centers, which exercises the
+    // tie-breaking rule; odd sizes and transforms give arbitrary slopes
+    const check_scene scenes[] = {
+        { "requested size", extent, { 0.0f, 0.0f }, 1.0f, 0.0f },
+        { "pixel-aligned", { 64, 64 }, { 0.0f, 0.0f }, 1.0f, 0.0f },
+        { "odd size", { 257, 131 }, { 0.0f, 0.0f }, 1.0f, 0.0f },
+        { "offset and scaled", { 640, 480 }, { 0.13f, -0.27f }, 1.7f, 0.0f },
+        { "rotated", { 333, 777 }, { -0.4f, 0.2f }, 0.6f, 33.0f },
+        { "upside down", { 800, 600 }, { 0.0f, 0.0f }, 1.0f, 180.0f },
+        { "covering", { 1280, 720 }, { 0.0f, 0.3f }, 5.0f, 0.0f },
+        { "single pixel", { 1, 1 }, { 0.0f, 0.0f }, 1.0f, 0.0f },
+    };
+
+    std::vector<render_job> jobs;
+    for (const auto &scene : scenes) {
+        render_job job;
+        job.output_path = scene.name;
+        job.extent = scene.extent;
+        job.transform.offset[0] = scene.offset[0];
+        job.transform.offset[1] = scene.offset[1];
+        job.transform.scale = scene.scale;
+        job.transform.rotation = scene.rotation_degrees * static_cast<float>(M_PI / 180.0);
+        jobs.push_back(job);
+    }
+
+    return jobs;
+}
+
+static void compare_images(const std::vector<render_job> &jobs, cpu_rasterizer &rasterizer) {
+    std::vector<std::vector<std::uint8_t>> device_images(jobs.size());
+    batch_renderer device_renderer;
+    device_renderer.render(jobs, [&](completed_job &result) {
+        if (!result.error.empty()) {
+            throw std::runtime_error("Failed to render " + result.job.output_path + ": " + result.error);
+        }
+        device_images[result.job.id] = std::move(result.pixels);
+    });
+
+    std::cout << std::setw(20) << "scene" << std::setw(12) << "size" << std::setw(12) << "mismatches"
+        << std::setw(16) << "max difference" << std::endl;
+
+    bool failed = false;
+    std::vector<std::uint8_t> cpu_image;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        const render_job &job = jobs[i];
+        rasterizer.render(job.transform, job.clear_color, job.extent.width, job.extent.height, cpu_image);
+
+        size_t mismatches = 0;
+        int max_difference = 0;
+        for (size_t pixel = 0; pixel < cpu_image.size(); pixel += 4) {
+            int pixel_difference = 0;
+            for (size_t channel = pixel; channel < pixel + 4; channel++) {
+                pixel_difference = std::max(pixel_difference,
+                        std::abs(static_cast<int>(cpu_image[channel]) - static_cast<int>(device_images[i][channel])));
+            }
+            if (pixel_difference != 0) {
+                mismatches++;
+            }
+            max_difference = std::max(max_difference, pixel_difference);
+        }
+        failed = failed || max_difference > COLOR_TOLERANCE;
+
+        std::cout << std::setw(20) << job.output_path
+            << std::setw(12) << (std::to_string(job.extent.width) + "x" + std::to_string(job.extent.height))
+            << std::setw(12) << mismatches << std::setw(16) << max_difference << std::endl;
+    }
+
+    if (failed) {
+        throw std::runtime_error("CPU rasterizer output does not match the device!");
+    }
+}
+
+static void compare_throughput(std::uint32_t frames, VkExtent2D extent, cpu_rasterizer &rasterizer) {
+    render_job job;
+    job.output_path = "benchmark";
+    job.extent = extent;
+
+    // Device frames include the copy back to host memory, which the CPU
+    // rasterizer gets for free
+    batch_renderer device_renderer;
+    auto start = std::chrono::steady_clock::now();
+    device_renderer.render(std::vector<render_job>(frames, job), [](completed_job &) {});
+    double device_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<std::uint8_t> pixels;
+    start = std::chrono::steady_clock::now();
+    for (std::uint32_t i = 0; i < frames; i++) {
+        rasterizer.render(job.transform, job.clear_color, extent.width, extent.height, pixels);
+    }
+    double cpu_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << std::fixed << std::setprecision(1)
+        << "Rendered and read back " << frames << " frames of " << extent.width << "x" << extent.height << "\n"
+        << "  Vulkan device: " << frames / device_seconds << " frames/s\n"
+        << "  CPU (" << rasterizer.kernel_name() << ", " << rasterizer.thread_count() << " thread(s)): "
+        << frames / cpu_seconds << " frames/s" << std::endl;
+}
+
+void run_rasterizer_check(std::uint32_t frames, VkExtent2D extent) {
+    cpu_rasterizer rasterizer;
+
+    compare_images(check_jobs(extent), rasterizer);
+    compare_throughput(frames, extent, rasterizer);
+}
@@ -0,0 +1,31 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "occlusion_scene.glsl"
+
+layout(push_constant) uniform draw_parameters {
+    float time;
+    // Where the drawing phase's list starts in instances
+    uint first_instance;
+} parameters;
+
+// Filled by occlusion_cull.comp
+layout(std430, set = 0, binding = 0) readonly buffer instance_lists {
+    uint instances[];
+};
+
+vec3 colors[3] = vec3[](
+    vec3(1.0, 0.0, 0.0),
+    vec3(0.0, 1.0, 0.0),
+    vec3(0.0, 0.0, 1.0)
+);
+
+layout(location = 0) out vec3 fragColor;
+
+void main() {
+    scene_instance instance = make_instance(instances[parameters.first_instance + gl_InstanceIndex], parameters.time);
+
+    gl_Position = vec4(instance_corner(instance, gl_VertexIndex), instance.depth, 1.0);
+    // Farther instances are darker
+    fragColor = colors[gl_VertexIndex] * (1.0 - 0.7 * instance.depth);
+}
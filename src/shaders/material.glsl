@@ -0,0 +1,14 @@
+// Shared by the fragment shaders built into pipeline variants
+
+// Pipeline variant, see MATERIAL_* in config.h: 0 opaque, 1 greyscale,
+// 2 half transparent (drawn with blending)
+layout(constant_id = 0) const uint material = 0;
+
+vec4 apply_material(vec4 color) {
+    if (material == 1) {
+        color.rgb = vec3(dot(color.rgb, vec3(0.2126, 0.7152, 0.0722)));
+    } else if (material == 2) {
+        color.a *= 0.5;
+    }
+    return color;
+}
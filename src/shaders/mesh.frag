@@ -0,0 +1,13 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+layout(location = 0) in vec3 fragNormal;
+layout(location = 0) out vec4 outColor;
+
+#include "material.glsl"
+
+void main() {
+    vec3 normal = normalize(fragNormal);
+    float light = max(dot(normal, normalize(vec3(0.4, 0.8, 0.6))), 0.0);
+    outColor = apply_material(vec4((0.2 + 0.8 * light) * (normal * 0.5 + 0.5), 1.0));
+}
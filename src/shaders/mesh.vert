@@ -0,0 +1,29 @@
+#version 450
+
+// Fits the mesh's bounding sphere into the view and spins it around the
+// vertical axis
+layout(push_constant) uniform mesh_transform {
+    vec4 center_and_inverse_radius;
+    float rotation;
+    float aspect;
+} transform;
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inNormal;
+
+layout(location = 0) out vec3 fragNormal;
+
+vec3 rotate(vec3 v) {
+    float s = sin(transform.rotation);
+    float c = cos(transform.rotation);
+    return vec3(c * v.x + s * v.z, v.y, c * v.z - s * v.x);
+}
+
+void main() {
+    vec3 position = rotate((inPosition - transform.center_and_inverse_radius.xyz) * transform.center_and_inverse_radius.w);
+    vec2 fit = transform.aspect > 1.0 ? vec2(1.0 / transform.aspect, 1.0) : vec2(1.0, transform.aspect);
+
+    // Meshes are y-up, the framebuffer is y-down
+    gl_Position = vec4(position.x * fit.x, -position.y * fit.y, position.z * 0.5 + 0.5, 1.0);
+    fragNormal = rotate(inNormal);
+}
@@ -0,0 +1,66 @@
+// Shared by the occlusion culling shaders: where every instance of the dense
+// scene is, computed from its index and the time alone so the cull pass and
+// the vertex shader always agree
+
+struct scene_instance {
+    vec2 center;
+    float size;
+    float rotation;
+    // Every instance is a flat triangle facing the viewer at this depth
+    float depth;
+};
+
+// Every OCCLUDER_INTERVAL-th instance is a large triangle close to the viewer
+const uint OCCLUDER_INTERVAL = 256;
+
+const vec2 instance_positions[3] = vec2[](
+    vec2(0.0, -0.5),
+    vec2(0.5, 0.5),
+    vec2(-0.5, 0.5)
+);
+
+uint hash(uint x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+// Uniform in [0, 1), a different sequence for each stream
+float random(uint index, uint stream) {
+    return float(hash(index * 4u + stream) >> 8) / 16777216.0;
+}
+
+scene_instance make_instance(uint index, float time) {
+    scene_instance instance;
+    vec2 home = vec2(random(index, 0), random(index, 1)) * 2.0 - 1.0;
+    float phase = random(index, 2) * 6.2831853;
+
+    if (index % OCCLUDER_INTERVAL == 0) {
+        instance.size = 0.4 + 0.4 * random(index, 3);
+        instance.depth = 0.01 + 0.04 * random(index, 3);
+    } else {
+        instance.size = 0.01 + 0.03 * random(index, 3);
+        instance.depth = 0.1 + 0.9 * random(index, 3);
+    }
+
+    // Drifting keeps what is hidden changing from frame to frame
+    instance.center = home + 0.1 * vec2(cos(time * 0.5 + phase), sin(time * 0.5 + phase));
+    instance.rotation = time * 0.3 + phase;
+    return instance;
+}
+
+vec2 instance_corner(scene_instance instance, uint corner) {
+    float s = sin(instance.rotation);
+    float c = cos(instance.rotation);
+    return instance.center + mat2(c, s, -s, c) * (instance_positions[corner] * instance.size);
+}
+
+// Screen space bounds, xy the minimum and zw the maximum. No corner is
+// further than sqrt(0.5) * size from the center, however it is rotated.
+vec4 instance_bounds(scene_instance instance) {
+    float radius = instance.size * 0.7072;
+    return vec4(instance.center - radius, instance.center + radius);
+}
@@ -0,0 +1,31 @@
+#version 450
+
+vec2 positions[3] = vec2[](
+    vec2(0.0, -0.5),
+    vec2(0.5, 0.5),
+    vec2(-0.5, 0.5)
+);
+
+vec3 colors[3] = vec3[](
+    vec3(1.0, 0.0, 0.0),
+    vec3(0.0, 1.0, 0.0),
+    vec3(0.0, 0.0, 1.0)
+);
+
+// Placement of the triangle, set per frame by the headless renderers
+layout(push_constant) uniform scene_transform {
+    vec2 offset;
+    float scale;
+    float rotation;
+} transform;
+
+layout(location = 0) out vec3 fragColor;
+
+void main() {
+    float s = sin(transform.rotation);
+    float c = cos(transform.rotation);
+    vec2 position = mat2(c, s, -s, c) * (positions[gl_VertexIndex] * transform.scale);
+
+    gl_Position = vec4(position + transform.offset, 0.0, 1.0);
+    fragColor = colors[gl_VertexIndex];
+}
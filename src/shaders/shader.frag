@@ -1,8 +1,11 @@
 #version 450
+#extension GL_GOOGLE_include_directive : require
 
 layout(location = 0) in vec3 fragColor;
 layout(location = 0) out vec4 outColor;
 
+#include "material.glsl"
+
 void main() {
-    outColor = vec4(fragColor, 1.0);
+    outColor = apply_material(vec4(fragColor, 1.0));
 }
@@ -0,0 +1,14 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "tessellation.glsl"
+
+// Written by tessellate.comp
+layout(location = 0) in vec2 inPosition;
+
+layout(location = 0) out vec3 fragColor;
+
+void main() {
+    gl_Position = vec4(inPosition, 0.0, 1.0);
+    fragColor = corner_blend(inPosition);
+}
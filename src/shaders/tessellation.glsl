@@ -0,0 +1,96 @@
+// Shared by the tessellation shaders: the corners of any one of the small
+// triangles the scene triangle is subdivided into, computed from its index
+// alone so that work groups need no coordination
+
+const uint PATTERN_UNIFORM = 0;
+const uint PATTERN_SIERPINSKI = 1;
+
+// The same triangle shader.vert draws
+const vec2 corners[3] = vec2[](
+    vec2(0.0, -0.5),
+    vec2(0.5, 0.5),
+    vec2(-0.5, 0.5)
+);
+
+const vec3 corner_colors[3] = vec3[](
+    vec3(1.0, 0.0, 0.0),
+    vec3(0.0, 1.0, 0.0),
+    vec3(0.0, 0.0, 1.0)
+);
+
+// Point (row, column) of the lattice with segments rows below the top corner
+vec2 lattice_point(uint row, uint column, uint segments) {
+    return corners[0] + (corners[2] - corners[0]) * (float(row) / float(segments)) +
+        (corners[1] - corners[2]) * (float(column) / float(segments));
+}
+
+// Row r of a uniform subdivision holds triangles r² up to (r + 1)² - 1,
+// alternately pointing up and down. Corners keep the scene triangle's winding.
+void uniform_triangle(uint index, uint segments, out vec2 triangle[3]) {
+    uint row = uint(sqrt(float(index)));
+    // The float square root is inexact for large indices
+    if (row * row > index) {
+        row--;
+    } else if ((row + 1) * (row + 1) <= index) {
+        row++;
+    }
+
+    uint offset = index - row * row;
+    uint column = offset / 2;
+    if (offset % 2 == 0) {
+        triangle[0] = lattice_point(row, column, segments);
+        triangle[1] = lattice_point(row + 1, column + 1, segments);
+        triangle[2] = lattice_point(row + 1, column, segments);
+    } else {
+        triangle[0] = lattice_point(row, column, segments);
+        triangle[1] = lattice_point(row, column + 1, segments);
+        triangle[2] = lattice_point(row + 1, column + 1, segments);
+    }
+}
+
+// Each base 3 digit of the index picks the corner triangle to descend into
+void sierpinski_triangle(uint index, uint levels, out vec2 triangle[3]) {
+    vec2 a = corners[0];
+    vec2 b = corners[1];
+    vec2 c = corners[2];
+    for (uint level = 0; level < levels; level++) {
+        vec2 ab = (a + b) * 0.5;
+        vec2 bc = (b + c) * 0.5;
+        vec2 ca = (c + a) * 0.5;
+        uint digit = index % 3;
+        index /= 3;
+        if (digit == 0) {
+            b = ab;
+            c = ca;
+        } else if (digit == 1) {
+            a = ab;
+            c = bc;
+        } else {
+            a = ca;
+            b = bc;
+        }
+    }
+    triangle[0] = a;
+    triangle[1] = b;
+    triangle[2] = c;
+}
+
+void tessellated_triangle(uint pattern, uint detail, uint index, out vec2 triangle[3]) {
+    if (pattern == PATTERN_SIERPINSKI) {
+        sierpinski_triangle(index, detail, triangle);
+    } else {
+        uniform_triangle(index, detail, triangle);
+    }
+}
+
+// The color the scene triangle has at position, so the subdivision looks
+// like the plain triangle wherever it is filled
+vec3 corner_blend(vec2 position) {
+    vec2 e0 = corners[1] - corners[0];
+    vec2 e1 = corners[2] - corners[0];
+    vec2 p = position - corners[0];
+    float area = e0.x * e1.y - e0.y * e1.x;
+    float w1 = (p.x * e1.y - p.y * e1.x) / area;
+    float w2 = (e0.x * p.y - e0.y * p.x) / area;
+    return corner_colors[0] * (1.0 - w1 - w2) + corner_colors[1] * w1 + corner_colors[2] * w2;
+}
@@ -0,0 +1,18 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout(set = 0, binding = 0) uniform texture2D textures[];
+layout(set = 0, binding = 1) uniform sampler texture_sampler;
+
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragTexCoord;
+layout(location = 2) flat in uint fragTextureIndex;
+layout(location = 0) out vec4 outColor;
+
+#include "material.glsl"
+
+void main() {
+    vec4 texel = texture(sampler2D(textures[nonuniformEXT(fragTextureIndex)], texture_sampler), fragTexCoord);
+    outColor = apply_material(vec4(fragColor, 1.0) * texel);
+}
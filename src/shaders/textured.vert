@@ -0,0 +1,43 @@
+#version 450
+
+layout(push_constant) uniform push_constants {
+    uint instance_columns;
+} pc;
+
+// Bindless slot of the texture this instance samples
+layout(location = 0) in uint inTextureIndex;
+
+vec2 positions[3] = vec2[](
+    vec2(0.0, -0.5),
+    vec2(0.5, 0.5),
+    vec2(-0.5, 0.5)
+);
+
+vec3 colors[3] = vec3[](
+    vec3(1.0, 0.0, 0.0),
+    vec3(0.0, 1.0, 0.0),
+    vec3(0.0, 0.0, 1.0)
+);
+
+vec2 tex_coords[3] = vec2[](
+    vec2(0.5, 0.0),
+    vec2(1.0, 1.0),
+    vec2(0.0, 1.0)
+);
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) flat out uint fragTextureIndex;
+
+void main() {
+    // Instances are laid out on a square grid, one triangle per cell
+    uint column = gl_InstanceIndex % pc.instance_columns;
+    uint row = gl_InstanceIndex / pc.instance_columns;
+    float cell_size = 2.0 / float(pc.instance_columns);
+    vec2 cell_center = vec2(-1.0) + cell_size * (vec2(column, row) + 0.5);
+
+    gl_Position = vec4(cell_center + positions[gl_VertexIndex] * cell_size * 0.5, 0.0, 1.0);
+    fragColor = colors[gl_VertexIndex];
+    fragTexCoord = tex_coords[gl_VertexIndex];
+    fragTextureIndex = inTextureIndex;
+}
@@ -0,0 +1,157 @@
+#include "submission_scheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+void submission_scheduler::init(PFN_vkQueueSubmit2KHR queue_submit_2) {
+    this->queue_submit_2 = queue_submit_2;
+}
+
+void submission_scheduler::enqueue(VkQueue queue, submit_batch batch, VkFence fence) {
+    auto it = std::find_if(pending_queues.begin(), pending_queues.end(),
+            [queue](const queue_batches &pending) { return pending.queue == queue; });
+    if (it == pending_queues.end()) {
+        pending_queues.push_back({ queue, {}, VK_NULL_HANDLE });
+        it = pending_queues.end() - 1;
+    }
+
+    if (fence != VK_NULL_HANDLE) {
+        if (it->fence != VK_NULL_HANDLE) {
+            throw std::runtime_error("Only one fence can be submitted per queue and flush!");
+        }
+        it->fence = fence;
+    }
+    it->batches.push_back(std::move(batch));
+}
+
+void submission_scheduler::flush() {
+    // Timeline waits may be submitted before their signals, but binary ones
+    // may not, so the queues go in the order their first batch came in
+    for (const auto &pending : pending_queues) {
+        auto start = std::chrono::steady_clock::now();
+        if (queue_submit_2) {
+            submit_2(pending);
+        } else {
+            submit_1(pending);
+        }
+        submit_time += std::chrono::steady_clock::now() - start;
+
+        call_count++;
+        batch_count += pending.batches.size();
+        for (const auto &batch : pending.batches) {
+            command_buffer_count += batch.command_buffers.size();
+        }
+    }
+    pending_queues.clear();
+}
+
+void submission_scheduler::submit_2(const queue_batches &pending) {
+    // Sized up front, the submit infos point into them
+    std::vector<std::vector<VkSemaphoreSubmitInfoKHR>> waits(pending.batches.size());
+    std::vector<std::vector<VkSemaphoreSubmitInfoKHR>> signals(pending.batches.size());
+    std::vector<std::vector<VkCommandBufferSubmitInfoKHR>> command_buffers(pending.batches.size());
+    std::vector<VkSubmitInfo2KHR> submit_infos(pending.batches.size());
+
+    auto semaphore_info = [](const submit_semaphore &semaphore, VkPipelineStageFlags2KHR stage) {
+        VkSemaphoreSubmitInfoKHR info{};
+        info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO_KHR;
+        info.semaphore = semaphore.semaphore;
+        info.value = semaphore.value;
+        info.stageMask = stage;
+        return info;
+    };
+
+    for (size_t i = 0; i < pending.batches.size(); i++) {
+        const submit_batch &batch = pending.batches[i];
+
+        // The legacy stage bits have the same values in the 64-bit masks
+        for (const auto &wait : batch.waits) {
+            waits[i].push_back(semaphore_info(wait, wait.stage));
+        }
+        for (const auto &signal : batch.signals) {
+            signals[i].push_back(semaphore_info(signal, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR));
+        }
+        for (VkCommandBuffer command_buffer : batch.command_buffers) {
+            VkCommandBufferSubmitInfoKHR info{};
+            info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO_KHR;
+            info.commandBuffer = command_buffer;
+            command_buffers[i].push_back(info);
+        }
+
+        submit_infos[i].sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2_KHR;
+        submit_infos[i].waitSemaphoreInfoCount = waits[i].size();
+        submit_infos[i].pWaitSemaphoreInfos = waits[i].data();
+        submit_infos[i].commandBufferInfoCount = command_buffers[i].size();
+        submit_infos[i].pCommandBufferInfos = command_buffers[i].data();
+        submit_infos[i].signalSemaphoreInfoCount = signals[i].size();
+        submit_infos[i].pSignalSemaphoreInfos = signals[i].data();
+    }
+
+    if (queue_submit_2(pending.queue, submit_infos.size(), submit_infos.data(), pending.fence) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to submit command buffers!");
+    }
+}
+
+void submission_scheduler::submit_1(const queue_batches &pending) {
+    std::vector<std::vector<VkSemaphore>> wait_semaphores(pending.batches.size());
+    std::vector<std::vector<std::uint64_t>> wait_values(pending.batches.size());
+    std::vector<std::vector<VkPipelineStageFlags>> wait_stages(pending.batches.size());
+    std::vector<std::vector<VkSemaphore>> signal_semaphores(pending.batches.size());
+    std::vector<std::vector<std::uint64_t>> signal_values(pending.batches.size());
+    std::vector<VkTimelineSemaphoreSubmitInfo> timeline_infos(pending.batches.size());
+    std::vector<VkSubmitInfo> submit_infos(pending.batches.size());
+
+    for (size_t i = 0; i < pending.batches.size(); i++) {
+        const submit_batch &batch = pending.batches[i];
+
+        for (const auto &wait : batch.waits) {
+            wait_semaphores[i].push_back(wait.semaphore);
+            wait_values[i].push_back(wait.value);
+            wait_stages[i].push_back(wait.stage);
+        }
+        for (const auto &signal : batch.signals) {
+            signal_semaphores[i].push_back(signal.semaphore);
+            signal_values[i].push_back(signal.value);
+        }
+
+        // Values for binary semaphores are ignored
+        timeline_infos[i].sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timeline_infos[i].waitSemaphoreValueCount = wait_values[i].size();
+        timeline_infos[i].pWaitSemaphoreValues = wait_values[i].data();
+        timeline_infos[i].signalSemaphoreValueCount = signal_values[i].size();
+        timeline_infos[i].pSignalSemaphoreValues = signal_values[i].data();
+
+        submit_infos[i].sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit_infos[i].pNext = &timeline_infos[i];
+        submit_infos[i].waitSemaphoreCount = wait_semaphores[i].size();
+        submit_infos[i].pWaitSemaphores = wait_semaphores[i].data();
+        submit_infos[i].pWaitDstStageMask = wait_stages[i].data();
+        submit_infos[i].commandBufferCount = batch.command_buffers.size();
+        submit_infos[i].pCommandBuffers = batch.command_buffers.data();
+        submit_infos[i].signalSemaphoreCount = signal_semaphores[i].size();
+        submit_infos[i].pSignalSemaphores = signal_semaphores[i].data();
+    }
+
+    if (vkQueueSubmit(pending.queue, submit_infos.size(), submit_infos.data(), pending.fence) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to submit command buffers!");
+    }
+}
+
+void submission_scheduler::report(std::ostream &out, std::uint32_t frames) {
+    double per_frame = frames > 0 ? 1.0 / frames : 0.0;
+    double submit_us = std::chrono::duration<double, std::micro>(submit_time).count();
+
+    out << call_count * per_frame << " calls, " << batch_count * per_frame << " batches, "
+        << command_buffer_count * per_frame << " command buffers, " << submit_us * per_frame << " us per frame ("
+        << (queue_submit_2 ? "vkQueueSubmit2" : "vkQueueSubmit") << ")";
+
+    call_count = 0;
+    batch_count = 0;
+    command_buffer_count = 0;
+    submit_time = {};
+}
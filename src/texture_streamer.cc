@@ -0,0 +1,502 @@
+#include "texture_streamer.h"
+#include "config.h"
+#include "image_io.h"
+#include "mapped_file.h"
+#include "vulkan_utils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+void texture_streamer::init(VkPhysicalDevice physical_device, VkDevice device, std::uint32_t graphics_family, VkQueue graphics_queue,
+        std::uint32_t transfer_family, VkQueue transfer_queue) {
+    this->physical_device = physical_device;
+    this->device = device;
+    this->graphics_family = graphics_family;
+    this->graphics_queue = graphics_queue;
+    this->transfer_family = transfer_family;
+    this->transfer_queue = transfer_queue;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+    max_image_dimension = properties.limits.maxImageDimension2D;
+    // Copies need offsets aligned to the texel size at least
+    staging_alignment = std::max<VkDeviceSize>(4, properties.limits.optimalBufferCopyOffsetAlignment);
+
+    create_staging_ring();
+    create_command_pools();
+    create_timelines();
+
+    for (std::uint32_t i = 0; i < STREAMING_DECODE_THREADS; i++) {
+        workers.emplace_back([this]() { worker_loop(); });
+    }
+}
+
+void texture_streamer::cleanup() {
+    {
+        std::lock_guard<std::mutex> lock(staging_mutex);
+        stopping = true;
+    }
+    staging_available.notify_all();
+    requests.close();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+
+    // Command buffers go away with their pools
+    uploads.clear();
+    completed_uploads.clear();
+    transfer_command_pool.reset();
+    graphics_command_pool.reset();
+    transfer_timeline.reset();
+    completion_timeline.reset();
+
+    if (staging_buffer_memory) {
+        vkUnmapMemory(device, staging_buffer_memory);
+    }
+    staging_buffer.reset();
+    staging_buffer_memory.reset();
+}
+
+void texture_streamer::create_staging_ring() {
+    staging_capacity = STREAMING_STAGING_SIZE;
+
+    VkBuffer buffer;
+    VkDeviceMemory buffer_memory;
+    create_buffer(physical_device, device, staging_capacity, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            0, buffer, buffer_memory);
+    staging_buffer = unique_buffer(device, buffer);
+    staging_buffer_memory = unique_device_memory(device, buffer_memory);
+
+    // Mapped for the streamer's whole lifetime; workers decode straight into it
+    void *data;
+    if (vkMapMemory(device, staging_buffer_memory, 0, staging_capacity, 0, &data) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to map texture staging buffer!");
+    }
+    staging_data = static_cast<std::uint8_t *>(data);
+}
+
+void texture_streamer::create_command_pools() {
+    VkCommandPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+    pool_info.queueFamilyIndex = transfer_family;
+    if (vkCreateCommandPool(device, &pool_info, nullptr, transfer_command_pool.put(device)) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create texture streaming command pool!");
+    }
+
+    pool_info.queueFamilyIndex = graphics_family;
+    if (vkCreateCommandPool(device, &pool_info, nullptr, graphics_command_pool.put(device)) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create texture streaming command pool!");
+    }
+}
+
+void texture_streamer::create_timelines() {
+    VkSemaphoreTypeCreateInfo type_info{};
+    type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    type_info.initialValue = 0;
+
+    VkSemaphoreCreateInfo semaphore_info{};
+    semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphore_info.pNext = &type_info;
+
+    if (vkCreateSemaphore(device, &semaphore_info, nullptr, transfer_timeline.put(device)) != VK_SUCCESS ||
+            vkCreateSemaphore(device, &semaphore_info, nullptr, completion_timeline.put(device)) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create texture streaming timelines!");
+    }
+}
+
+void texture_streamer::request(const std::string &path) {
+    auto now = std::chrono::steady_clock::now();
+    if (outstanding_requests == 0) {
+        first_request = now;
+        streamed_count = 0;
+        streamed_bytes = 0;
+    }
+    outstanding_requests++;
+
+    requests.push({ path, now });
+}
+
+void texture_streamer::worker_loop() {
+    texture_request request;
+    while (requests.pop(request)) {
+        decoded_texture texture;
+        texture.request = std::move(request);
+
+        try {
+            mapped_file file(texture.request.path);
+            ppm_header header = parse_ppm_header(file.data(), file.size());
+            if (header.width > max_image_dimension || header.height > max_image_dimension) {
+                throw std::runtime_error("Texture is larger than the device supports!");
+            }
+
+            texture.width = header.width;
+            texture.height = header.height;
+            texture.size = static_cast<VkDeviceSize>(header.width) * header.height * 4;
+            if (texture.size > staging_capacity) {
+                throw std::runtime_error("Texture does not fit into the staging ring!");
+            }
+
+            // Waits for earlier uploads to free enough of the ring
+            if (!allocate_staging(texture.size, texture.staging_offset)) {
+                return;
+            }
+            decode_ppm(file.data(), header, staging_data + texture.staging_offset);
+        } catch (const std::exception &e) {
+            texture.error = e.what();
+        }
+
+        texture.decoded = std::chrono::steady_clock::now();
+        decoded_textures.push(std::move(texture));
+    }
+}
+
+bool texture_streamer::allocate_staging(VkDeviceSize size, VkDeviceSize &offset) {
+    size = (size + staging_alignment - 1) / staging_alignment * staging_alignment;
+
+    std::unique_lock<std::mutex> lock(staging_mutex);
+    staging_available.wait(lock, [&]() {
+        if (stopping) {
+            return true;
+        }
+
+        if (staging_allocations.empty()) {
+            staging_head = 0;
+            offset = 0;
+            return size <= staging_capacity;
+        }
+
+        // Either the used space is [tail, head) with free space on both sides,
+        // or it has wrapped around and the free space is [head, tail)
+        VkDeviceSize tail = staging_allocations.front().offset;
+        if (staging_head > tail) {
+            if (staging_head + size <= staging_capacity) {
+                offset = staging_head;
+                return true;
+            }
+            offset = 0;
+            return size <= tail;
+        }
+
+        offset = staging_head;
+        return staging_head + size <= tail;
+    });
+
+    if (stopping) {
+        return false;
+    }
+
+    staging_allocations.push_back({ offset, size, false });
+    staging_head = offset + size;
+    return true;
+}
+
+void texture_streamer::release_staging(VkDeviceSize offset) {
+    {
+        std::lock_guard<std::mutex> lock(staging_mutex);
+        for (auto &allocation : staging_allocations) {
+            if (allocation.offset == offset && !allocation.released) {
+                allocation.released = true;
+                break;
+            }
+        }
+        while (!staging_allocations.empty() && staging_allocations.front().released) {
+            staging_allocations.pop_front();
+        }
+    }
+    staging_available.notify_all();
+}
+
+std::vector<streamed_texture> texture_streamer::update(submission_scheduler &scheduler) {
+    std::vector<streamed_texture> ready;
+    std::uint32_t outstanding_before = outstanding_requests;
+
+    std::uint64_t copies_done = 0;
+    std::uint64_t uploads_done = 0;
+    vkGetSemaphoreCounterValue(device, transfer_timeline, &copies_done);
+    vkGetSemaphoreCounterValue(device, completion_timeline, &uploads_done);
+    auto now = std::chrono::steady_clock::now();
+
+    for (auto it = uploads.begin(); it != uploads.end();) {
+        if (!it->staging_released && it->timeline_value <= copies_done) {
+            release_staging(it->texture.staging_offset);
+            vkFreeCommandBuffers(device, transfer_command_pool, 1, &it->transfer_command_buffer);
+            it->staging_released = true;
+        }
+
+        if (it->timeline_value > uploads_done) {
+            ++it;
+            continue;
+        }
+
+        vkFreeCommandBuffers(device, graphics_command_pool, 1, &it->graphics_command_buffer);
+        report(*it, now);
+        ready.push_back({ it->texture.request.path, it->image_view, it->texture.width, it->texture.height, it->mip_levels });
+
+        completed_uploads.push_back(std::move(*it));
+        it = uploads.erase(it);
+        outstanding_requests--;
+    }
+
+    // Everything decoded since the last call is uploaded in one batch per
+    // queue, signalling the last upload's value, which the timelines only
+    // reach once all of the batch's uploads are done
+    submit_batch copy_batch;
+    submit_batch mip_batch;
+    decoded_texture texture;
+    while (decoded_textures.try_pop(texture)) {
+        if (!texture.error.empty()) {
+            std::cerr << "Failed to stream " << texture.request.path << ": " << texture.error << std::endl;
+            outstanding_requests--;
+            continue;
+        }
+        record_upload(std::move(texture));
+        copy_batch.command_buffers.push_back(uploads.back().transfer_command_buffer);
+        mip_batch.command_buffers.push_back(uploads.back().graphics_command_buffer);
+    }
+
+    if (!copy_batch.command_buffers.empty()) {
+        copy_batch.signals.push_back({ transfer_timeline, next_timeline_value });
+        scheduler.enqueue(transfer_queue, std::move(copy_batch));
+
+        // The mip chains are built on the graphics queue, which is the only
+        // one guaranteed to support blits, as soon as the copies have landed
+        mip_batch.waits.push_back({ transfer_timeline, next_timeline_value, VK_PIPELINE_STAGE_TRANSFER_BIT });
+        mip_batch.signals.push_back({ completion_timeline, next_timeline_value });
+        scheduler.enqueue(graphics_queue, std::move(mip_batch));
+    }
+
+    if (outstanding_before > 0 && outstanding_requests == 0 && streamed_count > 0) {
+        double elapsed_s = std::chrono::duration<double>(now - first_request).count();
+        std::cout << "Streamed " << streamed_count << " textures, "
+            << streamed_bytes / (1024.0 * 1024.0) << " MiB in " << elapsed_s * 1000.0 << " ms ("
+            << streamed_bytes / (1024.0 * 1024.0) / elapsed_s << " MiB/s)" << std::endl;
+    }
+
+    return ready;
+}
+
+void texture_streamer::record_upload(decoded_texture texture) {
+    upload target;
+    target.texture = std::move(texture);
+    target.mip_levels = 1 + static_cast<std::uint32_t>(std::log2(std::max(target.texture.width, target.texture.height)));
+
+    // Mip levels are blitted from level 0, which is copied in
+    create_image(physical_device, device, target.texture.width, target.texture.height, target.mip_levels, VK_SAMPLE_COUNT_1_BIT,
+            VK_FORMAT_R8G8B8A8_UNORM,
+            VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, *target.image.put(device), *target.image_memory.put(device));
+    target.image_view = unique_image_view(device,
+            create_image_view(device, target.image, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT, target.mip_levels));
+
+    VkCommandBufferAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    alloc_info.commandBufferCount = 1;
+
+    alloc_info.commandPool = transfer_command_pool;
+    if (vkAllocateCommandBuffers(device, &alloc_info, &target.transfer_command_buffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate texture upload command buffer!");
+    }
+    alloc_info.commandPool = graphics_command_pool;
+    if (vkAllocateCommandBuffers(device, &alloc_info, &target.graphics_command_buffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate texture upload command buffer!");
+    }
+
+    record_copy(target.transfer_command_buffer, target);
+    record_mip_generation(target.graphics_command_buffer, target);
+
+    target.timeline_value = ++next_timeline_value;
+    target.submitted = std::chrono::steady_clock::now();
+    uploads.push_back(std::move(target));
+}
+
+void texture_streamer::record_copy(VkCommandBuffer command_buffer, const upload &target) {
+    VkCommandBufferBeginInfo begin_info{};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to begin recording texture copy!");
+    }
+
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = target.image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = target.mip_levels;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+            0, nullptr, 0, nullptr, 1, &barrier);
+
+    VkBufferImageCopy region{};
+    region.bufferOffset = target.texture.staging_offset;
+    region.bufferRowLength = 0;
+    region.bufferImageHeight = 0;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = 0;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+    region.imageOffset = { 0, 0, 0 };
+    region.imageExtent = { target.texture.width, target.texture.height, 1 };
+
+    vkCmdCopyBufferToImage(command_buffer, staging_buffer, target.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+    if (transfer_family != graphics_family) {
+        // Release the image to the graphics queue; the matching acquire is
+        // the first thing the mip generation records
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcQueueFamilyIndex = transfer_family;
+        barrier.dstQueueFamilyIndex = graphics_family;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = 0;
+
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+                0, nullptr, 0, nullptr, 1, &barrier);
+    }
+
+    if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to record texture copy!");
+    }
+}
+
+void texture_streamer::record_mip_generation(VkCommandBuffer command_buffer, const upload &target) {
+    VkCommandBufferBeginInfo begin_info{};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to begin recording texture mip generation!");
+    }
+
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = target.image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+
+    if (transfer_family != graphics_family) {
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcQueueFamilyIndex = transfer_family;
+        barrier.dstQueueFamilyIndex = graphics_family;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = target.mip_levels;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                0, nullptr, 0, nullptr, 1, &barrier);
+
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    }
+
+    // Each level is downsampled from the one above it, which then becomes
+    // read-only. R8G8B8A8_UNORM is required to support linear blits.
+    barrier.subresourceRange.levelCount = 1;
+    std::int32_t mip_width = static_cast<std::int32_t>(target.texture.width);
+    std::int32_t mip_height = static_cast<std::int32_t>(target.texture.height);
+
+    for (std::uint32_t level = 1; level < target.mip_levels; level++) {
+        barrier.subresourceRange.baseMipLevel = level - 1;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                0, nullptr, 0, nullptr, 1, &barrier);
+
+        std::int32_t next_width = std::max(mip_width / 2, 1);
+        std::int32_t next_height = std::max(mip_height / 2, 1);
+
+        VkImageBlit blit{};
+        blit.srcOffsets[0] = { 0, 0, 0 };
+        blit.srcOffsets[1] = { mip_width, mip_height, 1 };
+        blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        blit.srcSubresource.mipLevel = level - 1;
+        blit.srcSubresource.baseArrayLayer = 0;
+        blit.srcSubresource.layerCount = 1;
+        blit.dstOffsets[0] = { 0, 0, 0 };
+        blit.dstOffsets[1] = { next_width, next_height, 1 };
+        blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        blit.dstSubresource.mipLevel = level;
+        blit.dstSubresource.baseArrayLayer = 0;
+        blit.dstSubresource.layerCount = 1;
+
+        vkCmdBlitImage(command_buffer,
+                target.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                target.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                1, &blit, VK_FILTER_LINEAR);
+
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+                0, nullptr, 0, nullptr, 1, &barrier);
+
+        mip_width = next_width;
+        mip_height = next_height;
+    }
+
+    barrier.subresourceRange.baseMipLevel = target.mip_levels - 1;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+            0, nullptr, 0, nullptr, 1, &barrier);
+
+    if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to record texture mip generation!");
+    }
+}
+
+void texture_streamer::report(const upload &finished, std::chrono::steady_clock::time_point completed) {
+    const decoded_texture &texture = finished.texture;
+    double decoded_ms = std::chrono::duration<double, std::milli>(texture.decoded - texture.request.requested).count();
+    double upload_ms = std::chrono::duration<double, std::milli>(completed - finished.submitted).count();
+    double latency_ms = std::chrono::duration<double, std::milli>(completed - texture.request.requested).count();
+    double mib = texture.size / (1024.0 * 1024.0);
+
+    // Completion is only noticed once per frame, so the upload time includes
+    // up to a frame of polling delay and the bandwidth is a lower bound
+    std::cout << "Streamed " << texture.request.path << " (" << texture.width << "x" << texture.height << ", "
+        << finished.mip_levels << " mips, " << mib << " MiB): decoded " << decoded_ms << " ms after request, uploaded in "
+        << upload_ms << " ms (" << mib / (upload_ms / 1000.0) << " MiB/s), visible " << latency_ms << " ms after request"
+        << std::endl;
+
+    streamed_count++;
+    streamed_bytes += texture.size;
+}
@@ -1,14 +1,21 @@
 #include "triangle_application.h"
 #include "config.h"
+#include "mesh_format.h"
+#include "vulkan_utils.h"
 
 #include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <cstdint>
+#include <cstddef>
 #include <cstring>
 #include <fstream>
 #include <iostream>
 #include <limits>
 #include <set>
 #include <stdexcept>
+#include <string>
+#include <utility>
 #include <vector>
 #include <vulkan/vulkan_core.h>
 
@@ -19,6 +26,22 @@
 VkResult CreateDebugUtilsMessengerEXT(VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT *pCreateInfo, const VkAllocationCallbacks *pAllocator, VkDebugUtilsMessengerEXT *pMessenger);
 void DestroyDebugUtilsMessengerEXT(VkInstance instance, const VkDebugUtilsMessengerEXT messenger, const VkAllocationCallbacks *pAllocator);
 
+triangle_application::triangle_application(const options &opts)
+    : texture_files(opts.texture_files), mesh_file(opts.mesh_file),
+      memory_budget_limit(static_cast<VkDeviceSize>(opts.memory_budget_mib) * 1024 * 1024) {
+    if (opts.sierpinski_levels > 0) {
+        tessellation.sierpinski = true;
+        tessellation.detail = opts.sierpinski_levels;
+    } else {
+        tessellation.detail = opts.tessellate_segments;
+    }
+    allow_mesh_shaders = !opts.no_mesh_shaders;
+    occlusion_cull_instances = opts.occlusion_cull_instances;
+    surface_count = opts.window_count;
+    headless_surfaces = opts.headless_surface;
+    headless_frame_count = opts.frames;
+}
+
 void triangle_application::run() {
     init_window();
     init_vulkan();
@@ -27,24 +50,40 @@ void triangle_application::run() {
 }
 
 void triangle_application::init_window() {
+    // Sized once, so the resize callback's pointers into it stay valid
+    surfaces.resize(surface_count);
+    if (headless_surfaces) {
+        return;
+    }
+
     glfwInit();
 
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
 
-    window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "Vulkan triangle", nullptr, nullptr);
-    if (!window) {
-        glfwTerminate();
-        throw std::runtime_error("Failed to create GLFW window");
-        return;
-    }
+    for (std::uint32_t i = 0; i < surface_count; i++) {
+        std::string title = "Vulkan triangle";
+        if (surface_count > 1) {
+            title += " (" + std::to_string(i + 1) + "/" + std::to_string(surface_count) + ")";
+        }
+
+        GLFWwindow *window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, title.c_str(), nullptr, nullptr);
+        if (!window) {
+            for (std::uint32_t j = 0; j < i; j++) {
+                glfwDestroyWindow(surfaces[j].window);
+            }
+            glfwTerminate();
+            throw std::runtime_error("Failed to create GLFW window");
+        }
 
-    glfwSetWindowUserPointer(window, this);
-    glfwSetFramebufferSizeCallback(window, framebuffer_resize_callback);
+        surfaces[i].window = window;
+        glfwSetWindowUserPointer(window, &surfaces[i]);
+        glfwSetFramebufferSizeCallback(window, framebuffer_resize_callback);
+    }
 }
 
 void triangle_application::framebuffer_resize_callback(GLFWwindow *window, int width, int height) {
-    auto app = reinterpret_cast<triangle_application *>(glfwGetWindowUserPointer(window));
-    app->framebuffer_resized = true;
+    auto target = reinterpret_cast<presentation_surface *>(glfwGetWindowUserPointer(window));
+    target->resized = true;
 }
 
 void triangle_application::init_vulkan() {
@@ -52,15 +91,36 @@ void triangle_application::init_vulkan() {
     setup_debug_messenger();
     create_surface();
     pick_physical_device();
+    supported_msaa_samples = choose_msaa_samples();
+    msaa_samples = supported_msaa_samples;
+    render_scale_limit = MAX_RENDER_SCALE;
     create_logical_device();
-    create_swap_chain();
-    create_image_views();
+    memory.init(physical_device, memory_budget_enabled, memory_budget_limit);
+    create_occlusion_culler();
+    for (auto &target : surfaces) {
+        create_swap_chain(target);
+    }
+    create_offscreen_targets();
     create_render_pass();
+    create_texture_sampler();
+    create_descriptor_set_layout();
     create_graphics_pipeline();
+    create_mesh_pipeline();
+    create_tessellation_pipeline();
+    create_culled_pipeline();
+    precompile_pipelines();
     create_framebuffers();
     create_command_pool();
+    load_scene_mesh();
+    tessellate_scene();
     create_command_buffers();
+    create_textures();
+    create_descriptor_pool();
+    create_descriptor_set();
+    create_instance_buffers();
     create_sync_objects();
+    create_timestamp_queries();
+    create_texture_streamer();
 }
 
 void triangle_application::create_instance() {
@@ -70,15 +130,26 @@ void triangle_application::create_instance() {
 
     show_available_extensions();
 
+    if (headless_surfaces && !check_instance_extension_support(VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME)) {
+        throw std::runtime_error("Headless surfaces requested, but VK_EXT_headless_surface is not available!");
+    }
+
     VkApplicationInfo app_info{};
     app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
     app_info.pApplicationName = "Vulkan triangle";
     app_info.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
     app_info.pEngineName = "No engine";
     app_info.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    app_info.apiVersion = VK_API_VERSION_1_0;
-
-    auto extensions = get_required_extensions();
+    app_info.apiVersion = VK_API_VERSION_1_2;
+
+    auto extensions = get_required_extensions(headless_surfaces);
+    // Needed on the instance for VK_EXT_swapchain_maintenance1 on the device
+    if (check_instance_extension_support(VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME) &&
+            check_instance_extension_support(VK_EXT_SURFACE_MAINTENANCE_1_EXTENSION_NAME)) {
+        extensions.push_back(VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME);
+        extensions.push_back(VK_EXT_SURFACE_MAINTENANCE_1_EXTENSION_NAME);
+        surface_maintenance_1_enabled = true;
+    }
 
     VkInstanceCreateInfo create_info{};
     VkDebugUtilsMessengerCreateInfoEXT debug_create_info{};
@@ -99,48 +170,47 @@ void triangle_application::create_instance() {
         create_info.pNext = nullptr;
     }
 
-    if (vkCreateInstance(&create_info, nullptr, &instance) != VK_SUCCESS) {
+    VkResult result = vkCreateInstance(&create_info, nullptr, &instance);
+    if (result == VK_ERROR_INCOMPATIBLE_DRIVER) {
+        throw no_vulkan_device_error("Failed to find a Vulkan implementation!");
+    } else if (result != VK_SUCCESS) {
         throw std::runtime_error("Failed to create instance!");
     }
 
 
 }
 
-bool triangle_application::check_validation_layer_support() {
-    std::uint32_t layer_count;
-    vkEnumerateInstanceLayerProperties(&layer_count, nullptr);
-
-    std::vector<VkLayerProperties> available_layers(layer_count);
-    vkEnumerateInstanceLayerProperties(&layer_count, available_layers.data());
-
-    for (const char *layer_name : validation_layers) {
-        bool layer_found = false;
-
-        for (const auto &layer_properties : available_layers) {
-            if (strcmp(layer_name, layer_properties.layerName) == 0) {
-                layer_found = true;
-                break;
-            }
-        }
+std::vector<const char *> triangle_application::get_required_extensions(bool headless) {
+    std::vector<const char *> extensions;
+    if (headless) {
+        extensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+        extensions.push_back(VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME);
+    } else {
+        std::uint32_t glfw_extension_count = 0;
+        const char **glfw_extensions = glfwGetRequiredInstanceExtensions(&glfw_extension_count);
+        extensions.assign(glfw_extensions, glfw_extensions + glfw_extension_count);
+    }
 
-        if (!layer_found)
-            return false;
+    if (enable_validation_layers) {
+        extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
     }
 
-    return true;
+    return extensions;
 }
 
-std::vector<const char *> triangle_application::get_required_extensions() {
-    std::uint32_t glfw_extension_count = 0;
-    const char **glfw_extensions = glfwGetRequiredInstanceExtensions(&glfw_extension_count);
+bool triangle_application::check_instance_extension_support(const char *extension_name) {
+    std::uint32_t extension_count = 0;
+    vkEnumerateInstanceExtensionProperties(nullptr, &extension_count, nullptr);
 
-    std::vector<const char *> extensions(glfw_extensions, glfw_extensions + glfw_extension_count);
+    std::vector<VkExtensionProperties> extensions(extension_count);
+    vkEnumerateInstanceExtensionProperties(nullptr, &extension_count, extensions.data());
 
-    if (enable_validation_layers) {
-        extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+    for (const auto &extension : extensions) {
+        if (std::strcmp(extension.extensionName, extension_name) == 0) {
+            return true;
+        }
     }
-
-    return extensions;
+    return false;
 }
 
 void triangle_application::show_available_extensions() {
@@ -193,8 +263,27 @@ VKAPI_ATTR VkBool32 VKAPI_CALL triangle_application::debug_callback(
 }
 
 void triangle_application::create_surface() {
-    if (glfwCreateWindowSurface(instance, window, nullptr, &surface) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create window surface!");
+    if (headless_surfaces) {
+        auto create_headless_surface = reinterpret_cast<PFN_vkCreateHeadlessSurfaceEXT>(
+                vkGetInstanceProcAddr(instance, "vkCreateHeadlessSurfaceEXT"));
+        if (!create_headless_surface) {
+            throw std::runtime_error("Failed to load vkCreateHeadlessSurfaceEXT!");
+        }
+
+        VkHeadlessSurfaceCreateInfoEXT create_info{};
+        create_info.sType = VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT;
+        for (auto &target : surfaces) {
+            if (create_headless_surface(instance, &create_info, nullptr, &target.surface) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create headless surface!");
+            }
+        }
+        return;
+    }
+
+    for (auto &target : surfaces) {
+        if (glfwCreateWindowSurface(instance, target.window, nullptr, &target.surface) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create window surface!");
+        }
     }
 }
 
@@ -203,14 +292,14 @@ void triangle_application::pick_physical_device() {
     vkEnumeratePhysicalDevices(instance, &device_count, nullptr);
 
     if (device_count == 0) {
-        throw std::runtime_error("Failed to find GPUs with Vulkan support!");
+        throw no_vulkan_device_error("Failed to find GPUs with Vulkan support!");
     }
 
     std::vector<VkPhysicalDevice> devices(device_count);
     vkEnumeratePhysicalDevices(instance, &device_count, devices.data());
 
     for (const auto &device : devices) {
-        if (is_device_suitable(device, surface)) {
+        if (is_device_suitable(device, surfaces[0].surface) && presents_to_all_surfaces(device)) {
             physical_device = device;
             break;
         }
@@ -221,6 +310,25 @@ void triangle_application::pick_physical_device() {
     }
 }
 
+// The frame is presented to every surface from the queue found for the first
+bool triangle_application::presents_to_all_surfaces(VkPhysicalDevice device) {
+    queue_family_indices indices = find_queue_families(device, surfaces[0].surface);
+    if (!indices.present_family.has_value()) {
+        return false;
+    }
+
+    for (const auto &target : surfaces) {
+        VkBool32 present_support = false;
+        vkGetPhysicalDeviceSurfaceSupportKHR(device, indices.present_family.value(), target.surface, &present_support);
+        swap_chain_support_details swap_chain_support = query_swap_chain_support(device, target.surface);
+        if (!present_support || swap_chain_support.formats.empty() || swap_chain_support.present_modes.empty()) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 bool triangle_application::is_device_suitable(VkPhysicalDevice device, VkSurfaceKHR surface) {
     queue_family_indices indices = find_queue_families(device, surface);
 
@@ -232,7 +340,9 @@ bool triangle_application::is_device_suitable(VkPhysicalDevice device, VkSurface
         swap_chain_adequate = !swap_chain_support.formats.empty() && !swap_chain_support.present_modes.empty();
     }
 
-    return indices.is_complete() && extensions_supported && swap_chain_adequate;
+    bool descriptor_indexing_supported = !enable_bindless_materials || check_descriptor_indexing_support(device);
+
+    return indices.is_complete() && extensions_supported && swap_chain_adequate && descriptor_indexing_supported;
 }
 
 bool triangle_application::check_device_extension_support(VkPhysicalDevice device) {
@@ -251,6 +361,44 @@ bool triangle_application::check_device_extension_support(VkPhysicalDevice devic
     return required_extensions.empty();
 }
 
+bool triangle_application::check_optional_device_extension(VkPhysicalDevice device, const char *extension_name) {
+    std::uint32_t extension_count;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, nullptr);
+
+    std::vector<VkExtensionProperties> available_extensions(extension_count);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, available_extensions.data());
+
+    for (const auto &extension : available_extensions) {
+        if (std::strcmp(extension.extensionName, extension_name) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool triangle_application::check_descriptor_indexing_support(VkPhysicalDevice device) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(device, &properties);
+    if (properties.apiVersion < VK_API_VERSION_1_2) {
+        return false;
+    }
+
+    VkPhysicalDeviceVulkan12Features vulkan_12_features{};
+    vulkan_12_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &vulkan_12_features;
+    vkGetPhysicalDeviceFeatures2(device, &features);
+
+    return vulkan_12_features.runtimeDescriptorArray &&
+        vulkan_12_features.descriptorBindingPartiallyBound &&
+        vulkan_12_features.descriptorBindingSampledImageUpdateAfterBind &&
+        vulkan_12_features.descriptorBindingUpdateUnusedWhilePending &&
+        vulkan_12_features.shaderSampledImageArrayNonUniformIndexing;
+}
+
 queue_family_indices triangle_application::find_queue_families(VkPhysicalDevice device, VkSurfaceKHR surface) {
     queue_family_indices indices;
 
@@ -278,18 +426,30 @@ queue_family_indices triangle_application::find_queue_families(VkPhysicalDevice
         i++;
     }
 
+    for (std::uint32_t family = 0; family < queue_families.size(); family++) {
+        VkQueueFlags flags = queue_families[family].queueFlags;
+        if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+            indices.transfer_family = family;
+            break;
+        }
+    }
+
     return indices;
 }
 
 
 void triangle_application::create_logical_device() {
-    queue_family_indices indices = find_queue_families(physical_device, surface);
+    queue_family_indices indices = find_queue_families(physical_device, surfaces[0].surface);
 
     std::vector<VkDeviceQueueCreateInfo> queue_create_infos;
     std::set<std::uint32_t> unique_queue_families = {
         indices.graphics_family.value(),
         indices.present_family.value()
     };
+    // Texture uploads go to the transfer family when there is one, and share
+    // the graphics queue otherwise
+    transfer_family = indices.transfer_family.value_or(indices.graphics_family.value());
+    unique_queue_families.insert(transfer_family);
 
     float queue_priority = 1.0f;
 
@@ -304,14 +464,106 @@ void triangle_application::create_logical_device() {
     }
 
     VkPhysicalDeviceFeatures device_features{};
+    // The mesh loader only checks the largest index a file claims to have,
+    // so keep fetches from a file that lies about it inside the buffer
+    if (!mesh_file.empty()) {
+        VkPhysicalDeviceFeatures supported_features;
+        vkGetPhysicalDeviceFeatures(physical_device, &supported_features);
+        device_features.robustBufferAccess = supported_features.robustBufferAccess;
+    }
+
+    VkPhysicalDeviceVulkan12Features vulkan_12_features{};
+    vulkan_12_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    if (enable_bindless_materials) {
+        vulkan_12_features.runtimeDescriptorArray = VK_TRUE;
+        vulkan_12_features.descriptorBindingPartiallyBound = VK_TRUE;
+        vulkan_12_features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+        vulkan_12_features.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+        vulkan_12_features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+        // Texture streaming tracks uploads on timelines, which 1.2 always supports
+        vulkan_12_features.timelineSemaphore = VK_TRUE;
+    }
+
+    // Lets the mesh loader copy straight out of the file mapping
+    std::vector<const char *> enabled_extensions = device_extensions;
+    if (!mesh_file.empty() && check_optional_device_extension(physical_device, VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME)) {
+        enabled_extensions.push_back(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME);
+        host_pointer_import = true;
+    }
+    // Lets the tessellation skip the vertex buffer and its memory traffic
+    VkPhysicalDeviceMeshShaderFeaturesEXT mesh_shader_features{};
+    mesh_shader_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+    if (tessellation.detail > 0 && allow_mesh_shaders &&
+            check_optional_device_extension(physical_device, VK_EXT_MESH_SHADER_EXTENSION_NAME)) {
+        VkPhysicalDeviceFeatures2 features{};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &mesh_shader_features;
+        vkGetPhysicalDeviceFeatures2(physical_device, &features);
+
+        if (mesh_shader_features.meshShader) {
+            // Only the mesh stage itself, none of the features it can be combined with
+            mesh_shader_features = {};
+            mesh_shader_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+            mesh_shader_features.meshShader = VK_TRUE;
+            vulkan_12_features.pNext = &mesh_shader_features;
+            enabled_extensions.push_back(VK_EXT_MESH_SHADER_EXTENSION_NAME);
+            mesh_shader_tessellation = true;
+        }
+    }
+    // Lets the submission scheduler hand each queue its batches with
+    // vkQueueSubmit2, which needs fewer structures per batch than vkQueueSubmit
+    VkPhysicalDeviceSynchronization2FeaturesKHR synchronization_2_features{};
+    synchronization_2_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR;
+    if (check_optional_device_extension(physical_device, VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME)) {
+        VkPhysicalDeviceFeatures2 features{};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &synchronization_2_features;
+        vkGetPhysicalDeviceFeatures2(physical_device, &features);
+
+        if (synchronization_2_features.synchronization2) {
+            synchronization_2_features.pNext = vulkan_12_features.pNext;
+            vulkan_12_features.pNext = &synchronization_2_features;
+            enabled_extensions.push_back(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+            synchronization_2_enabled = true;
+        }
+    }
+    // Lets presents signal fences, which tell when a replaced swap chain is
+    // no longer in use
+    VkPhysicalDeviceSwapchainMaintenance1FeaturesEXT swapchain_maintenance_1_features{};
+    swapchain_maintenance_1_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SWAPCHAIN_MAINTENANCE_1_FEATURES_EXT;
+    if (surface_maintenance_1_enabled &&
+            check_optional_device_extension(physical_device, VK_EXT_SWAPCHAIN_MAINTENANCE_1_EXTENSION_NAME)) {
+        VkPhysicalDeviceFeatures2 features{};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &swapchain_maintenance_1_features;
+        vkGetPhysicalDeviceFeatures2(physical_device, &features);
+
+        if (swapchain_maintenance_1_features.swapchainMaintenance1) {
+            swapchain_maintenance_1_features.pNext = vulkan_12_features.pNext;
+            vulkan_12_features.pNext = &swapchain_maintenance_1_features;
+            enabled_extensions.push_back(VK_EXT_SWAPCHAIN_MAINTENANCE_1_EXTENSION_NAME);
+            swapchain_maintenance_1_enabled = true;
+        }
+    }
+    // Lets check_memory_budget() see how close the process is to running out
+    if (check_optional_device_extension(physical_device, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME)) {
+        enabled_extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        memory_budget_enabled = true;
+    } else if (memory_budget_limit != 0) {
+        std::cout << VK_EXT_MEMORY_BUDGET_EXTENSION_NAME << " is not supported, the memory budget is checked against "
+            "an estimate of this window's own allocations" << std::endl;
+    } else {
+        std::cout << VK_EXT_MEMORY_BUDGET_EXTENSION_NAME << " is not supported, memory usage is not tracked" << std::endl;
+    }
 
     VkDeviceCreateInfo create_info{};
     create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    create_info.pNext = &vulkan_12_features;
     create_info.queueCreateInfoCount = queue_create_infos.size();
     create_info.pQueueCreateInfos = queue_create_infos.data();
     create_info.pEnabledFeatures = &device_features;
-    create_info.enabledExtensionCount = device_extensions.size();
-    create_info.ppEnabledExtensionNames = device_extensions.data();
+    create_info.enabledExtensionCount = enabled_extensions.size();
+    create_info.ppEnabledExtensionNames = enabled_extensions.data();
     if (enable_validation_layers) {
         create_info.enabledLayerCount = validation_layers.size();
         create_info.ppEnabledLayerNames = validation_layers.data();
@@ -325,14 +577,31 @@ void triangle_application::create_logical_device() {
 
     vkGetDeviceQueue(device, indices.graphics_family.value(), 0, &graphics_queue);
     vkGetDeviceQueue(device, indices.present_family.value(), 0, &present_queue);
+    vkGetDeviceQueue(device, transfer_family, 0, &transfer_queue);
+
+    if (mesh_shader_tessellation) {
+        cmd_draw_mesh_tasks = (PFN_vkCmdDrawMeshTasksEXT) vkGetDeviceProcAddr(device, "vkCmdDrawMeshTasksEXT");
+        if (cmd_draw_mesh_tasks == nullptr) {
+            throw std::runtime_error("Failed to load vkCmdDrawMeshTasksEXT!");
+        }
+    }
+
+    PFN_vkQueueSubmit2KHR queue_submit_2 = nullptr;
+    if (synchronization_2_enabled) {
+        queue_submit_2 = (PFN_vkQueueSubmit2KHR) vkGetDeviceProcAddr(device, "vkQueueSubmit2KHR");
+        if (queue_submit_2 == nullptr) {
+            throw std::runtime_error("Failed to load vkQueueSubmit2KHR!");
+        }
+    }
+    scheduler.init(queue_submit_2);
 }
 
-void triangle_application::create_swap_chain() {
-    swap_chain_support_details swap_chain_support = query_swap_chain_support(physical_device, surface);
+void triangle_application::create_swap_chain(presentation_surface &target) {
+    swap_chain_support_details swap_chain_support = query_swap_chain_support(physical_device, target.surface);
 
     VkSurfaceFormatKHR surface_format = choose_swap_surface_format(swap_chain_support.formats);
     VkPresentModeKHR present_mode = choose_swap_present_mode(swap_chain_support.present_modes);
-    VkExtent2D extent = choose_swap_extent(swap_chain_support.capabilities, window);
+    VkExtent2D extent = choose_swap_extent(swap_chain_support.capabilities, target.window);
 
     std::uint32_t image_count = swap_chain_support.capabilities.minImageCount + 1;
     if (swap_chain_support.capabilities.maxImageCount > 0 && image_count > swap_chain_support.capabilities.maxImageCount) {
@@ -341,15 +610,26 @@ void triangle_application::create_swap_chain() {
 
     VkSwapchainCreateInfoKHR create_info{};
     create_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-    create_info.surface = surface;
+    create_info.surface = target.surface;
     create_info.minImageCount = image_count;
     create_info.imageFormat = surface_format.format;
     create_info.imageColorSpace = surface_format.colorSpace;
     create_info.imageExtent = extent;
     create_info.imageArrayLayers = 1;
-    create_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    // The scene is rendered offscreen and blitted into the swap chain image
+    if (!(swap_chain_support.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT)) {
+        throw std::runtime_error("Swap chain images cannot be used as a transfer destination!");
+    }
+    create_info.imageUsage = VK_IMAGE_USAGE_TRANSFER_DST_BIT;
 
-    queue_family_indices indices = find_queue_families(physical_device, surface);
+    // The first surface's format is checked with the offscreen targets
+    VkFormatProperties format_properties;
+    vkGetPhysicalDeviceFormatProperties(physical_device, surface_format.format, &format_properties);
+    if (!(format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT)) {
+        throw std::runtime_error("Swap chain image format does not support blitting!");
+    }
+
+    queue_family_indices indices = find_queue_families(physical_device, surfaces[0].surface);
     std::uint32_t family_indices[] = { indices.graphics_family.value(), indices.present_family.value() };
 
     if (indices.graphics_family != indices.present_family) {
@@ -367,47 +647,177 @@ void triangle_application::create_swap_chain() {
     create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
     create_info.presentMode = present_mode;
     create_info.clipped = VK_TRUE;
-    create_info.oldSwapchain = VK_NULL_HANDLE;
+    // Handing over the old swap chain lets the presentation engine reuse its
+    // resources and keeps its already acquired images presentable
+    create_info.oldSwapchain = target.swap_chain;
 
-    if (vkCreateSwapchainKHR(device, &create_info, nullptr, &swap_chain) != VK_SUCCESS) {
+    VkSwapchainKHR new_swap_chain;
+    if (vkCreateSwapchainKHR(device, &create_info, nullptr, &new_swap_chain) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create swap chain!");
     }
+    if (target.swap_chain) {
+        // The frame fences do not cover presents, which may still be waiting
+        // on their semaphores or reading the old images. With present fences
+        // or presents on the graphics queue, release_old_swap_chains() finds
+        // out when they are done; presents on a queue of their own are not
+        // ordered against anything this process waits on.
+        if (swapchain_maintenance_1_enabled) {
+            target.old_swap_chains.push_back({ std::move(target.swap_chain), std::move(target.present_fences) });
+            target.present_fences.clear();
+        } else if (present_queue == graphics_queue) {
+            target.old_swap_chains.push_back({ std::move(target.swap_chain), {} });
+        } else {
+            vkQueueWaitIdle(present_queue);
+            retired_resources.retire(submitted_frames, std::move(target.swap_chain));
+        }
+    }
+    target.swap_chain = unique_swapchain(device, new_swap_chain);
+    if (swapchain_maintenance_1_enabled) {
+        create_present_fences(target);
+    }
 
-    vkGetSwapchainImagesKHR(device, swap_chain, &image_count, nullptr);
-    swap_chain_images.resize(image_count);
-    vkGetSwapchainImagesKHR(device, swap_chain, &image_count, swap_chain_images.data());
-
-    swap_chain_image_format = surface_format.format;
-    swap_chain_extent = extent;
+    vkGetSwapchainImagesKHR(device, target.swap_chain, &image_count, nullptr);
+    target.images.resize(image_count);
+    vkGetSwapchainImagesKHR(device, target.swap_chain, &image_count, target.images.data());
+
+    target.format = surface_format.format;
+    target.extent = extent;
+    // The render targets are made for the first surface and blitted to the
+    // others at their own size
+    if (&target == &surfaces[0]) {
+        swap_chain_image_format = surface_format.format;
+        swap_chain_extent = extent;
+    }
 }
 
 void triangle_application::cleanup_swap_chain() {
-    for (auto framebuffer : swap_chain_framebuffers) {
-        vkDestroyFramebuffer(device, framebuffer, nullptr);
+    offscreen_framebuffers.clear();
+    offscreen_image_views.clear();
+    offscreen_images.clear();
+    offscreen_image_memories.clear();
+
+    msaa_image_view.reset();
+    msaa_image.reset();
+    msaa_image_memory.reset();
+
+    depth_image_view.reset();
+    depth_image.reset();
+    depth_image_memory.reset();
+
+    for (auto &target : surfaces) {
+        wait_for_presents(target);
+        target.old_swap_chains.clear();
+        target.present_fences.clear();
+        target.swap_chain.reset();
+    }
+}
+
+void triangle_application::create_present_fences(presentation_surface &target) {
+    // Signalled, as if the slot's previous present had completed
+    VkFenceCreateInfo fence_info{};
+    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+    target.present_fences.resize(MAX_FRAMES_IN_FLIGHT);
+    for (auto &fence : target.present_fences) {
+        if (vkCreateFence(device, &fence_info, nullptr, fence.put(device)) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create present fences!");
+        }
+    }
+}
+
+void triangle_application::release_old_swap_chains(presentation_surface &target) {
+    if (swapchain_maintenance_1_enabled) {
+        auto done = [this](const retired_swap_chain &old) {
+            return std::all_of(old.present_fences.begin(), old.present_fences.end(),
+                    [this](const unique_fence &fence) { return vkGetFenceStatus(device, fence) == VK_SUCCESS; });
+        };
+        target.old_swap_chains.erase(std::remove_if(target.old_swap_chains.begin(), target.old_swap_chains.end(), done),
+                target.old_swap_chains.end());
+        return;
     }
 
-    for (auto image_view : swap_chain_image_views) {
-        vkDestroyImageView(device, image_view, nullptr);
+    // A present has just been queued on the current swap chain, behind every
+    // present on the old ones on the same queue. Frames are submitted there
+    // too, so MAX_FRAMES_IN_FLIGHT frames on, all of them have been processed.
+    for (auto &old : target.old_swap_chains) {
+        retired_resources.retire(submitted_frames + MAX_FRAMES_IN_FLIGHT, std::move(old.swap_chain));
+    }
+    target.old_swap_chains.clear();
+}
+
+void triangle_application::wait_for_presents(presentation_surface &target) {
+    std::vector<VkFence> fences;
+    for (const auto &fence : target.present_fences) {
+        fences.push_back(fence);
+    }
+    for (const auto &old : target.old_swap_chains) {
+        for (const auto &fence : old.present_fences) {
+            fences.push_back(fence);
+        }
+    }
+    if (!fences.empty()) {
+        vkWaitForFences(device, fences.size(), fences.data(), VK_TRUE, std::numeric_limits<std::uint64_t>::max());
     }
+}
 
-    vkDestroySwapchainKHR(device, swap_chain, nullptr);
+void triangle_application::retire_swap_chain() {
+    // Frames still in flight render into these targets, so they are only
+    // destroyed once the last frame submitted so far has completed. The swap
+    // chain itself is retired by create_swap_chain once it has been replaced.
+    retired_resources.retire(submitted_frames, std::move(offscreen_framebuffers));
+    retired_resources.retire(submitted_frames, std::move(offscreen_image_views));
+    retired_resources.retire(submitted_frames, std::move(offscreen_images));
+    retired_resources.retire(submitted_frames, std::move(offscreen_image_memories));
+    offscreen_framebuffers.clear();
+    offscreen_image_views.clear();
+    offscreen_images.clear();
+    offscreen_image_memories.clear();
+
+    if (msaa_image) {
+        retired_resources.retire(submitted_frames, std::move(msaa_image_view));
+        retired_resources.retire(submitted_frames, std::move(msaa_image));
+        retired_resources.retire(submitted_frames, std::move(msaa_image_memory));
+    }
+    if (depth_image) {
+        retired_resources.retire(submitted_frames, std::move(depth_image_view));
+        retired_resources.retire(submitted_frames, std::move(depth_image));
+        retired_resources.retire(submitted_frames, std::move(depth_image_memory));
+    }
 }
 
-void triangle_application::recreate_swap_chain() {
+static bool window_minimized(GLFWwindow *window) {
     int width = 0, height = 0;
     glfwGetFramebufferSize(window, &width, &height);
-    // Handle minimization
-    while (width == 0 || height == 0) {
-        glfwWaitEvents();
-        glfwGetFramebufferSize(window, &width, &height);
+    return width == 0 || height == 0;
+}
+
+void triangle_application::recreate_swap_chain(presentation_surface &target) {
+    // Waiting for the window to be restored would stop the other surfaces
+    // too, so draw_frame() leaves it out and calls again every frame
+    target.minimized = target.window && window_minimized(target.window);
+    if (target.minimized) {
+        return;
     }
 
-    vkDeviceWaitIdle(device);
+    if (&target != &surfaces[0]) {
+        create_swap_chain(target);
+        return;
+    }
 
-    cleanup_swap_chain();
+    // No need to wait for the device: the old render targets are retired
+    // until the frames in flight complete, and the old swap chain until its
+    // presents have (only the fallback for a separate present queue waits)
+    retire_swap_chain();
+
+    create_swap_chain(target);
+    create_offscreen_targets();
+    create_framebuffers();
+}
 
-    create_swap_chain();
-    create_image_views();
+void triangle_application::recreate_render_targets() {
+    retire_swap_chain();
+    create_offscreen_targets();
     create_framebuffers();
 }
 
@@ -456,8 +866,11 @@ VkExtent2D triangle_application::choose_swap_extent(const VkSurfaceCapabilitiesK
     if (capabilities.currentExtent.width != std::numeric_limits<std::uint32_t>::max()) {
         return capabilities.currentExtent;
     } else {
-        int width, height;
-        glfwGetFramebufferSize(window, &width, &height);
+        // Headless surfaces have no window to take the size from
+        int width = WINDOW_WIDTH, height = WINDOW_HEIGHT;
+        if (window) {
+            glfwGetFramebufferSize(window, &width, &height);
+        }
 
         VkExtent2D actual_extent = { static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
         
@@ -468,170 +881,457 @@ VkExtent2D triangle_application::choose_swap_extent(const VkSurfaceCapabilitiesK
     }
 }
 
-void triangle_application::create_image_views() {
-    swap_chain_image_views.resize(swap_chain_images.size());
+void triangle_application::create_offscreen_targets() {
+    // One target per frame in flight, sized for render_scale_limit; frames
+    // only render into the top-left render_extent() of it, so changing the
+    // scale within the limit never reallocates.
+    VkExtent2D target_extent = scaled_extent(render_scale_limit);
+    offscreen_images.resize(MAX_FRAMES_IN_FLIGHT);
+    offscreen_image_memories.resize(MAX_FRAMES_IN_FLIGHT);
+    offscreen_image_views.resize(MAX_FRAMES_IN_FLIGHT);
+
+    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        create_image(physical_device, device, target_extent.width, target_extent.height, VK_SAMPLE_COUNT_1_BIT, swap_chain_image_format,
+                VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, *offscreen_images[i].put(device), *offscreen_image_memories[i].put(device));
+        offscreen_image_views[i] = unique_image_view(device,
+                create_image_view(device, offscreen_images[i], swap_chain_image_format, VK_IMAGE_ASPECT_COLOR_BIT));
+    }
+
+    VkFormatProperties format_properties;
+    vkGetPhysicalDeviceFormatProperties(physical_device, swap_chain_image_format, &format_properties);
+
+    VkFormatFeatureFlags blit_features = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT;
+    if ((format_properties.optimalTilingFeatures & blit_features) != blit_features) {
+        throw std::runtime_error("Swap chain image format does not support blitting!");
+    }
+
+    if (format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) {
+        upscale_filter = VK_FILTER_LINEAR;
+    } else {
+        upscale_filter = VK_FILTER_NEAREST;
+    }
+
+    create_msaa_target();
+    create_depth_target();
+}
+
+void triangle_application::create_msaa_target() {
+    if (msaa_samples == VK_SAMPLE_COUNT_1_BIT) {
+        return;
+    }
+
+    // The multisampled image only lives inside the render pass: it is cleared
+    // on load, resolved at the end of the subpass and never stored, so tilers
+    // can keep it entirely in on-chip memory.
+    VkExtent2D target_extent = scaled_extent(render_scale_limit);
+    create_image(physical_device, device, target_extent.width, target_extent.height, msaa_samples, swap_chain_image_format,
+            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT,
+            *msaa_image.put(device), *msaa_image_memory.put(device));
+    msaa_image_view = unique_image_view(device, create_image_view(device, msaa_image, swap_chain_image_format, VK_IMAGE_ASPECT_COLOR_BIT));
+}
+
+void triangle_application::create_depth_target() {
+    if (occlusion_cull_instances == 0) {
+        return;
+    }
+
+    // Cleared and written by the first culling phase, reduced into the
+    // hierarchical Z pyramid and then tested against by the second phase
+    VkExtent2D target_extent = scaled_extent(render_scale_limit);
+    create_image(physical_device, device, target_extent.width, target_extent.height, VK_SAMPLE_COUNT_1_BIT, depth_format,
+            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, *depth_image.put(device), *depth_image_memory.put(device));
+    depth_image_view = unique_image_view(device, create_image_view(device, depth_image, depth_format, VK_IMAGE_ASPECT_DEPTH_BIT));
+
+    culler.set_depth_target(depth_image_view, target_extent, retired_resources, submitted_frames);
+}
+
+VkSampleCountFlagBits triangle_application::choose_msaa_samples() {
+    // The pyramid is built from single-sampled depth
+    if (occlusion_cull_instances > 0) {
+        std::cout << "MSAA is disabled while occlusion culling" << std::endl;
+        return VK_SAMPLE_COUNT_1_BIT;
+    }
 
-    for (size_t i = 0; i < swap_chain_images.size(); i++) {
-        VkImageViewCreateInfo create_info{};
-        create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-        create_info.image = swap_chain_images[i];
-        create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
-        create_info.format = swap_chain_image_format;
-        create_info.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
-        create_info.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
-        create_info.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
-        create_info.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
-        create_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        create_info.subresourceRange.baseMipLevel = 0;
-        create_info.subresourceRange.levelCount = 1;
-        create_info.subresourceRange.baseArrayLayer = 0;
-        create_info.subresourceRange.layerCount = 1;
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
 
-        if (vkCreateImageView(device, &create_info, nullptr, &swap_chain_image_views[i]) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to create image views!");
+    VkSampleCountFlags counts = properties.limits.framebufferColorSampleCounts;
+    for (std::uint32_t samples = MSAA_SAMPLES; samples > 1; samples /= 2) {
+        if (counts & samples) {
+            std::cout << "Using " << samples << "x MSAA" << std::endl;
+            return static_cast<VkSampleCountFlagBits>(samples);
         }
     }
+
+    return VK_SAMPLE_COUNT_1_BIT;
+}
+
+VkCommandBuffer triangle_application::begin_single_time_commands() {
+    VkCommandBufferAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    alloc_info.commandPool = command_pool;
+    alloc_info.commandBufferCount = 1;
+
+    VkCommandBuffer command_buffer;
+    if (vkAllocateCommandBuffers(device, &alloc_info, &command_buffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate command buffers!");
+    }
+
+    VkCommandBufferBeginInfo begin_info{};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    vkBeginCommandBuffer(command_buffer, &begin_info);
+
+    return command_buffer;
+}
+
+void triangle_application::end_single_time_commands(VkCommandBuffer command_buffer) {
+    vkEndCommandBuffer(command_buffer);
+
+    VkSubmitInfo submit_info{};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &command_buffer;
+
+    vkQueueSubmit(graphics_queue, 1, &submit_info, VK_NULL_HANDLE);
+    vkQueueWaitIdle(graphics_queue);
+
+    vkFreeCommandBuffers(device, command_pool, 1, &command_buffer);
+}
+
+void triangle_application::transition_image_layout(VkCommandBuffer command_buffer, VkImage image,
+        VkImageLayout old_layout, VkImageLayout new_layout) {
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = old_layout;
+    barrier.newLayout = new_layout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+
+    VkPipelineStageFlags source_stage;
+    VkPipelineStageFlags destination_stage;
+
+    if (old_layout == VK_IMAGE_LAYOUT_UNDEFINED && new_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+        source_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        destination_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    } else if (old_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && new_layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+        source_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        destination_stage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    } else {
+        throw std::invalid_argument("Unsupported layout transition!");
+    }
+
+    vkCmdPipelineBarrier(command_buffer, source_stage, destination_stage, 0,
+            0, nullptr, 0, nullptr, 1, &barrier);
 }
 
 void triangle_application::create_render_pass() {
+    std::vector<VkAttachmentDescription> attachments;
+
     VkAttachmentDescription color_attachment{};
     color_attachment.format = swap_chain_image_format;
-    color_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    color_attachment.samples = msaa_samples;
     color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
     color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
     color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    color_attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-    
+    color_attachment.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+    if (msaa_samples != VK_SAMPLE_COUNT_1_BIT) {
+        // Only the resolved image outlives the render pass
+        color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        color_attachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    }
+    bool depth = occlusion_cull_instances > 0;
+    if (depth) {
+        // second_phase_render_pass draws on top of it
+        color_attachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    }
+    attachments.push_back(color_attachment);
+
     VkAttachmentReference color_attachment_ref{};
     color_attachment_ref.attachment = 0;
     color_attachment_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
+    VkAttachmentReference resolve_attachment_ref{};
+    resolve_attachment_ref.attachment = 1;
+    resolve_attachment_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
     VkSubpassDescription subpass{};
     subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
     subpass.colorAttachmentCount = 1;
     subpass.pColorAttachments = &color_attachment_ref;
 
-    VkSubpassDependency dependency{};
-    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    dependency.dstSubpass = 0;
-    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.srcAccessMask = 0;
-    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    if (msaa_samples != VK_SAMPLE_COUNT_1_BIT) {
+        VkAttachmentDescription resolve_attachment{};
+        resolve_attachment.format = swap_chain_image_format;
+        resolve_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+        resolve_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        resolve_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        resolve_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        resolve_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        resolve_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        resolve_attachment.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        attachments.push_back(resolve_attachment);
+
+        subpass.pResolveAttachments = &resolve_attachment_ref;
+    }
+
+    VkAttachmentReference depth_attachment_ref{};
+    if (depth) {
+        // Stored for the pyramid, which samples it in the read-only layout
+        VkAttachmentDescription depth_attachment{};
+        depth_attachment.format = depth_format;
+        depth_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+        depth_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        depth_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        depth_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        depth_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        depth_attachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+        depth_attachment_ref.attachment = attachments.size();
+        depth_attachment_ref.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        attachments.push_back(depth_attachment);
+
+        subpass.pDepthStencilAttachment = &depth_attachment_ref;
+    }
+
+    VkSubpassDependency dependencies[2]{};
+    // The previous blit out of this offscreen target must be done reading it,
+    // and the previous frame must be done writing the shared MSAA image
+    dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[0].dstSubpass = 0;
+    dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+    dependencies[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+    // The upscaling blit reads what the subpass wrote
+    dependencies[1].srcSubpass = 0;
+    dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    dependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+    if (depth) {
+        // The previous frame must also be done testing against and building
+        // the pyramid from the shared depth image
+        dependencies[0].srcStageMask |= VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        dependencies[0].srcAccessMask |= VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependencies[0].dstStageMask |= VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+        dependencies[0].dstAccessMask |= VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+        // Followed by the pyramid build rather than the blit
+        dependencies[1].srcStageMask |= VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        dependencies[1].srcAccessMask |= VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependencies[1].dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    }
 
     VkRenderPassCreateInfo render_pass_info{};
     render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    render_pass_info.attachmentCount = 1;
-    render_pass_info.pAttachments = &color_attachment;
+    render_pass_info.attachmentCount = attachments.size();
+    render_pass_info.pAttachments = attachments.data();
     render_pass_info.subpassCount = 1;
     render_pass_info.pSubpasses = &subpass;
-    render_pass_info.dependencyCount = 1;
-    render_pass_info.pDependencies = &dependency;
+    render_pass_info.dependencyCount = 2;
+    render_pass_info.pDependencies = dependencies;
 
-    if (vkCreateRenderPass(device, &render_pass_info, nullptr, &render_pass) != VK_SUCCESS) {
+    if (vkCreateRenderPass(device, &render_pass_info, nullptr, render_pass.put(device)) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create render pass!");
     }
+
+    if (depth) {
+        create_second_phase_render_pass();
+    }
 }
 
-void triangle_application::create_graphics_pipeline() {
-    auto vert_shader_code = read_file("shader.vert.spv");
-    auto frag_shader_code = read_file("shader.frag.spv");
-
-    VkShaderModule vert_shader_module = create_shader_module(vert_shader_code);
-    VkShaderModule frag_shader_module = create_shader_module(frag_shader_code);
-
-    VkPipelineShaderStageCreateInfo vert_shader_stage_info{};
-    vert_shader_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    vert_shader_stage_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
-    vert_shader_stage_info.module = vert_shader_module;
-    vert_shader_stage_info.pName = "main";
-
-    VkPipelineShaderStageCreateInfo frag_shader_stage_info{};
-    frag_shader_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    frag_shader_stage_info.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    frag_shader_stage_info.module = frag_shader_module;
-    frag_shader_stage_info.pName = "main";
-
-    VkPipelineShaderStageCreateInfo shader_stages[] = {
-        vert_shader_stage_info, frag_shader_stage_info
-    };
+void triangle_application::create_second_phase_render_pass() {
+    // Compatible with render_pass, so its framebuffers and pipelines are
+    // shared, but loads what the first phase left instead of clearing it
+    VkAttachmentDescription attachments[2]{};
+    attachments[0].format = swap_chain_image_format;
+    attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
+    attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachments[0].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    attachments[0].finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+    // Nothing reads the depth after this frame
+    attachments[1].format = depth_format;
+    attachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
+    attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachments[1].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+    VkAttachmentReference color_attachment_ref{};
+    color_attachment_ref.attachment = 0;
+    color_attachment_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    VkAttachmentReference depth_attachment_ref{};
+    depth_attachment_ref.attachment = 1;
+    depth_attachment_ref.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    VkSubpassDescription subpass{};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = 1;
+    subpass.pColorAttachments = &color_attachment_ref;
+    subpass.pDepthStencilAttachment = &depth_attachment_ref;
+
+    VkSubpassDependency dependencies[2]{};
+    // The first phase's drawing, and the pyramid build sampling its depth
+    dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[0].dstSubpass = 0;
+    dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    dependencies[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+        VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+    // The upscaling blit reads what the subpass wrote
+    dependencies[1].srcSubpass = 0;
+    dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    dependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+    VkRenderPassCreateInfo render_pass_info{};
+    render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    render_pass_info.attachmentCount = 2;
+    render_pass_info.pAttachments = attachments;
+    render_pass_info.subpassCount = 1;
+    render_pass_info.pSubpasses = &subpass;
+    render_pass_info.dependencyCount = 2;
+    render_pass_info.pDependencies = dependencies;
+
+    if (vkCreateRenderPass(device, &render_pass_info, nullptr, second_phase_render_pass.put(device)) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create second phase render pass!");
+    }
+}
+
+void triangle_application::create_texture_sampler() {
+    if (!enable_bindless_materials) return;
+
+    VkSamplerCreateInfo sampler_info{};
+    sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler_info.magFilter = VK_FILTER_LINEAR;
+    sampler_info.minFilter = VK_FILTER_LINEAR;
+    sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    sampler_info.anisotropyEnable = VK_FALSE;
+    sampler_info.maxAnisotropy = 1.0f;
+    sampler_info.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+    sampler_info.unnormalizedCoordinates = VK_FALSE;
+    sampler_info.compareEnable = VK_FALSE;
+    sampler_info.compareOp = VK_COMPARE_OP_ALWAYS;
+    sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    sampler_info.mipLodBias = 0.0f;
+    sampler_info.minLod = 0.0f;
+    sampler_info.maxLod = VK_LOD_CLAMP_NONE;
+
+    if (vkCreateSampler(device, &sampler_info, nullptr, texture_sampler.put(device)) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create texture sampler!");
+    }
+}
+
+void triangle_application::create_descriptor_set_layout() {
+    if (!enable_bindless_materials) return;
+
+    VkPhysicalDeviceVulkan12Properties vulkan_12_properties{};
+    vulkan_12_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+
+    VkPhysicalDeviceProperties2 properties{};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties.pNext = &vulkan_12_properties;
+    vkGetPhysicalDeviceProperties2(physical_device, &properties);
 
-    std::vector<VkDynamicState> dynamic_states = {
-        VK_DYNAMIC_STATE_VIEWPORT,
-        VK_DYNAMIC_STATE_SCISSOR
+    bindless_texture_capacity = std::min({
+        MAX_BINDLESS_TEXTURES,
+        vulkan_12_properties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+        vulkan_12_properties.maxDescriptorSetUpdateAfterBindSampledImages
+    });
+
+    if (bindless_texture_capacity < TEXTURE_COUNT) {
+        throw std::runtime_error("Device cannot bind enough textures for bindless materials!");
+    }
+
+    VkDescriptorSetLayoutBinding bindings[2]{};
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+    bindings[0].descriptorCount = bindless_texture_capacity;
+    bindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    bindings[0].pImmutableSamplers = nullptr;
+
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+    bindings[1].descriptorCount = 1;
+    bindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    VkSampler immutable_sampler = texture_sampler;
+    bindings[1].pImmutableSamplers = &immutable_sampler;
+
+    // Slots that no instance uses may stay empty, and slots no pending
+    // frame reads can be filled in while frames that bound the set are
+    // still executing
+    VkDescriptorBindingFlags binding_flags[2] = {
+        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+            VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT,
+        0
     };
 
-    VkPipelineDynamicStateCreateInfo dynamic_state{};
-    dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-    dynamic_state.dynamicStateCount = dynamic_states.size();
-    dynamic_state.pDynamicStates = dynamic_states.data();
-
-    VkPipelineVertexInputStateCreateInfo vertex_input_info{};
-    vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertex_input_info.vertexBindingDescriptionCount = 0;
-    vertex_input_info.pVertexBindingDescriptions = nullptr;
-    vertex_input_info.vertexAttributeDescriptionCount = 0;
-    vertex_input_info.pVertexAttributeDescriptions = nullptr;
-
-    VkPipelineInputAssemblyStateCreateInfo input_assembly{};
-    input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-    input_assembly.primitiveRestartEnable = VK_FALSE;
-
-
-    VkPipelineViewportStateCreateInfo viewport_state{};
-    viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-    viewport_state.viewportCount = 1;
-    viewport_state.scissorCount = 1;
-
-    VkPipelineRasterizationStateCreateInfo rasterizer{};
-    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-    rasterizer.depthClampEnable = VK_FALSE;
-    rasterizer.rasterizerDiscardEnable = VK_FALSE;
-    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-    rasterizer.lineWidth = 1.0f;
-    rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-    rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
-    rasterizer.depthBiasEnable = VK_FALSE;
-    rasterizer.depthBiasConstantFactor = 0.0f;
-    rasterizer.depthBiasClamp = 0.0f;
-    rasterizer.depthBiasSlopeFactor = 0.0f;
-
-    VkPipelineMultisampleStateCreateInfo multisampling{};
-    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    multisampling.sampleShadingEnable = VK_FALSE;
-    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-    multisampling.minSampleShading = 1.0f;
-    multisampling.pSampleMask = nullptr;
-    multisampling.alphaToCoverageEnable = VK_FALSE;
-    multisampling.alphaToOneEnable = VK_FALSE;
-
-    VkPipelineColorBlendAttachmentState color_blend_attachment{};
-    color_blend_attachment.colorWriteMask =
-        VK_COLOR_COMPONENT_R_BIT |
-        VK_COLOR_COMPONENT_G_BIT |
-        VK_COLOR_COMPONENT_B_BIT |
-        VK_COLOR_COMPONENT_A_BIT;
-    color_blend_attachment.blendEnable = VK_FALSE;
-    color_blend_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
-    color_blend_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
-    color_blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;
-    color_blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-    color_blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-    color_blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
-
-    VkPipelineColorBlendStateCreateInfo color_blending{};
-    color_blending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-    color_blending.logicOpEnable = VK_FALSE;
-    color_blending.logicOp = VK_LOGIC_OP_COPY;
-    color_blending.attachmentCount = 1;
-    color_blending.pAttachments = &color_blend_attachment;
-    color_blending.blendConstants[0] = 0.0f;
-    color_blending.blendConstants[1] = 0.0f;
-    color_blending.blendConstants[2] = 0.0f;
-    color_blending.blendConstants[3] = 0.0f;
+    VkDescriptorSetLayoutBindingFlagsCreateInfo binding_flags_info{};
+    binding_flags_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    binding_flags_info.bindingCount = 2;
+    binding_flags_info.pBindingFlags = binding_flags;
+
+    VkDescriptorSetLayoutCreateInfo layout_info{};
+    layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_info.pNext = &binding_flags_info;
+    layout_info.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    layout_info.bindingCount = 2;
+    layout_info.pBindings = bindings;
+
+    if (vkCreateDescriptorSetLayout(device, &layout_info, nullptr, descriptor_set_layout.put(device)) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create descriptor set layout!");
+    }
+}
+
+void triangle_application::create_graphics_pipeline() {
+    pipeline_cache = unique_pipeline_cache(device, load_pipeline_cache(device, WINDOW_PIPELINE_CACHE_FILE));
+
+    VkPushConstantRange push_constant_range{};
+    push_constant_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    push_constant_range.offset = 0;
+    push_constant_range.size = sizeof(std::uint32_t);
 
     VkPipelineLayoutCreateInfo pipeline_layout_info{};
     pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
@@ -639,98 +1339,284 @@ void triangle_application::create_graphics_pipeline() {
     pipeline_layout_info.pSetLayouts = nullptr;
     pipeline_layout_info.pushConstantRangeCount = 0;
     pipeline_layout_info.pPushConstantRanges = nullptr;
+    VkDescriptorSetLayout set_layout = descriptor_set_layout;
+    if (enable_bindless_materials) {
+        pipeline_layout_info.setLayoutCount = 1;
+        pipeline_layout_info.pSetLayouts = &set_layout;
+        pipeline_layout_info.pushConstantRangeCount = 1;
+        pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+    }
 
-    if (vkCreatePipelineLayout(device, &pipeline_layout_info, nullptr, &pipeline_layout) != VK_SUCCESS) {
+    if (vkCreatePipelineLayout(device, &pipeline_layout_info, nullptr, pipeline_layout.put(device)) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create pipeline layout!");
     }
 
-    VkGraphicsPipelineCreateInfo pipeline_info{};
-    pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipeline_info.stageCount = 2;
-    pipeline_info.pStages = shader_stages;
-    pipeline_info.pVertexInputState = &vertex_input_info;
-    pipeline_info.pInputAssemblyState = &input_assembly;
-    pipeline_info.pViewportState = &viewport_state;
-    pipeline_info.pRasterizationState = &rasterizer;
-    pipeline_info.pMultisampleState = &multisampling;
-    pipeline_info.pDepthStencilState = nullptr;
-    pipeline_info.pColorBlendState = &color_blending;
-    pipeline_info.pDynamicState = &dynamic_state;
-    pipeline_info.layout = pipeline_layout;
-    pipeline_info.renderPass = render_pass;
-    pipeline_info.subpass = 0;
-    pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
-    pipeline_info.basePipelineIndex = -1;
-
-    if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &graphics_pipeline) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create graphics pipeline!");
+    if (!enable_bindless_materials) {
+        scene_pipelines.init(device, pipeline_cache, pipeline_layout, render_pass, "shader.vert.spv", "shader.frag.spv");
+        return;
     }
 
-    vkDestroyShaderModule(device, frag_shader_module, nullptr);
-    vkDestroyShaderModule(device, vert_shader_module, nullptr);
-}
-
-std::vector<char> triangle_application::read_file(const std::string &filename) {
-    std::ifstream file(filename, std::ios::ate | std::ios::binary);
-    if (!file.is_open()) {
-        throw std::runtime_error("Failed to open file!");
-    }
+    // The texture slot of every instance, from instance_buffers
+    VkVertexInputBindingDescription binding_description{};
+    binding_description.binding = 0;
+    binding_description.stride = sizeof(std::uint32_t);
+    binding_description.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
 
-    size_t file_size = (size_t) file.tellg();
-    std::vector<char> buffer(file_size);
+    std::vector<VkVertexInputAttributeDescription> attribute_descriptions(1);
+    attribute_descriptions[0].binding = 0;
+    attribute_descriptions[0].location = 0;
+    attribute_descriptions[0].format = VK_FORMAT_R32_UINT;
+    attribute_descriptions[0].offset = 0;
 
-    file.seekg(0);
-    file.read(buffer.data(), file_size);
-    file.close();
+    scene_pipelines.init(device, pipeline_cache, pipeline_layout, render_pass, "textured.vert.spv", "textured.frag.spv",
+            { binding_description }, attribute_descriptions);
 
-    return buffer;
 }
 
-VkShaderModule triangle_application::create_shader_module(const std::vector<char> &code) {
-    VkShaderModuleCreateInfo create_info{};
-    create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    create_info.codeSize = code.size();
-    create_info.pCode = reinterpret_cast<const std::uint32_t *>(code.data());
+void triangle_application::precompile_pipelines() {
+    // Every variant record_command_buffer() may draw with at the current
+    // sample count
+    std::vector<pipeline_key> keys;
+    for (std::uint32_t material = 0; material < MATERIAL_COUNT; material++) {
+        keys.push_back(scene_pipeline_key(material));
+    }
+    scene_pipelines.precompile(keys);
 
-    VkShaderModule shader_module;
-    if (vkCreateShaderModule(device, &create_info, nullptr, &shader_module) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create shader module!");
+    if (!mesh_file.empty()) {
+        mesh_pipelines.precompile({ mesh_pipeline_key() });
+    }
+    if (tessellation.detail > 0) {
+        tessellation_pipelines.precompile({ scene_pipeline_key(MATERIAL_OPAQUE) });
     }
+    if (occlusion_cull_instances > 0) {
+        culled_pipelines.precompile({ culled_pipeline_key() });
+    }
+}
 
-    return shader_module;
+pipeline_key triangle_application::scene_pipeline_key(std::uint32_t material) const {
+    pipeline_key key;
+    key.cull_mode = VK_CULL_MODE_BACK_BIT;
+    key.front_face = VK_FRONT_FACE_CLOCKWISE;
+    key.samples = msaa_samples;
+    key.blend = material == MATERIAL_TRANSLUCENT;
+    key.material = material;
+    return key;
+}
+
+pipeline_key triangle_application::mesh_pipeline_key() const {
+    // OBJ faces wind counter-clockwise, which mesh.vert's y flip preserves.
+    // There is no depth buffer, so culling back faces is what keeps the far
+    // side of closed meshes from showing through.
+    pipeline_key key;
+    key.cull_mode = VK_CULL_MODE_BACK_BIT;
+    key.front_face = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    key.samples = msaa_samples;
+    key.material = MATERIAL_OPAQUE;
+    return key;
+}
+
+pipeline_key triangle_application::culled_pipeline_key() const {
+    pipeline_key key = scene_pipeline_key(MATERIAL_OPAQUE);
+    key.depth_test = true;
+    return key;
+}
+
+void triangle_application::create_mesh_pipeline() {
+    if (mesh_file.empty()) return;
+
+    // Vertices are read exactly as they are stored in the mesh file
+    VkVertexInputBindingDescription binding_description{};
+    binding_description.binding = 0;
+    binding_description.stride = sizeof(mesh_vertex);
+    binding_description.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+    std::vector<VkVertexInputAttributeDescription> attribute_descriptions(2);
+    attribute_descriptions[0].binding = 0;
+    attribute_descriptions[0].location = 0;
+    attribute_descriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
+    attribute_descriptions[0].offset = offsetof(mesh_vertex, position);
+    attribute_descriptions[1].binding = 0;
+    attribute_descriptions[1].location = 1;
+    attribute_descriptions[1].format = VK_FORMAT_R8G8B8A8_SNORM;
+    attribute_descriptions[1].offset = offsetof(mesh_vertex, normal);
+
+    VkPushConstantRange push_constant_range{};
+    push_constant_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    push_constant_range.offset = 0;
+    push_constant_range.size = 6 * sizeof(float);
+
+    VkPipelineLayoutCreateInfo pipeline_layout_info{};
+    pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipeline_layout_info.pushConstantRangeCount = 1;
+    pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+
+    if (vkCreatePipelineLayout(device, &pipeline_layout_info, nullptr, mesh_pipeline_layout.put(device)) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create mesh pipeline layout!");
+    }
+
+    mesh_pipelines.init(device, pipeline_cache, mesh_pipeline_layout, render_pass, "mesh.vert.spv", "mesh.frag.spv",
+            { binding_description }, attribute_descriptions);
+}
+
+void triangle_application::create_tessellation_pipeline() {
+    if (tessellation.detail == 0) return;
+
+    std::uint32_t triangle_count = tessellation.triangle_count();
+
+    if (mesh_shader_tessellation) {
+        VkPhysicalDeviceMeshShaderPropertiesEXT mesh_shader_properties{};
+        mesh_shader_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_PROPERTIES_EXT;
+
+        VkPhysicalDeviceProperties2 properties{};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties.pNext = &mesh_shader_properties;
+        vkGetPhysicalDeviceProperties2(physical_device, &properties);
+
+        std::uint64_t group_count = (triangle_count + TESSELLATION_MESH_GROUP_SIZE - 1) / TESSELLATION_MESH_GROUP_SIZE;
+        if (split_dispatch(group_count, mesh_shader_properties.maxMeshWorkGroupCount, mesh_task_group_counts) &&
+                group_count <= mesh_shader_properties.maxMeshWorkGroupTotalCount) {
+            mesh_task_parameters = make_tessellation_parameters(tessellation, mesh_task_group_counts[0]);
+            std::cout << "Generating " << triangle_count << " triangles per frame in mesh shaders" << std::endl;
+        } else {
+            std::cout << "Too many triangles for one mesh shader dispatch, tessellating with a compute pre-pass" << std::endl;
+            mesh_shader_tessellation = false;
+        }
+    }
+
+    if (mesh_shader_tessellation) {
+        VkPushConstantRange push_constant_range{};
+        push_constant_range.stageFlags = VK_SHADER_STAGE_MESH_BIT_EXT;
+        push_constant_range.offset = 0;
+        push_constant_range.size = sizeof(tessellation_parameters);
+
+        VkPipelineLayoutCreateInfo pipeline_layout_info{};
+        pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipeline_layout_info.pushConstantRangeCount = 1;
+        pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+
+        if (vkCreatePipelineLayout(device, &pipeline_layout_info, nullptr, tessellation_pipeline_layout.put(device)) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create tessellation pipeline layout!");
+        }
+
+        tessellation_pipelines.init(device, pipeline_cache, tessellation_pipeline_layout, render_pass,
+                "tessellate.mesh.spv", "shader.frag.spv");
+        return;
+    }
+
+    // The positions tessellate.comp packs, one vertex each
+    VkVertexInputBindingDescription binding_description{};
+    binding_description.binding = 0;
+    binding_description.stride = sizeof(std::uint32_t);
+    binding_description.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+    std::vector<VkVertexInputAttributeDescription> attribute_descriptions(1);
+    attribute_descriptions[0].binding = 0;
+    attribute_descriptions[0].location = 0;
+    attribute_descriptions[0].format = VK_FORMAT_R16G16_SNORM;
+    attribute_descriptions[0].offset = 0;
+
+    VkPipelineLayoutCreateInfo pipeline_layout_info{};
+    pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+
+    if (vkCreatePipelineLayout(device, &pipeline_layout_info, nullptr, tessellation_pipeline_layout.put(device)) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create tessellation pipeline layout!");
+    }
+
+    tessellation_pipelines.init(device, pipeline_cache, tessellation_pipeline_layout, render_pass,
+            "tessellated.vert.spv", "shader.frag.spv", { binding_description }, attribute_descriptions);
+}
+
+void triangle_application::create_occlusion_culler() {
+    if (occlusion_cull_instances == 0) return;
+
+    // The pyramid build samples the depth it has been tested and written against
+    VkFormatFeatureFlags depth_features = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+    for (VkFormat format : { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D16_UNORM }) {
+        VkFormatProperties format_properties;
+        vkGetPhysicalDeviceFormatProperties(physical_device, format, &format_properties);
+        if ((format_properties.optimalTilingFeatures & depth_features) == depth_features) {
+            depth_format = format;
+            break;
+        }
+    }
+    if (depth_format == VK_FORMAT_UNDEFINED) {
+        throw std::runtime_error("No depth format can be sampled for occlusion culling!");
+    }
+
+    culler.init(physical_device, device, occlusion_cull_instances, MAX_FRAMES_IN_FLIGHT);
+    start_time = std::chrono::steady_clock::now();
+    std::cout << "Occlusion culling " << occlusion_cull_instances << " instances against a hierarchical Z pyramid" << std::endl;
+}
+
+void triangle_application::create_culled_pipeline() {
+    if (occlusion_cull_instances == 0) return;
+
+    culled_pipelines.init(device, pipeline_cache, culler.draw_layout(), render_pass, "culled.vert.spv", "shader.frag.spv");
+}
+
+void triangle_application::tessellate_scene() {
+    if (tessellation.detail == 0 || mesh_shader_tessellation) return;
+
+    queue_family_indices indices = find_queue_families(physical_device, surfaces[0].surface);
+
+    std::uint32_t queue_family_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, nullptr);
+
+    std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, queue_families.data());
+
+    if (!(queue_families[indices.graphics_family.value()].queueFlags & VK_QUEUE_COMPUTE_BIT)) {
+        throw std::runtime_error("Graphics queue cannot run the tessellation pre-pass!");
+    }
+
+    tessellated = generate_tessellation(physical_device, device, graphics_queue, indices.graphics_family.value(), tessellation);
+}
+
+void triangle_application::load_scene_mesh() {
+    if (mesh_file.empty()) return;
+
+    queue_family_indices indices = find_queue_families(physical_device, surfaces[0].surface);
+    mesh = load_mesh(physical_device, device, graphics_queue, indices.graphics_family.value(), host_pointer_import, mesh_file);
+    start_time = std::chrono::steady_clock::now();
 }
 
 void triangle_application::create_framebuffers() {
-    swap_chain_framebuffers.resize(swap_chain_image_views.size());
-    for (size_t i = 0; i < swap_chain_image_views.size(); i++) {
-        VkImageView attachments[] = {
-            swap_chain_image_views[i]
-        };
+    VkExtent2D target_extent = scaled_extent(render_scale_limit);
+    offscreen_framebuffers.resize(offscreen_image_views.size());
+    for (size_t i = 0; i < offscreen_image_views.size(); i++) {
+        std::vector<VkImageView> attachments;
+        if (msaa_samples != VK_SAMPLE_COUNT_1_BIT) {
+            attachments.push_back(msaa_image_view);
+        }
+        attachments.push_back(offscreen_image_views[i]);
+        if (depth_image_view) {
+            attachments.push_back(depth_image_view);
+        }
 
         VkFramebufferCreateInfo framebuffer_info{};
         framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
         framebuffer_info.renderPass = render_pass;
-        framebuffer_info.attachmentCount = 1;
-        framebuffer_info.pAttachments = attachments;
-        framebuffer_info.width = swap_chain_extent.width;
-        framebuffer_info.height = swap_chain_extent.height;
+        framebuffer_info.attachmentCount = attachments.size();
+        framebuffer_info.pAttachments = attachments.data();
+        framebuffer_info.width = target_extent.width;
+        framebuffer_info.height = target_extent.height;
         framebuffer_info.layers = 1;
 
-        if (vkCreateFramebuffer(device, &framebuffer_info, nullptr, &swap_chain_framebuffers[i]) != VK_SUCCESS) {
+        if (vkCreateFramebuffer(device, &framebuffer_info, nullptr, offscreen_framebuffers[i].put(device)) != VK_SUCCESS) {
             throw std::runtime_error("Failed to create framebuffer!");
         }
     }
 }
 
 void triangle_application::create_command_pool() {
-    queue_family_indices queue_family_indices = find_queue_families(physical_device, surface);
+    queue_family_indices queue_family_indices = find_queue_families(physical_device, surfaces[0].surface);
 
     VkCommandPoolCreateInfo pool_info{};
     pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
     pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
     pool_info.queueFamilyIndex = queue_family_indices.graphics_family.value();
 
-    if (vkCreateCommandPool(device, &pool_info, nullptr, &command_pool) != VK_SUCCESS) {
+    if (vkCreateCommandPool(device, &pool_info, nullptr, command_pool.put(device)) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create command pool!");
     }
 }
@@ -749,7 +1635,164 @@ void triangle_application::create_command_buffers() {
     }
 }
 
-void triangle_application::record_command_buffer(VkCommandBuffer command_buffer, std::uint32_t image_index) {
+void triangle_application::create_textures() {
+    if (!enable_bindless_materials) return;
+
+    const VkDeviceSize texture_bytes = TEXTURE_SIZE * TEXTURE_SIZE * 4;
+    const VkDeviceSize staging_size = texture_bytes * TEXTURE_COUNT;
+
+    VkBuffer staging_buffer;
+    VkDeviceMemory staging_buffer_memory;
+    create_buffer(physical_device, device, staging_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            0, staging_buffer, staging_buffer_memory);
+
+    // Texture 0 is plain white so a single instance looks like the untextured
+    // triangle; the others are checkerboards with a per-texture tint
+    void *data;
+    vkMapMemory(device, staging_buffer_memory, 0, staging_size, 0, &data);
+    auto pixels = static_cast<std::uint8_t *>(data);
+    for (std::uint32_t t = 0; t < TEXTURE_COUNT; t++) {
+        std::uint8_t tint[3] = {
+            static_cast<std::uint8_t>(64 + (t * 67) % 192),
+            static_cast<std::uint8_t>(64 + (t * 131) % 192),
+            static_cast<std::uint8_t>(64 + (t * 197) % 192)
+        };
+
+        for (std::uint32_t y = 0; y < TEXTURE_SIZE; y++) {
+            for (std::uint32_t x = 0; x < TEXTURE_SIZE; x++) {
+                bool tinted = t != 0 && ((x / 8) + (y / 8)) % 2 == 1;
+                for (int c = 0; c < 3; c++) {
+                    *pixels++ = tinted ? tint[c] : 255;
+                }
+                *pixels++ = 255;
+            }
+        }
+    }
+    vkUnmapMemory(device, staging_buffer_memory);
+
+    texture_images.resize(TEXTURE_COUNT);
+    texture_image_memories.resize(TEXTURE_COUNT);
+    texture_image_views.resize(TEXTURE_COUNT);
+
+    VkCommandBuffer command_buffer = begin_single_time_commands();
+
+    for (std::uint32_t t = 0; t < TEXTURE_COUNT; t++) {
+        create_image(physical_device, device, TEXTURE_SIZE, TEXTURE_SIZE, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_UNORM,
+                VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, *texture_images[t].put(device), *texture_image_memories[t].put(device));
+
+        transition_image_layout(command_buffer, texture_images[t], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+        VkBufferImageCopy region{};
+        region.bufferOffset = texture_bytes * t;
+        region.bufferRowLength = 0;
+        region.bufferImageHeight = 0;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = 0;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageOffset = { 0, 0, 0 };
+        region.imageExtent = { TEXTURE_SIZE, TEXTURE_SIZE, 1 };
+
+        vkCmdCopyBufferToImage(command_buffer, staging_buffer, texture_images[t], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+        transition_image_layout(command_buffer, texture_images[t], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    }
+
+    end_single_time_commands(command_buffer);
+
+    for (std::uint32_t t = 0; t < TEXTURE_COUNT; t++) {
+        texture_image_views[t] = unique_image_view(device,
+                create_image_view(device, texture_images[t], VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT));
+    }
+
+    vkDestroyBuffer(device, staging_buffer, nullptr);
+    vkFreeMemory(device, staging_buffer_memory, nullptr);
+}
+
+void triangle_application::create_descriptor_pool() {
+    if (!enable_bindless_materials) return;
+
+    VkDescriptorPoolSize pool_sizes[2]{};
+    pool_sizes[0].type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+    pool_sizes[0].descriptorCount = bindless_texture_capacity;
+    pool_sizes[1].type = VK_DESCRIPTOR_TYPE_SAMPLER;
+    pool_sizes[1].descriptorCount = 1;
+
+    VkDescriptorPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    pool_info.poolSizeCount = 2;
+    pool_info.pPoolSizes = pool_sizes;
+    pool_info.maxSets = 1;
+
+    if (vkCreateDescriptorPool(device, &pool_info, nullptr, descriptor_pool.put(device)) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create descriptor pool!");
+    }
+}
+
+void triangle_application::create_descriptor_set() {
+    if (!enable_bindless_materials) return;
+
+    VkDescriptorSetAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool = descriptor_pool;
+    alloc_info.descriptorSetCount = 1;
+    VkDescriptorSetLayout set_layout = descriptor_set_layout;
+    alloc_info.pSetLayouts = &set_layout;
+
+    if (vkAllocateDescriptorSets(device, &alloc_info, &descriptor_set) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate descriptor sets!");
+    }
+
+    // Only the slots that hold a texture are written, the rest of the array
+    // stays unbound
+    std::vector<VkDescriptorImageInfo> image_infos(TEXTURE_COUNT);
+    for (std::uint32_t t = 0; t < TEXTURE_COUNT; t++) {
+        image_infos[t].sampler = VK_NULL_HANDLE;
+        image_infos[t].imageView = texture_image_views[t];
+        image_infos[t].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    }
+
+    VkWriteDescriptorSet descriptor_write{};
+    descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptor_write.dstSet = descriptor_set;
+    descriptor_write.dstBinding = 0;
+    descriptor_write.dstArrayElement = 0;
+    descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+    descriptor_write.descriptorCount = image_infos.size();
+    descriptor_write.pImageInfo = image_infos.data();
+
+    vkUpdateDescriptorSets(device, 1, &descriptor_write, 0, nullptr);
+}
+
+void triangle_application::create_instance_buffers() {
+    if (!enable_bindless_materials) return;
+
+    // Enough for one instance per slot, however many textures are streamed in
+    VkDeviceSize buffer_size = std::max(INSTANCE_COUNT, bindless_texture_capacity) * sizeof(std::uint32_t);
+
+    instance_buffers.resize(MAX_FRAMES_IN_FLIGHT);
+    instance_buffer_memories.resize(MAX_FRAMES_IN_FLIGHT);
+    instance_texture_slots.resize(MAX_FRAMES_IN_FLIGHT);
+
+    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        VkBuffer buffer;
+        VkDeviceMemory buffer_memory;
+        create_buffer(physical_device, device, buffer_size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 0, buffer, buffer_memory);
+        instance_buffers[i] = unique_buffer(device, buffer);
+        instance_buffer_memories[i] = unique_device_memory(device, buffer_memory);
+
+        // Freeing the memory unmaps it
+        void *data;
+        vkMapMemory(device, buffer_memory, 0, buffer_size, 0, &data);
+        instance_texture_slots[i] = static_cast<std::uint32_t *>(data);
+    }
+}
+
+void triangle_application::record_command_buffer(VkCommandBuffer command_buffer) {
     VkCommandBufferBeginInfo begin_info{};
     begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
     begin_info.flags = 0;
@@ -759,47 +1802,214 @@ void triangle_application::record_command_buffer(VkCommandBuffer command_buffer,
         throw std::runtime_error("Failed to begin recording command buffer!");
     }
 
+    if (timestamp_query_pool != VK_NULL_HANDLE) {
+        vkCmdResetQueryPool(command_buffer, timestamp_query_pool, current_frame * 2, 2);
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestamp_query_pool, current_frame * 2);
+    }
+
+    VkExtent2D extent = render_extent();
+    float scene_time = std::chrono::duration<float>(std::chrono::steady_clock::now() - start_time).count();
+
+    if (occlusion_cull_instances > 0) {
+        culler.record_first_phase(command_buffer, scene_time);
+    }
+
     VkRenderPassBeginInfo render_pass_info{};
     render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
     render_pass_info.renderPass = render_pass;
-    render_pass_info.framebuffer = swap_chain_framebuffers[image_index];
+    render_pass_info.framebuffer = offscreen_framebuffers[current_frame];
     render_pass_info.renderArea.offset = { 0, 0 };
-    render_pass_info.renderArea.extent = swap_chain_extent;
-    VkClearValue clear_color = { { { 0.0f, 0.0f, 0.0f, 1.0f } } };
-    render_pass_info.clearValueCount = 1;
-    render_pass_info.pClearValues = &clear_color;
+    render_pass_info.renderArea.extent = extent;
+    VkClearValue clear_values[2]{};
+    clear_values[0].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
+    clear_values[1].depthStencil = { 1.0f, 0 };
+    render_pass_info.clearValueCount = depth_image_view ? 2 : 1;
+    render_pass_info.pClearValues = clear_values;
 
     vkCmdBeginRenderPass(command_buffer, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
 
-    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphics_pipeline);
-
     VkViewport viewport{};
     viewport.x = 0.0f;
     viewport.y = 0.0f;
-    viewport.width = static_cast<float>(swap_chain_extent.width);
-    viewport.height = static_cast<float>(swap_chain_extent.height);
+    viewport.width = static_cast<float>(extent.width);
+    viewport.height = static_cast<float>(extent.height);
     viewport.minDepth = 0.0f;
     viewport.maxDepth = 1.0f;
     vkCmdSetViewport(command_buffer, 0, 1, &viewport);
 
     VkRect2D scissor{};
     scissor.offset = { 0, 0 };
-    scissor.extent = swap_chain_extent;
+    scissor.extent = extent;
     vkCmdSetScissor(command_buffer, 0, 1, &scissor);
 
-    vkCmdDraw(command_buffer, 3, 1, 0, 0);
+    if (occlusion_cull_instances > 0) {
+        // What was visible last frame is most of what is visible now, and
+        // the depth it leaves decides what else has to be drawn
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, culled_pipelines.get(culled_pipeline_key()));
+        culler.draw(command_buffer, 0, scene_time);
+        vkCmdEndRenderPass(command_buffer);
+
+        culler.record_second_phase(command_buffer, extent, scene_time);
+
+        render_pass_info.renderPass = second_phase_render_pass;
+        render_pass_info.clearValueCount = 0;
+        render_pass_info.pClearValues = nullptr;
+        vkCmdBeginRenderPass(command_buffer, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
+        culler.draw(command_buffer, 1, scene_time);
+    } else if (tessellation.detail > 0) {
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, tessellation_pipelines.get(scene_pipeline_key(MATERIAL_OPAQUE)));
+
+        if (mesh_shader_tessellation) {
+            vkCmdPushConstants(command_buffer, tessellation_pipeline_layout, VK_SHADER_STAGE_MESH_BIT_EXT, 0,
+                    sizeof(mesh_task_parameters), &mesh_task_parameters);
+            cmd_draw_mesh_tasks(command_buffer, mesh_task_group_counts[0], mesh_task_group_counts[1], 1);
+        } else {
+            for (const auto &chunk : tessellated.chunks) {
+                VkBuffer vertex_buffer = chunk.buffer;
+                VkDeviceSize vertex_offset = 0;
+                vkCmdBindVertexBuffers(command_buffer, 0, 1, &vertex_buffer, &vertex_offset);
+                vkCmdDraw(command_buffer, chunk.vertex_count, 1, 0, 0);
+            }
+        }
+    } else if (mesh.buffer) {
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mesh_pipelines.get(mesh_pipeline_key()));
+
+        float radius = 0.0f;
+        float push_constants[6];
+        for (int axis = 0; axis < 3; axis++) {
+            float half_size = (mesh.bounds_max[axis] - mesh.bounds_min[axis]) * 0.5f;
+            push_constants[axis] = mesh.bounds_min[axis] + half_size;
+            radius += half_size * half_size;
+        }
+        push_constants[3] = radius > 0.0f ? 1.0f / std::sqrt(radius) : 1.0f;
+        push_constants[4] = std::chrono::duration<float>(std::chrono::steady_clock::now() - start_time).count() * 0.5f;
+        push_constants[5] = static_cast<float>(extent.width) / static_cast<float>(extent.height);
+        vkCmdPushConstants(command_buffer, mesh_pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(push_constants), push_constants);
+
+        // Both blocks live in the one buffer the file was copied into
+        VkBuffer vertex_buffer = mesh.buffer;
+        VkDeviceSize vertex_offset = mesh.vertex_offset;
+        vkCmdBindVertexBuffers(command_buffer, 0, 1, &vertex_buffer, &vertex_offset);
+        vkCmdBindIndexBuffer(command_buffer, mesh.buffer, mesh.index_offset, VK_INDEX_TYPE_UINT32);
+
+        vkCmdDrawIndexed(command_buffer, mesh.index_count, 1, 0, 0, 0);
+    } else if (enable_bindless_materials) {
+        // One descriptor set for every instance; each picks its texture through the instance buffer
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 0, 1, &descriptor_set, 0, nullptr);
+
+        // Once textures have been streamed in, they are shown instead of the
+        // procedural ones, one instance each
+        std::uint32_t instance_count = INSTANCE_COUNT;
+        std::uint32_t first_texture = 0;
+        std::uint32_t texture_count = TEXTURE_COUNT;
+        if (streamed_texture_count > 0) {
+            instance_count = std::max(INSTANCE_COUNT, streamed_texture_count);
+            first_texture = TEXTURE_COUNT;
+            texture_count = streamed_texture_count;
+        }
+
+        // The slot's previous frame has completed, so its buffer is free
+        std::uint32_t *texture_slots = instance_texture_slots[current_frame];
+        for (std::uint32_t i = 0; i < instance_count; i++) {
+            texture_slots[i] = first_texture + i % texture_count;
+        }
+        VkBuffer instance_buffer = instance_buffers[current_frame];
+        VkDeviceSize instance_offset = 0;
+        vkCmdBindVertexBuffers(command_buffer, 0, 1, &instance_buffer, &instance_offset);
+
+        std::uint32_t instance_columns = static_cast<std::uint32_t>(std::ceil(std::sqrt(static_cast<double>(instance_count))));
+        vkCmdPushConstants(command_buffer, pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(instance_columns),
+                &instance_columns);
+
+        // The grid is split into one run of instances per material, each
+        // drawn with its own pipeline variant
+        std::uint32_t run_length = (instance_count + MATERIAL_COUNT - 1) / MATERIAL_COUNT;
+        for (std::uint32_t material = 0; material < MATERIAL_COUNT; material++) {
+            std::uint32_t first_instance = material * run_length;
+            if (first_instance >= instance_count) {
+                break;
+            }
+
+            vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, scene_pipelines.get(scene_pipeline_key(material)));
+            vkCmdDraw(command_buffer, 3, std::min(run_length, instance_count - first_instance), 0, first_instance);
+        }
+    } else {
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, scene_pipelines.get(scene_pipeline_key(MATERIAL_OPAQUE)));
+        vkCmdDraw(command_buffer, 3, 1, 0, 0);
+    }
 
     vkCmdEndRenderPass(command_buffer);
 
+    if (occlusion_cull_instances > 0) {
+        culler.record_counts(command_buffer, current_frame);
+    }
+
+    // Upscale the rendered region into every surface's acquired image
+    std::vector<VkImageMemoryBarrier> barriers(frame_surfaces.size());
+    for (size_t i = 0; i < frame_surfaces.size(); i++) {
+        const presentation_surface &target = *frame_surfaces[i];
+        VkImageMemoryBarrier &barrier = barriers[i];
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = target.images[target.image_index];
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    }
+
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+            0, nullptr, 0, nullptr, barriers.size(), barriers.data());
+
+    for (const presentation_surface *target : frame_surfaces) {
+        VkImageBlit blit{};
+        blit.srcOffsets[0] = { 0, 0, 0 };
+        blit.srcOffsets[1] = { static_cast<std::int32_t>(extent.width), static_cast<std::int32_t>(extent.height), 1 };
+        blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        blit.srcSubresource.mipLevel = 0;
+        blit.srcSubresource.baseArrayLayer = 0;
+        blit.srcSubresource.layerCount = 1;
+        blit.dstOffsets[0] = { 0, 0, 0 };
+        blit.dstOffsets[1] = { static_cast<std::int32_t>(target->extent.width), static_cast<std::int32_t>(target->extent.height), 1 };
+        blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        blit.dstSubresource.mipLevel = 0;
+        blit.dstSubresource.baseArrayLayer = 0;
+        blit.dstSubresource.layerCount = 1;
+
+        vkCmdBlitImage(command_buffer,
+                offscreen_images[current_frame], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                target->images[target->image_index], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                1, &blit, upscale_filter);
+    }
+
+    for (auto &barrier : barriers) {
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = 0;
+    }
+
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+            0, nullptr, 0, nullptr, barriers.size(), barriers.data());
+
+    if (timestamp_query_pool != VK_NULL_HANDLE) {
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestamp_query_pool, current_frame * 2 + 1);
+    }
+
     if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
         throw std::runtime_error("Failed to record command buffer!");
     }
 }
 
 void triangle_application::create_sync_objects() {
-    image_available_semaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    render_finished_semaphores.resize(MAX_FRAMES_IN_FLIGHT);
     in_flight_fences.resize(MAX_FRAMES_IN_FLIGHT);
+    frame_numbers.assign(MAX_FRAMES_IN_FLIGHT, 0);
 
     VkSemaphoreCreateInfo semaphore_info{};
     semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -809,17 +2019,129 @@ void triangle_application::create_sync_objects() {
     fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
     for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        if (vkCreateSemaphore(device, &semaphore_info, nullptr, &image_available_semaphores[i]) != VK_SUCCESS ||
-               vkCreateSemaphore(device, &semaphore_info, nullptr, &render_finished_semaphores[i]) != VK_SUCCESS ||
-               vkCreateFence(device, &fence_info, nullptr, &in_flight_fences[i]) != VK_SUCCESS) {
+        if (vkCreateFence(device, &fence_info, nullptr, in_flight_fences[i].put(device)) != VK_SUCCESS) {
             throw std::runtime_error("Failed to create sync objects!");
         }
     }
+
+    for (auto &target : surfaces) {
+        target.image_available_semaphores.resize(MAX_FRAMES_IN_FLIGHT);
+        target.render_finished_semaphores.resize(MAX_FRAMES_IN_FLIGHT);
+
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            if (vkCreateSemaphore(device, &semaphore_info, nullptr, target.image_available_semaphores[i].put(device)) != VK_SUCCESS ||
+                   vkCreateSemaphore(device, &semaphore_info, nullptr, target.render_finished_semaphores[i].put(device)) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create sync objects!");
+            }
+        }
+    }
+}
+
+
+void triangle_application::create_timestamp_queries() {
+    queue_family_indices indices = find_queue_families(physical_device, surfaces[0].surface);
+
+    std::uint32_t queue_family_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, nullptr);
+
+    std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, queue_families.data());
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+
+    render_scale = MAX_RENDER_SCALE;
+    last_frame_time = std::chrono::steady_clock::now();
+    last_report_time = last_frame_time;
+
+    // Without GPU timestamps the controller falls back to CPU frame times
+    if (queue_families[indices.graphics_family.value()].timestampValidBits == 0) {
+        std::cout << "GPU timestamps not supported, using CPU frame times for resolution scaling" << std::endl;
+        return;
+    }
+
+    timestamp_period = properties.limits.timestampPeriod;
+    timestamps_written.assign(MAX_FRAMES_IN_FLIGHT, false);
+
+    VkQueryPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    pool_info.queryCount = MAX_FRAMES_IN_FLIGHT * 2;
+
+    if (vkCreateQueryPool(device, &pool_info, nullptr, timestamp_query_pool.put(device)) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create timestamp query pool!");
+    }
 }
 
+void triangle_application::create_texture_streamer() {
+    if (texture_files.empty()) return;
+
+    if (!enable_bindless_materials) {
+        std::cerr << "Texture streaming needs bindless materials, ignoring the textures" << std::endl;
+        return;
+    }
+
+    queue_family_indices indices = find_queue_families(physical_device, surfaces[0].surface);
+    streamer.init(physical_device, device, indices.graphics_family.value(), graphics_queue, transfer_family, transfer_queue);
+    if (transfer_family != indices.graphics_family.value()) {
+        std::cout << "Streaming textures through the dedicated transfer queue family " << transfer_family << std::endl;
+    }
+
+    for (const auto &path : texture_files) {
+        streamer.request(path);
+    }
+}
+
+void triangle_application::update_streamed_textures() {
+    if (texture_files.empty() || !enable_bindless_materials) return;
+
+    for (const auto &texture : streamer.update(scheduler)) {
+        std::uint32_t slot = TEXTURE_COUNT + streamed_texture_count;
+        if (slot >= bindless_texture_capacity) {
+            std::cerr << "No bindless slot left for " << texture.path << std::endl;
+            continue;
+        }
+
+        // Frames in flight have the set bound, which only allows writing
+        // slots they never read with UPDATE_UNUSED_WHILE_PENDING; no frame
+        // has been recorded with this slot yet
+        VkDescriptorImageInfo image_info{};
+        image_info.sampler = VK_NULL_HANDLE;
+        image_info.imageView = texture.image_view;
+        image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        VkWriteDescriptorSet descriptor_write{};
+        descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptor_write.dstSet = descriptor_set;
+        descriptor_write.dstBinding = 0;
+        descriptor_write.dstArrayElement = slot;
+        descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+        descriptor_write.descriptorCount = 1;
+        descriptor_write.pImageInfo = &image_info;
+
+        vkUpdateDescriptorSets(device, 1, &descriptor_write, 0, nullptr);
+        streamed_texture_count++;
+        // RGBA8, and a third more for the mip chain
+        streamed_texture_bytes += static_cast<VkDeviceSize>(texture.width) * texture.height * 4 * 4 / 3;
+    }
+}
 
 void triangle_application::main_loop() {
-    while (!glfwWindowShouldClose(window)) {
+    if (headless_surfaces) {
+        for (std::uint32_t i = 0; i < headless_frame_count; i++) {
+            draw_frame();
+        }
+        vkDeviceWaitIdle(device);
+        return;
+    }
+
+    // Closing any of the windows quits
+    auto any_window_closed = [this]() {
+        return std::any_of(surfaces.begin(), surfaces.end(),
+                [](const presentation_surface &target) { return glfwWindowShouldClose(target.window); });
+    };
+
+    while (!any_window_closed()) {
         glfwPollEvents();
         draw_frame();
     }
@@ -827,81 +2149,385 @@ void triangle_application::main_loop() {
 }
 
 void triangle_application::draw_frame() {
-    vkWaitForFences(device, 1, &in_flight_fences[current_frame], VK_TRUE, std::numeric_limits<std::uint64_t>::max());
+    VkFence in_flight_fence = in_flight_fences[current_frame];
+    vkWaitForFences(device, 1, &in_flight_fence, VK_TRUE, std::numeric_limits<std::uint64_t>::max());
+    retired_resources.collect(frame_numbers[current_frame]);
+    if (occlusion_cull_instances > 0 && frame_numbers[current_frame] > 0) {
+        culler.read_counts(current_frame, drawn_first_phase, drawn_second_phase);
+    }
+    update_streamed_textures();
+    check_memory_budget();
+
+    auto now = std::chrono::steady_clock::now();
+    double frame_time_ms = std::chrono::duration<double, std::milli>(now - last_frame_time).count();
+    last_frame_time = now;
+
+    // The fence guarantees this frame slot's previous timestamps are available
+    read_gpu_frame_time(frame_time_ms);
+    update_render_scale(frame_time_ms);
+    report_frame_stats();
+
+    // An out of date swap chain is recreated and acquired from again rather
+    // than skipping the frame, which would leave the other surfaces' wait
+    // semaphores signalled. Only a minimised window, which nothing is
+    // acquired from, is left out of the frame.
+    frame_surfaces.clear();
+    for (auto &target : surfaces) {
+        if (target.window && window_minimized(target.window)) {
+            target.minimized = true;
+            continue;
+        }
+        if (target.minimized) {
+            recreate_swap_chain(target);
+        }
 
-    std::uint32_t image_index;
-    VkResult result = vkAcquireNextImageKHR(device, swap_chain, std::numeric_limits<std::uint64_t>::max(), image_available_semaphores[current_frame], VK_NULL_HANDLE, &image_index);
+        VkResult result;
+        while ((result = vkAcquireNextImageKHR(device, target.swap_chain, std::numeric_limits<std::uint64_t>::max(),
+                        target.image_available_semaphores[current_frame], VK_NULL_HANDLE, &target.image_index))
+                == VK_ERROR_OUT_OF_DATE_KHR) {
+            recreate_swap_chain(target);
+            if (target.minimized) {
+                break;
+            }
+        }
+        if (target.minimized) {
+            continue;
+        }
+
+        if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+            throw std::runtime_error("Failed to acquire swap chain image!");
+        }
+        frame_surfaces.push_back(&target);
+    }
 
-    if (result == VK_ERROR_OUT_OF_DATE_KHR) {
-        recreate_swap_chain();
+    // With every window minimised there is nothing to render for
+    if (frame_surfaces.empty()) {
+        glfwWaitEvents();
         return;
-    } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
-        throw std::runtime_error("Failed to acquire swap chain image!");
     }
 
-    vkResetFences(device, 1, &in_flight_fences[current_frame]);
+    vkResetFences(device, 1, &in_flight_fence);
 
     vkResetCommandBuffer(command_buffers[current_frame], 0);
-    record_command_buffer(command_buffers[current_frame], image_index);
+    record_command_buffer(command_buffers[current_frame]);
+    if (timestamp_query_pool != VK_NULL_HANDLE) {
+        timestamps_written[current_frame] = true;
+    }
 
-    VkSubmitInfo submit_info{};
-    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    VkSemaphore wait_semaphores[] = { image_available_semaphores[current_frame] };
-    VkPipelineStageFlags wait_stages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-    submit_info.waitSemaphoreCount = 1;
-    submit_info.pWaitSemaphores = wait_semaphores;
-    submit_info.pWaitDstStageMask = wait_stages;
-    submit_info.commandBufferCount = 1;
-    submit_info.pCommandBuffers = &command_buffers[current_frame];
-    VkSemaphore signal_semaphores[] = { render_finished_semaphores[current_frame] };
-    submit_info.signalSemaphoreCount = 1;
-    submit_info.pSignalSemaphores = signal_semaphores;
+    // One submission and one present for all surfaces in the frame
+    submit_batch frame_batch;
+    frame_batch.command_buffers.push_back(command_buffers[current_frame]);
+    std::vector<VkSemaphore> signal_semaphores;
+    std::vector<VkSwapchainKHR> swap_chains;
+    std::vector<std::uint32_t> image_indices;
+    for (const presentation_surface *target : frame_surfaces) {
+        // Only the upscaling blits touch the swap chain images
+        frame_batch.waits.push_back({ target->image_available_semaphores[current_frame], 0, VK_PIPELINE_STAGE_TRANSFER_BIT });
+        frame_batch.signals.push_back({ target->render_finished_semaphores[current_frame] });
+        signal_semaphores.push_back(target->render_finished_semaphores[current_frame]);
+        swap_chains.push_back(target->swap_chain);
+        image_indices.push_back(target->image_index);
+    }
 
-    if (vkQueueSubmit(graphics_queue, 1, &submit_info, in_flight_fences[current_frame]) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to submit draw command buffer!");
+    // Goes out together with the texture uploads update_streamed_textures()
+    // enqueued, in one call per queue
+    scheduler.enqueue(graphics_queue, std::move(frame_batch), in_flight_fence);
+    scheduler.flush();
+    frame_numbers[current_frame] = ++submitted_frames;
+
+    // A slot's previous present was queued MAX_FRAMES_IN_FLIGHT frames ago
+    std::vector<VkFence> present_fences;
+    if (swapchain_maintenance_1_enabled) {
+        for (const presentation_surface *target : frame_surfaces) {
+            present_fences.push_back(target->present_fences[current_frame]);
+        }
+        vkWaitForFences(device, present_fences.size(), present_fences.data(), VK_TRUE, std::numeric_limits<std::uint64_t>::max());
+        vkResetFences(device, present_fences.size(), present_fences.data());
     }
 
+    VkSwapchainPresentFenceInfoEXT present_fence_info{};
+    present_fence_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_PRESENT_FENCE_INFO_EXT;
+    present_fence_info.swapchainCount = present_fences.size();
+    present_fence_info.pFences = present_fences.data();
+
+    std::vector<VkResult> results(frame_surfaces.size());
     VkPresentInfoKHR present_info{};
     present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-    present_info.waitSemaphoreCount = 1;
-    present_info.pWaitSemaphores = signal_semaphores;
-    VkSwapchainKHR swap_chains[] = { swap_chain };
-    present_info.swapchainCount = 1;
-    present_info.pSwapchains = swap_chains;
-    present_info.pImageIndices = &image_index;
-    present_info.pResults = nullptr;
-
-    result = vkQueuePresentKHR(present_queue, &present_info);
-
-    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebuffer_resized) {
-        framebuffer_resized = false;
-        recreate_swap_chain();
-    } else if (result != VK_SUCCESS) {
-        throw std::runtime_error("Failed to present swap chain image!");
+    present_info.waitSemaphoreCount = signal_semaphores.size();
+    present_info.pWaitSemaphores = signal_semaphores.data();
+    present_info.swapchainCount = swap_chains.size();
+    present_info.pSwapchains = swap_chains.data();
+    present_info.pImageIndices = image_indices.data();
+    present_info.pResults = results.data();
+    if (swapchain_maintenance_1_enabled) {
+        present_info.pNext = &present_fence_info;
+    }
+
+    vkQueuePresentKHR(present_queue, &present_info);
+
+    for (size_t i = 0; i < frame_surfaces.size(); i++) {
+        presentation_surface &target = *frame_surfaces[i];
+        if (results[i] == VK_SUCCESS || results[i] == VK_SUBOPTIMAL_KHR) {
+            release_old_swap_chains(target);
+        }
+        if (results[i] == VK_ERROR_OUT_OF_DATE_KHR || results[i] == VK_SUBOPTIMAL_KHR || target.resized) {
+            target.resized = false;
+            recreate_swap_chain(target);
+        } else if (results[i] != VK_SUCCESS) {
+            throw std::runtime_error("Failed to present swap chain image!");
+        }
     }
 
     current_frame = (current_frame + 1) % MAX_FRAMES_IN_FLIGHT;
 }
 
+VkExtent2D triangle_application::scaled_extent(float scale) {
+    VkExtent2D extent;
+    extent.width = std::max(1u, static_cast<std::uint32_t>(std::lround(swap_chain_extent.width * scale)));
+    extent.height = std::max(1u, static_cast<std::uint32_t>(std::lround(swap_chain_extent.height * scale)));
+    return extent;
+}
+
+VkExtent2D triangle_application::render_extent() {
+    return scaled_extent(render_scale);
+}
+
+bool triangle_application::read_gpu_frame_time(double &frame_time_ms) {
+    if (timestamp_query_pool == VK_NULL_HANDLE || !timestamps_written[current_frame]) {
+        return false;
+    }
+
+    std::uint64_t timestamps[2];
+    VkResult result = vkGetQueryPoolResults(device, timestamp_query_pool, current_frame * 2, 2,
+            sizeof(timestamps), timestamps, sizeof(std::uint64_t), VK_QUERY_RESULT_64_BIT);
+    if (result != VK_SUCCESS) {
+        return false;
+    }
+
+    frame_time_ms = static_cast<double>(timestamps[1] - timestamps[0]) * timestamp_period / 1e6;
+    return true;
+}
+
+void triangle_application::update_render_scale(double frame_time_ms) {
+    if (smoothed_frame_time_ms == 0.0) {
+        smoothed_frame_time_ms = frame_time_ms;
+    } else {
+        smoothed_frame_time_ms += 0.1 * (frame_time_ms - smoothed_frame_time_ms);
+    }
+
+    if (smoothed_frame_time_ms <= 0.0) {
+        return;
+    }
+
+    // Fill cost grows with the pixel count, i.e. with the square of the
+    // scale. Only react outside a dead band so the scale doesn't oscillate.
+    if (smoothed_frame_time_ms > FRAME_TIME_BUDGET_MS || smoothed_frame_time_ms < FRAME_TIME_BUDGET_MS * 0.85) {
+        double target_scale = render_scale * std::sqrt(FRAME_TIME_BUDGET_MS * 0.925 / smoothed_frame_time_ms);
+        render_scale += 0.1f * static_cast<float>(target_scale - render_scale);
+        render_scale = std::clamp(render_scale, MIN_RENDER_SCALE, render_scale_limit);
+    }
+}
+
+void triangle_application::report_frame_stats() {
+    frames_since_report++;
+
+    auto now = std::chrono::steady_clock::now();
+    double elapsed_s = std::chrono::duration<double>(now - last_report_time).count();
+    if (elapsed_s < STATS_REPORT_INTERVAL_S) {
+        return;
+    }
+
+    VkExtent2D extent = render_extent();
+    std::cout << "Render scale " << render_scale
+        << " (" << extent.width << "x" << extent.height << " of "
+        << swap_chain_extent.width << "x" << swap_chain_extent.height << "), "
+        << (timestamp_query_pool != VK_NULL_HANDLE ? "GPU" : "CPU") << " frame time "
+        << smoothed_frame_time_ms << " ms (budget " << FRAME_TIME_BUDGET_MS << " ms), "
+        << frames_since_report / elapsed_s << " fps" << std::endl;
+
+    if (tessellation.detail > 0) {
+        double triangles = static_cast<double>(tessellation.triangle_count());
+        std::cout << "Geometry: " << tessellation.triangle_count() << " triangles per frame from "
+            << (mesh_shader_tessellation ? "mesh shaders" : "the vertex buffer") << ", "
+            << triangles * frames_since_report / elapsed_s / 1e6 << " M triangles/s" << std::endl;
+    }
+    if (occlusion_cull_instances > 0) {
+        std::cout << "Occlusion culling: " << drawn_first_phase + drawn_second_phase << " of " << culler.count()
+            << " instances drawn (" << drawn_first_phase << " visible last frame, " << drawn_second_phase
+            << " newly visible)" << std::endl;
+    }
+
+    std::cout << "Submission: ";
+    scheduler.report(std::cout, frames_since_report);
+    std::cout << std::endl;
+
+    std::cout << "Memory: ";
+    memory.print(std::cout);
+    if (msaa_samples != supported_msaa_samples || render_scale_limit < MAX_RENDER_SCALE) {
+        std::cout << " (reduced to " << msaa_samples << "x MSAA, render scale at most " << render_scale_limit << ")";
+    }
+    std::cout << std::endl;
+
+    frames_since_report = 0;
+    last_report_time = now;
+}
+
+VkDeviceSize triangle_application::render_target_bytes(float scale_limit, VkSampleCountFlagBits samples) {
+    // Swap chain formats have four bytes per pixel
+    VkExtent2D extent = scaled_extent(scale_limit);
+    VkDeviceSize pixels = static_cast<VkDeviceSize>(extent.width) * extent.height;
+    VkDeviceSize images = MAX_FRAMES_IN_FLIGHT + (samples != VK_SAMPLE_COUNT_1_BIT ? samples : 0);
+    if (occlusion_cull_instances > 0) {
+        // The depth image, and the pyramid at a third more than its first level
+        return pixels * 4 * images + pixels * 4 + pixels * 4 * 4 / 3;
+    }
+    return pixels * 4 * images;
+}
+
+VkDeviceSize triangle_application::estimated_device_local_bytes() {
+    VkDeviceSize bytes = render_target_bytes(render_scale_limit, msaa_samples) + streamed_texture_bytes;
+
+    VkMemoryRequirements requirements;
+    for (const auto &image : texture_images) {
+        vkGetImageMemoryRequirements(device, image, &requirements);
+        bytes += requirements.size;
+    }
+    if (mesh.buffer) {
+        vkGetBufferMemoryRequirements(device, mesh.buffer, &requirements);
+        bytes += requirements.size;
+    }
+    for (const auto &chunk : tessellated.chunks) {
+        vkGetBufferMemoryRequirements(device, chunk.buffer, &requirements);
+        bytes += requirements.size;
+    }
+    return bytes;
+}
+
+void triangle_application::check_memory_budget() {
+    auto now = std::chrono::steady_clock::now();
+    if (std::chrono::duration<double>(now - last_budget_check_time).count() < MEMORY_BUDGET_CHECK_INTERVAL_S) {
+        return;
+    }
+    last_budget_check_time = now;
+
+    if (!memory_budget_enabled) {
+        memory.set_estimated_usage(estimated_device_local_bytes());
+    }
+    memory.update();
+    if (!memory.tracks_usage()) {
+        return;
+    }
+
+    // Gives up one thing per check, so the driver's numbers reflect the
+    // memory freed before deciding on the next
+    double pressure = memory.device_local_pressure();
+    if (pressure > MEMORY_PRESSURE_HIGH) {
+        if (msaa_samples != VK_SAMPLE_COUNT_1_BIT) {
+            std::cout << "Device memory at " << pressure * 100.0 << "% of budget, disabling MSAA" << std::endl;
+            set_msaa_samples(VK_SAMPLE_COUNT_1_BIT);
+        } else if (render_scale_limit > MIN_RENDER_SCALE) {
+            float limit = std::max(MIN_RENDER_SCALE, render_scale_limit * RENDER_SCALE_LIMIT_STEP);
+            std::cout << "Device memory at " << pressure * 100.0 << "% of budget, limiting render scale to " << limit << std::endl;
+            set_render_scale_limit(limit);
+        }
+        return;
+    }
+
+    // Restored in reverse order, and only if the estimated cost keeps the
+    // pressure low enough not to give it up again at the next check
+    if (render_scale_limit < MAX_RENDER_SCALE) {
+        float limit = std::min(MAX_RENDER_SCALE, render_scale_limit / RENDER_SCALE_LIMIT_STEP);
+        VkDeviceSize cost = render_target_bytes(limit, msaa_samples) - render_target_bytes(render_scale_limit, msaa_samples);
+        if (memory.device_local_pressure(cost) < MEMORY_PRESSURE_LOW) {
+            std::cout << "Device memory pressure has eased, raising render scale limit to " << limit << std::endl;
+            set_render_scale_limit(limit);
+        }
+    } else if (msaa_samples != supported_msaa_samples) {
+        VkDeviceSize cost = render_target_bytes(render_scale_limit, supported_msaa_samples) - render_target_bytes(render_scale_limit, msaa_samples);
+        if (memory.device_local_pressure(cost) < MEMORY_PRESSURE_LOW) {
+            std::cout << "Device memory pressure has eased, restoring " << supported_msaa_samples << "x MSAA" << std::endl;
+            set_msaa_samples(supported_msaa_samples);
+        }
+    }
+}
+
+void triangle_application::set_msaa_samples(VkSampleCountFlagBits samples) {
+    msaa_samples = samples;
+
+    // The attachments change, so does the render pass. Pipelines only need a
+    // compatible render pass, so the old variants stay valid for when the
+    // sample count returns; the new ones are compiled right away rather than
+    // in the middle of recording.
+    retired_resources.retire(submitted_frames, std::move(render_pass));
+    if (second_phase_render_pass) {
+        retired_resources.retire(submitted_frames, std::move(second_phase_render_pass));
+    }
+    create_render_pass();
+    scene_pipelines.set_render_pass(render_pass);
+    mesh_pipelines.set_render_pass(render_pass);
+    tessellation_pipelines.set_render_pass(render_pass);
+    culled_pipelines.set_render_pass(render_pass);
+    precompile_pipelines();
+
+    recreate_render_targets();
+}
+
+void triangle_application::set_render_scale_limit(float limit) {
+    render_scale_limit = limit;
+    render_scale = std::min(render_scale, render_scale_limit);
+    recreate_render_targets();
+}
+
 void triangle_application::cleanup() {
+    // main_loop has waited for the device, so everything retired is unused.
+    // The handles release their objects here, before the device goes away.
+    retired_resources.flush();
+    streamer.cleanup();
     cleanup_swap_chain();
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        vkDestroySemaphore(device, image_available_semaphores[i], nullptr);
-        vkDestroySemaphore(device, render_finished_semaphores[i], nullptr);
-        vkDestroyFence(device, in_flight_fences[i], nullptr);
-    }
-    vkDestroyCommandPool(device, command_pool, nullptr);
-    vkDestroyPipeline(device, graphics_pipeline, nullptr);
-    vkDestroyPipelineLayout(device, pipeline_layout, nullptr);
-    vkDestroyRenderPass(device, render_pass, nullptr);
+    for (auto &target : surfaces) {
+        target.image_available_semaphores.clear();
+        target.render_finished_semaphores.clear();
+    }
+    in_flight_fences.clear();
+    timestamp_query_pool.reset();
+    descriptor_pool.reset();
+    instance_buffers.clear();
+    instance_buffer_memories.clear();
+    instance_texture_slots.clear();
+    texture_image_views.clear();
+    texture_images.clear();
+    texture_image_memories.clear();
+    command_pool.reset();
+    mesh = gpu_mesh{};
+    mesh_pipelines.cleanup();
+    mesh_pipeline_layout.reset();
+    tessellated = gpu_tessellation{};
+    tessellation_pipelines.cleanup();
+    tessellation_pipeline_layout.reset();
+    culled_pipelines.cleanup();
+    culler.cleanup();
+    scene_pipelines.cleanup();
+    save_pipeline_cache(device, pipeline_cache, WINDOW_PIPELINE_CACHE_FILE);
+    pipeline_cache.reset();
+    pipeline_layout.reset();
+    descriptor_set_layout.reset();
+    texture_sampler.reset();
+    render_pass.reset();
+    second_phase_render_pass.reset();
     vkDestroyDevice(device, nullptr);
     if (enable_validation_layers) {
         DestroyDebugUtilsMessengerEXT(instance, debug_messenger, nullptr);
     }
-    vkDestroySurfaceKHR(instance, surface, nullptr);
+    for (const auto &target : surfaces) {
+        vkDestroySurfaceKHR(instance, target.surface, nullptr);
+    }
     vkDestroyInstance(instance, nullptr);
-    glfwDestroyWindow(window);
-    glfwTerminate();
+    if (!headless_surfaces) {
+        for (const auto &target : surfaces) {
+            glfwDestroyWindow(target.window);
+        }
+        glfwTerminate();
+    }
 }
 
 VkResult CreateDebugUtilsMessengerEXT(VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT *pCreateInfo, const VkAllocationCallbacks *pAllocator, VkDebugUtilsMessengerEXT *pMessenger) {
@@ -0,0 +1,221 @@
+#include "vulkan_utils.h"
+#include "config.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+bool check_validation_layer_support() {
+    std::uint32_t layer_count;
+    vkEnumerateInstanceLayerProperties(&layer_count, nullptr);
+
+    std::vector<VkLayerProperties> available_layers(layer_count);
+    vkEnumerateInstanceLayerProperties(&layer_count, available_layers.data());
+
+    for (const char *layer_name : validation_layers) {
+        bool layer_found = false;
+
+        for (const auto &layer_properties : available_layers) {
+            if (strcmp(layer_name, layer_properties.layerName) == 0) {
+                layer_found = true;
+                break;
+            }
+        }
+
+        if (!layer_found)
+            return false;
+    }
+
+    return true;
+}
+
+std::vector<char> read_file(const std::string &filename) {
+    std::ifstream file(filename, std::ios::ate | std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open file!");
+    }
+
+    size_t file_size = (size_t) file.tellg();
+    std::vector<char> buffer(file_size);
+
+    file.seekg(0);
+    file.read(buffer.data(), file_size);
+    file.close();
+
+    return buffer;
+}
+
+VkShaderModule create_shader_module(VkDevice device, const std::vector<char> &code) {
+    VkShaderModuleCreateInfo create_info{};
+    create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    create_info.codeSize = code.size();
+    create_info.pCode = reinterpret_cast<const std::uint32_t *>(code.data());
+
+    VkShaderModule shader_module;
+    if (vkCreateShaderModule(device, &create_info, nullptr, &shader_module) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create shader module!");
+    }
+
+    return shader_module;
+}
+
+VkPipelineCache load_pipeline_cache(VkDevice device, const std::string &filename) {
+    // The data is passed on as is; the driver ignores data written by a
+    // different device or driver version
+    std::vector<char> cache_data;
+    try {
+        cache_data = read_file(filename);
+    } catch (const std::runtime_error &) {
+        cache_data.clear();
+    }
+
+    VkPipelineCacheCreateInfo create_info{};
+    create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    create_info.initialDataSize = cache_data.size();
+    create_info.pInitialData = cache_data.empty() ? nullptr : cache_data.data();
+
+    VkPipelineCache pipeline_cache;
+    if (vkCreatePipelineCache(device, &create_info, nullptr, &pipeline_cache) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create pipeline cache!");
+    }
+
+    return pipeline_cache;
+}
+
+void save_pipeline_cache(VkDevice device, VkPipelineCache pipeline_cache, const std::string &filename) {
+    size_t data_size = 0;
+    if (vkGetPipelineCacheData(device, pipeline_cache, &data_size, nullptr) != VK_SUCCESS || data_size == 0) {
+        return;
+    }
+
+    std::vector<char> data(data_size);
+    if (vkGetPipelineCacheData(device, pipeline_cache, &data_size, data.data()) != VK_SUCCESS) {
+        return;
+    }
+
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    file.write(data.data(), data_size);
+}
+
+std::uint32_t find_memory_type(VkPhysicalDevice physical_device, std::uint32_t type_filter,
+        VkMemoryPropertyFlags properties, VkMemoryPropertyFlags preferred_properties) {
+    VkPhysicalDeviceMemoryProperties memory_properties;
+    vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
+
+    if (preferred_properties != 0) {
+        VkMemoryPropertyFlags all_properties = properties | preferred_properties;
+        for (std::uint32_t i = 0; i < memory_properties.memoryTypeCount; i++) {
+            if ((type_filter & (1 << i)) && (memory_properties.memoryTypes[i].propertyFlags & all_properties) == all_properties) {
+                return i;
+            }
+        }
+    }
+
+    for (std::uint32_t i = 0; i < memory_properties.memoryTypeCount; i++) {
+        if ((type_filter & (1 << i)) && (memory_properties.memoryTypes[i].propertyFlags & properties) == properties) {
+            return i;
+        }
+    }
+
+    throw std::runtime_error("Failed to find a suitable memory type!");
+}
+
+void create_image(VkPhysicalDevice physical_device, VkDevice device, std::uint32_t width, std::uint32_t height,
+        VkSampleCountFlagBits samples, VkFormat format, VkImageUsageFlags usage, VkMemoryPropertyFlags properties,
+        VkMemoryPropertyFlags preferred_properties, VkImage &image, VkDeviceMemory &image_memory) {
+    create_image(physical_device, device, width, height, 1, samples, format, usage, properties, preferred_properties,
+            image, image_memory);
+}
+
+void create_image(VkPhysicalDevice physical_device, VkDevice device, std::uint32_t width, std::uint32_t height,
+        std::uint32_t mip_levels, VkSampleCountFlagBits samples, VkFormat format, VkImageUsageFlags usage,
+        VkMemoryPropertyFlags properties, VkMemoryPropertyFlags preferred_properties, VkImage &image,
+        VkDeviceMemory &image_memory) {
+    VkImageCreateInfo image_info{};
+    image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.imageType = VK_IMAGE_TYPE_2D;
+    image_info.extent.width = width;
+    image_info.extent.height = height;
+    image_info.extent.depth = 1;
+    image_info.mipLevels = mip_levels;
+    image_info.arrayLayers = 1;
+    image_info.format = format;
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    image_info.usage = usage;
+    image_info.samples = samples;
+    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateImage(device, &image_info, nullptr, &image) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create image!");
+    }
+
+    VkMemoryRequirements memory_requirements;
+    vkGetImageMemoryRequirements(device, image, &memory_requirements);
+
+    VkMemoryAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    alloc_info.allocationSize = memory_requirements.size;
+    alloc_info.memoryTypeIndex = find_memory_type(physical_device, memory_requirements.memoryTypeBits, properties, preferred_properties);
+
+    if (vkAllocateMemory(device, &alloc_info, nullptr, &image_memory) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate image memory!");
+    }
+
+    vkBindImageMemory(device, image, image_memory, 0);
+}
+
+VkImageView create_image_view(VkDevice device, VkImage image, VkFormat format, VkImageAspectFlags aspect_flags,
+        std::uint32_t mip_levels) {
+    VkImageViewCreateInfo create_info{};
+    create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    create_info.image = image;
+    create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    create_info.format = format;
+    create_info.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+    create_info.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+    create_info.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+    create_info.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+    create_info.subresourceRange.aspectMask = aspect_flags;
+    create_info.subresourceRange.baseMipLevel = 0;
+    create_info.subresourceRange.levelCount = mip_levels;
+    create_info.subresourceRange.baseArrayLayer = 0;
+    create_info.subresourceRange.layerCount = 1;
+
+    VkImageView image_view;
+    if (vkCreateImageView(device, &create_info, nullptr, &image_view) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create image views!");
+    }
+
+    return image_view;
+}
+
+void create_buffer(VkPhysicalDevice physical_device, VkDevice device, VkDeviceSize size, VkBufferUsageFlags usage,
+        VkMemoryPropertyFlags properties, VkMemoryPropertyFlags preferred_properties, VkBuffer &buffer,
+        VkDeviceMemory &buffer_memory) {
+    VkBufferCreateInfo buffer_info{};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = size;
+    buffer_info.usage = usage;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateBuffer(device, &buffer_info, nullptr, &buffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create buffer!");
+    }
+
+    VkMemoryRequirements memory_requirements;
+    vkGetBufferMemoryRequirements(device, buffer, &memory_requirements);
+
+    VkMemoryAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    alloc_info.allocationSize = memory_requirements.size;
+    alloc_info.memoryTypeIndex = find_memory_type(physical_device, memory_requirements.memoryTypeBits, properties, preferred_properties);
+
+    if (vkAllocateMemory(device, &alloc_info, nullptr, &buffer_memory) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate buffer memory!");
+    }
+
+    vkBindBufferMemory(device, buffer, buffer_memory, 0);
+}